@@ -0,0 +1,822 @@
+/*
+* End-to-end HTTP load generator for the Student Management server
+* Writes a generated database of N students into a scratch directory, starts
+* the server binary on it, and replays request mixes (student login, student
+* lookup, teacher department listing, subject mark PUTs, registrations) over
+* keep-alive connections, one closed-loop client thread per connection.
+* Reports throughput and p50/p99/p999 latency per scenario and per request
+* type; --json writes the same numbers so runs can be compared across commits.
+* --scenario conn-cap instead checks that the server idles while clients wait
+* at its --max-connections cap.
+* Compile (Linux): gcc -O2 -o load_gen bench/load_gen.c -lpthread
+* Usage: load_gen [--server PATH] [--port N] [--students N] [--connections N]
+*                 [--duration SECONDS] [--warmup SECONDS] [--scenario NAME|all]
+*                 [--json FILE] [--label TEXT] [-- SERVER_OPTIONS...]
+*/
+
+#define SMS_NO_MAIN
+#include "../student_server_enhanced.c"
+#ifdef _WIN32
+#include <direct.h>
+#define makeDirectory(path) _mkdir(path)
+#else
+#include <sys/wait.h>
+#define makeDirectory(path) mkdir(path, 0755)
+#endif
+
+#define LOAD_RUN_DIR "loadgen_run"
+#define LOAD_MAX_CONNECTIONS 1024
+#define LOAD_MAX_SERVER_ARGS 32
+#define LOAD_READY_TIMEOUT_MS 120000
+#define LOAD_LIST_PAGE 100
+#define LOAD_CAP_CONNECTIONS 2    // --max-connections for the conn-cap check
+#define LOAD_CAP_MAX_CPU 0.05     // share of a core the server may use while idle at the cap
+#define LOAD_CAP_TIMEOUT_MS 5000
+
+static const char* g_loadDepartments[] = {"CSE", "ECE", "EEE", "MECH", "CIVIL", "IT", "AIDS", "CSBS"};
+#define LOAD_DEPARTMENTS 8
+
+// Request types a scenario mixes
+enum {
+    OP_STUDENT_LOGIN,
+    OP_GET_STUDENT,
+    OP_LIST_DEPARTMENT,
+    OP_PUT_SUBJECT,
+    OP_REGISTER,
+    OP_COUNT
+};
+
+static const char* g_opNames[OP_COUNT] = {"student-login", "get-student", "list-department", "put-subject", "register"};
+
+// A named mix: relative weight of each request type
+typedef struct {
+    const char* name;
+    int weights[OP_COUNT];
+} Scenario;
+
+static const Scenario g_scenarios[] = {
+    {"login",           {100, 0, 0, 0, 0}},
+    {"get-student",     {0, 100, 0, 0, 0}},
+    {"list-department", {0, 0, 100, 0, 0}},
+    {"put-subject",     {0, 0, 0, 100, 0}},
+    {"register",        {0, 0, 0, 0, 100}},
+    // Dashboard traffic: mostly reads, a fifth mark entry, a few sign-ups
+    {"mixed",           {10, 50, 15, 20, 5}},
+};
+#define SCENARIO_COUNT (int)(sizeof(g_scenarios) / sizeof(g_scenarios[0]))
+
+typedef struct {
+    const char* serverPath;
+    int port;
+    int students;
+    int teachers;
+    int connections;
+    int duration;
+    int warmup;
+    const char* scenario;
+    const char* jsonPath;
+    const char* label;
+    char* serverArgs[LOAD_MAX_SERVER_ARGS];
+    int serverArgCount;
+} LoadConfig;
+
+static LoadConfig g_load = {
+#ifdef _WIN32
+    "student_server.exe",
+#else
+    "./student_server",
+#endif
+    18080, 10000, 0, 16, 10, 2, "all", NULL, NULL, {NULL}, 0
+};
+
+// Growable array of request latencies in nanoseconds
+typedef struct {
+    unsigned int* items;
+    long count;
+    long cap;
+} LatencyLog;
+
+// Client phases, read by every client thread between requests
+enum { PHASE_WARMUP, PHASE_MEASURE, PHASE_STOP };
+static volatile int g_loadPhase;
+
+// One connection and the results it gathered
+typedef struct {
+    int index;
+    const Scenario* scenario;
+    socket_t sock;
+    unsigned int random;
+    int department;
+    char teacherEmail[64];
+    char token[80];
+    OutBuffer request;
+    char* response;
+    int responseCap;
+    LatencyLog latency[OP_COUNT];
+    long errors[OP_COUNT];
+    long reconnects;
+} LoadClient;
+
+// Merged results of one request type (or of the whole scenario)
+typedef struct {
+    long requests;
+    long errors;
+    double throughput;
+    double p50, p99, p999, max;  // microseconds
+} LoadSummary;
+
+static double loadNanos() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static void loadSleep(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+static unsigned int loadRandom(unsigned int* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static void latencyAdd(LatencyLog* log, double nanos) {
+    if (log->count == log->cap) {
+        log->cap = log->cap ? log->cap * 2 : 4096;
+        log->items = (unsigned int*)realloc(log->items, log->cap * sizeof(unsigned int));
+    }
+    log->items[log->count++] = nanos < 4e9 ? (unsigned int)nanos : 4000000000u;
+}
+
+// ---------------------------------------------------------------------------
+// Database and server process
+// ---------------------------------------------------------------------------
+
+// Snapshot-format database: student i (id 1001 + i) and teacher i are in
+// department i % 8, and every student has subjects SUB0..SUB4
+static int writeLoadDatabase(const char* path, int students, int teachers) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "{\n  \"nextStudentId\": %d,\n  \"nextTeacherId\": %d,\n  \"nextPrincipalId\": 3001,\n",
+            1001 + students, 2001 + teachers);
+    fprintf(f, "  \"walLsn\": 0,\n  \"students\": [\n");
+    for (int i = 0; i < students; i++) {
+        fprintf(f, "%s    {\n      \"studentId\": %d,\n      \"name\": \"Student %d\",\n", i ? ",\n" : "", 1001 + i, i);
+        fprintf(f, "      \"password\": \"pass%d\",\n      \"email\": \"student%d@bench.edu\",\n", i, i);
+        fprintf(f, "      \"department\": \"%s\",\n      \"year\": %d,\n      \"semester\": %d,\n",
+                g_loadDepartments[i % LOAD_DEPARTMENTS], 1 + i % 4, 1 + i % 8);
+        fprintf(f, "      \"cgpa\": %.2f,\n      \"attendance\": %.2f,\n      \"subjects\": [\n", (i % 100) / 10.0, 50 + i % 50 * 1.0);
+        for (int j = 0; j < 5; j++) {
+            fprintf(f, "%s        {\n          \"subjectId\": \"SUB%d\",\n          \"name\": \"Subject %d\",\n", j ? ",\n" : "", j, j);
+            fprintf(f, "          \"mid1\": %d,\n          \"mid2\": %d,\n          \"final\": %d,\n", i % 30, (i + j) % 30, i % 70);
+            fprintf(f, "          \"attendance_percent\": %.2f,\n          \"remarks\": \"Good\"\n        }", 60.0 + j);
+        }
+        fprintf(f, "\n      ]\n    }");
+    }
+    fprintf(f, "\n  ],\n  \"teachers\": [\n");
+    for (int i = 0; i < teachers; i++) {
+        fprintf(f, "%s    {\n      \"teacherId\": %d,\n      \"name\": \"Teacher %d\",\n", i ? ",\n" : "", 2001 + i, i);
+        fprintf(f, "      \"password\": \"pass%d\",\n      \"email\": \"teacher%d@bench.edu\",\n", i, i);
+        fprintf(f, "      \"department\": \"%s\",\n      \"approved\": 1,\n      \"approvalDate\": \"2024-01-01 09:00:00\"\n    }",
+                g_loadDepartments[i % LOAD_DEPARTMENTS]);
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+#ifdef _WIN32
+static PROCESS_INFORMATION g_serverProcess;
+#else
+static pid_t g_serverProcess;
+#endif
+
+// Starts the server in LOAD_RUN_DIR with its output in server.log there.
+// Any previous WAL is removed so every run starts from the generated snapshot.
+static int startServer() {
+    char serverPath[1024];
+    char port[16];
+    char* argv[LOAD_MAX_SERVER_ARGS + 4];
+    int argc = 0;
+
+    remove(LOAD_RUN_DIR "/" WAL_FILE);
+    snprintf(port, sizeof(port), "%d", g_load.port);
+#ifdef _WIN32
+    if (!_fullpath(serverPath, g_load.serverPath, sizeof(serverPath))) return -1;
+#else
+    if (!realpath(g_load.serverPath, serverPath)) return -1;
+#endif
+    argv[argc++] = serverPath;
+    argv[argc++] = "--port";
+    argv[argc++] = port;
+    for (int i = 0; i < g_load.serverArgCount; i++) argv[argc++] = g_load.serverArgs[i];
+    argv[argc] = NULL;
+
+#ifdef _WIN32
+    char command[4096];
+    int n = 0;
+    for (int i = 0; i < argc; i++) n += snprintf(command + n, sizeof(command) - n, "%s\"%s\"", i ? " " : "", argv[i]);
+    SECURITY_ATTRIBUTES inherit = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+    HANDLE log = CreateFileA(LOAD_RUN_DIR "\\server.log", GENERIC_WRITE, FILE_SHARE_READ, &inherit,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    STARTUPINFOA startup;
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdOutput = log;
+    startup.hStdError = log;
+    int started = CreateProcessA(NULL, command, NULL, NULL, TRUE, 0, NULL, LOAD_RUN_DIR, &startup, &g_serverProcess);
+    CloseHandle(log);
+    return started ? 0 : -1;
+#else
+    g_serverProcess = fork();
+    if (g_serverProcess < 0) return -1;
+    if (g_serverProcess == 0) {
+        if (chdir(LOAD_RUN_DIR) != 0) _exit(127);
+        int log = open("server.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (log >= 0) {
+            dup2(log, 1);
+            dup2(log, 2);
+            close(log);
+        }
+        execv(serverPath, argv);
+        _exit(127);
+    }
+    return 0;
+#endif
+}
+
+static int serverRunning() {
+#ifdef _WIN32
+    return WaitForSingleObject(g_serverProcess.hProcess, 0) == WAIT_TIMEOUT;
+#else
+    return waitpid(g_serverProcess, NULL, WNOHANG) == 0;
+#endif
+}
+
+static void stopServer() {
+#ifdef _WIN32
+    TerminateProcess(g_serverProcess.hProcess, 0);
+    WaitForSingleObject(g_serverProcess.hProcess, INFINITE);
+    CloseHandle(g_serverProcess.hProcess);
+    CloseHandle(g_serverProcess.hThread);
+#else
+    kill(g_serverProcess, SIGTERM);
+    waitpid(g_serverProcess, NULL, 0);
+#endif
+}
+
+// CPU seconds the server has used so far, or -1 where that cannot be read
+static double serverCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(g_serverProcess.hProcess, &created, &exited, &kernel, &user)) return -1;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) / 1e7;
+#elif defined(__linux__)
+    char path[64], stat[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)g_serverProcess);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    size_t len = fread(stat, 1, sizeof(stat) - 1, f);
+    fclose(f);
+    stat[len] = '\0';
+    // utime and stime are the 12th and 13th fields after the "(comm)" one
+    char* p = strrchr(stat, ')');
+    unsigned long long utime, stime;
+    if (!p || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) return -1;
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+#else
+    return -1;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// HTTP client
+// ---------------------------------------------------------------------------
+
+static socket_t loadConnect() {
+    struct sockaddr_in addr;
+    socket_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == SOCK_INVALID) return SOCK_INVALID;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)g_load.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        sockClose(sock);
+        return SOCK_INVALID;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    return sock;
+}
+
+// Polls until the server accepts connections; loading a large database
+// takes a while
+static int waitForServer() {
+    long long deadline = nowMillis() + LOAD_READY_TIMEOUT_MS;
+    while (nowMillis() < deadline) {
+        socket_t sock = loadConnect();
+        if (sock != SOCK_INVALID) {
+            sockClose(sock);
+            return 0;
+        }
+        if (!serverRunning()) return -1;
+        loadSleep(50);
+    }
+    return -1;
+}
+
+// Appends one keep-alive request to out
+static void buildRequest(OutBuffer* out, const char* method, const char* path, const char* token, const char* body) {
+    bufPrintf(out, "%s %s HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n", method, path);
+    if (token) bufPrintf(out, "Authorization: Bearer %s\r\n", token);
+    if (body) {
+        bufPrintf(out, "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n", (int)strlen(body));
+        queueOutput(out, body, (int)strlen(body));
+    } else {
+        queueOutput(out, "\r\n", 2);
+    }
+}
+
+// Sends the client's pending request and reads the whole response into
+// client->response. Returns the HTTP status, or -1 if the connection failed.
+static int exchange(LoadClient* client) {
+    for (int sent = 0; sent < client->request.len;) {
+        int n = (int)send(client->sock, client->request.data + sent, client->request.len - sent, SEND_FLAGS);
+        if (n <= 0) return -1;
+        sent += n;
+    }
+    client->request.len = 0;
+
+    int len = 0;
+    int headerLen = 0;
+    int total = -1;
+    while (total < 0 || len < total) {
+        if (len == client->responseCap) {
+            client->responseCap *= 2;
+            client->response = (char*)realloc(client->response, client->responseCap + 1);
+        }
+        int n = (int)recv(client->sock, client->response + len, client->responseCap - len, 0);
+        if (n <= 0) return -1;
+        len += n;
+        client->response[len] = '\0';
+        if (total < 0) {
+            char* end = strstr(client->response, "\r\n\r\n");
+            if (!end) continue;
+            headerLen = (int)(end + 4 - client->response);
+            char length[24];
+            total = headerLen + (findHeader(client->response, end, "Content-Length", length, sizeof(length)) ? atoi(length) : 0);
+        }
+    }
+    return atoi(client->response + 9);  // "HTTP/1.1 200"
+}
+
+// Logs in as teacher 'index' for the subject PUTs. Returns 0 on success.
+static int teacherLogin(LoadClient* client) {
+    char body[160];
+    int teacher = client->index % g_load.teachers;
+    client->department = teacher % LOAD_DEPARTMENTS;
+    snprintf(client->teacherEmail, sizeof(client->teacherEmail), "teacher%d@bench.edu", teacher);
+    snprintf(body, sizeof(body), "{\"email\":\"%s\",\"password\":\"pass%d\"}", client->teacherEmail, teacher);
+    buildRequest(&client->request, "POST", "/api/teacher/login", NULL, body);
+    if (exchange(client) != 200) return -1;
+
+    char* token = strstr(client->response, "\"token\":\"");
+    if (!token) return -1;
+    token += 9;
+    int n = 0;
+    while (token[n] && token[n] != '"' && n < (int)sizeof(client->token) - 1) n++;
+    memcpy(client->token, token, n);
+    client->token[n] = '\0';
+    return 0;
+}
+
+// A random generated student, optionally restricted to one department
+static int pickStudent(LoadClient* client, int department) {
+    int i = (int)(loadRandom(&client->random) % g_load.students);
+    if (department >= 0) {
+        i = i - i % LOAD_DEPARTMENTS + department;
+        if (i >= g_load.students) i -= LOAD_DEPARTMENTS;
+    }
+    return i;
+}
+
+static int pickOperation(LoadClient* client) {
+    int total = 0;
+    for (int op = 0; op < OP_COUNT; op++) total += client->scenario->weights[op];
+    int r = (int)(loadRandom(&client->random) % total);
+    for (int op = 0; op < OP_COUNT; op++) {
+        r -= client->scenario->weights[op];
+        if (r < 0) return op;
+    }
+    return OP_COUNT - 1;
+}
+
+// Queues one request of the given type in client->request
+static void buildOperation(LoadClient* client, int op) {
+    char path[160];
+    char body[256];
+    int i;
+    switch (op) {
+        case OP_STUDENT_LOGIN:
+            i = pickStudent(client, -1);
+            snprintf(body, sizeof(body), "{\"studentId\":%d,\"password\":\"pass%d\"}", 1001 + i, i);
+            buildRequest(&client->request, "POST", "/api/student/login", NULL, body);
+            break;
+        case OP_GET_STUDENT:
+            snprintf(path, sizeof(path), "/api/students/%d", 1001 + pickStudent(client, -1));
+            buildRequest(&client->request, "GET", path, NULL, NULL);
+            break;
+        case OP_LIST_DEPARTMENT:
+            // One dashboard page, starting at a random student of the department
+            i = pickStudent(client, client->department);
+            snprintf(body, sizeof(body), "{\"role\":\"teacher\",\"department\":\"%s\",\"email\":\"%s\",\"limit\":\"%d\",\"cursor\":\"%d\"}",
+                     g_loadDepartments[client->department], client->teacherEmail, LOAD_LIST_PAGE, 1000 + i);
+            buildRequest(&client->request, "POST", "/api/students", NULL, body);
+            break;
+        case OP_PUT_SUBJECT:
+            i = pickStudent(client, client->department);
+            snprintf(path, sizeof(path), "/api/students/%d/subjects/SUB%d", 1001 + i, (int)(loadRandom(&client->random) % 5));
+            snprintf(body, sizeof(body), "{\"mid1\":%d,\"mid2\":%d,\"final\":%d,\"attendance_percent\":%d,\"remarks\":\"Load\"}",
+                     (int)(loadRandom(&client->random) % 31), (int)(loadRandom(&client->random) % 31),
+                     (int)(loadRandom(&client->random) % 71), 50 + (int)(loadRandom(&client->random) % 51));
+            buildRequest(&client->request, "PUT", path, client->token, body);
+            break;
+        default:
+            i = (int)(loadRandom(&client->random) % 1000000);
+            snprintf(body, sizeof(body), "{\"name\":\"Load %d\",\"password\":\"pass%d\",\"email\":\"load%d@bench.edu\",\"department\":\"%s\",\"year\":%d}",
+                     i, i, i, g_loadDepartments[client->department], 1 + i % 4);
+            buildRequest(&client->request, "POST", "/api/student/register", NULL, body);
+            break;
+    }
+}
+
+// Closed loop: one request in flight per connection until PHASE_STOP.
+// Requests finished during the warmup are not recorded.
+static THREAD_RETURN clientMain(void* arg) {
+    LoadClient* client = (LoadClient*)arg;
+    while (g_loadPhase != PHASE_STOP) {
+        if (client->sock == SOCK_INVALID) {
+            client->sock = loadConnect();
+            if (client->sock == SOCK_INVALID) {
+                loadSleep(10);
+                continue;
+            }
+        }
+        int op = pickOperation(client);
+        buildOperation(client, op);
+        double start = loadNanos();
+        int status = exchange(client);
+        double nanos = loadNanos() - start;
+        int recording = g_loadPhase == PHASE_MEASURE;
+        if (status < 0) {
+            sockClose(client->sock);
+            client->sock = SOCK_INVALID;
+            client->request.len = 0;
+            client->reconnects++;
+        }
+        if (!recording) continue;
+        if (status < 200 || status >= 300) client->errors[op]++;
+        else latencyAdd(&client->latency[op], nanos);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Scenarios and reporting
+// ---------------------------------------------------------------------------
+
+static int compareLatency(const void* a, const void* b) {
+    unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const LatencyLog* log, double p) {
+    if (log->count == 0) return 0;
+    long rank = (long)(p * log->count + 0.999999);
+    if (rank < 1) rank = 1;
+    return log->items[rank - 1] / 1e3;
+}
+
+// Sorts the merged log and fills in its summary
+static void summarize(LatencyLog* log, long errors, double seconds, LoadSummary* out) {
+    qsort(log->items, log->count, sizeof(unsigned int), compareLatency);
+    out->requests = log->count;
+    out->errors = errors;
+    out->throughput = log->count / seconds;
+    out->p50 = percentile(log, 0.50);
+    out->p99 = percentile(log, 0.99);
+    out->p999 = percentile(log, 0.999);
+    out->max = log->count ? log->items[log->count - 1] / 1e3 : 0;
+}
+
+static void printLoadSummary(const char* name, const LoadSummary* s) {
+    printf("  %-16s %9ld req %10.1f req/s  p50 %8.1f  p99 %8.1f  p999 %8.1f  max %9.1f us  %ld errors\n",
+           name, s->requests, s->throughput, s->p50, s->p99, s->p999, s->max, s->errors);
+}
+
+static void loadSummaryToJSON(OutBuffer* out, const char* key, const LoadSummary* s) {
+    jsonOpen(out, key, '{');
+    jsonPutInt(out, "requests", s->requests);
+    jsonPutInt(out, "errors", s->errors);
+    jsonPutNumber(out, "throughput", s->throughput);
+    jsonPutNumber(out, "p50Us", s->p50);
+    jsonPutNumber(out, "p99Us", s->p99);
+    jsonPutNumber(out, "p999Us", s->p999);
+    jsonPutNumber(out, "maxUs", s->max);
+    jsonClose(out, '}');
+}
+
+// Runs one scenario on fresh connections and appends its results to json
+static int runScenario(const Scenario* scenario, OutBuffer* json) {
+    int count = g_load.connections;
+    LoadClient* clients = (LoadClient*)calloc(count, sizeof(LoadClient));
+    for (int c = 0; c < count; c++) {
+        LoadClient* client = &clients[c];
+        client->index = c;
+        client->scenario = scenario;
+        client->random = 2463534242u + 7919u * c;
+        client->responseCap = 1 << 16;
+        client->response = (char*)malloc(client->responseCap + 1);
+        client->sock = loadConnect();
+        if (client->sock == SOCK_INVALID || teacherLogin(client) != 0) {
+            printf("  ✗ Connection %d could not log in as a teacher\n", c);
+            return -1;
+        }
+    }
+
+    g_loadPhase = PHASE_WARMUP;
+#ifdef _WIN32
+    HANDLE* threads = (HANDLE*)malloc(count * sizeof(HANDLE));
+    for (int c = 0; c < count; c++) threads[c] = CreateThread(NULL, 0, clientMain, &clients[c], 0, NULL);
+#else
+    pthread_t* threads = (pthread_t*)malloc(count * sizeof(pthread_t));
+    for (int c = 0; c < count; c++) pthread_create(&threads[c], NULL, clientMain, &clients[c]);
+#endif
+    loadSleep(g_load.warmup * 1000);
+    g_loadPhase = PHASE_MEASURE;
+    double start = loadNanos();
+    loadSleep(g_load.duration * 1000);
+    g_loadPhase = PHASE_STOP;
+    double seconds = (loadNanos() - start) / 1e9;
+#ifdef _WIN32
+    for (int c = 0; c < count; c++) {
+        WaitForSingleObject(threads[c], INFINITE);
+        CloseHandle(threads[c]);
+    }
+#else
+    for (int c = 0; c < count; c++) pthread_join(threads[c], NULL);
+#endif
+    free(threads);
+
+    // Merge the per-connection logs, per request type and overall
+    LatencyLog all = {NULL, 0, 0};
+    LoadSummary total, perOp[OP_COUNT];
+    long totalErrors = 0, reconnects = 0;
+    printf("Scenario %s (%d connections, %.1f s)\n", scenario->name, count, seconds);
+    jsonOpen(json, NULL, '{');
+    jsonPutString(json, "name", scenario->name);
+    jsonOpen(json, "operations", '{');
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (scenario->weights[op] == 0) continue;
+        LatencyLog merged = {NULL, 0, 0};
+        long errors = 0;
+        for (int c = 0; c < count; c++) {
+            LatencyLog* log = &clients[c].latency[op];
+            for (long k = 0; k < log->count; k++) latencyAdd(&merged, log->items[k]);
+            for (long k = 0; k < log->count; k++) latencyAdd(&all, log->items[k]);
+            errors += clients[c].errors[op];
+        }
+        summarize(&merged, errors, seconds, &perOp[op]);
+        totalErrors += errors;
+        loadSummaryToJSON(json, g_opNames[op], &perOp[op]);
+        free(merged.items);
+    }
+    jsonClose(json, '}');
+    summarize(&all, totalErrors, seconds, &total);
+    loadSummaryToJSON(json, "total", &total);
+    for (int c = 0; c < count; c++) reconnects += clients[c].reconnects;
+    jsonPutInt(json, "reconnects", reconnects);
+    jsonClose(json, '}');
+    free(all.items);
+
+    printLoadSummary("total", &total);
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (scenario->weights[op] > 0 && scenario->weights[op] < 100) printLoadSummary(g_opNames[op], &perOp[op]);
+    }
+    if (reconnects > 0) printf("  %ld reconnects\n", reconnects);
+
+    for (int c = 0; c < count; c++) {
+        if (clients[c].sock != SOCK_INVALID) sockClose(clients[c].sock);
+        for (int op = 0; op < OP_COUNT; op++) free(clients[c].latency[op].items);
+        free(clients[c].request.data);
+        free(clients[c].response);
+    }
+    free(clients);
+    return 0;
+}
+
+static void loadRecvTimeout(socket_t sock, int ms) {
+#ifdef _WIN32
+    DWORD timeout = ms;
+#else
+    struct timeval timeout = {ms / 1000, (ms % 1000) * 1000};
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+// The conn-cap check: holds one more idle connection than the server's
+// --max-connections allows for --duration seconds. The server must stay
+// idle meanwhile, and must serve the waiting connection once a slot frees.
+static int runCapCheck(OutBuffer* json) {
+    socket_t held[LOAD_CAP_CONNECTIONS];
+    LoadClient waiting;
+    memset(&waiting, 0, sizeof(waiting));
+    for (int c = 0; c < LOAD_CAP_CONNECTIONS; c++) {
+        held[c] = loadConnect();
+        if (held[c] == SOCK_INVALID) {
+            printf("  ✗ Connection %d was refused\n", c);
+            return -1;
+        }
+    }
+    waiting.sock = loadConnect();  // completes in the listen backlog
+    if (waiting.sock == SOCK_INVALID) {
+        printf("  ✗ Connection %d was refused\n", LOAD_CAP_CONNECTIONS);
+        return -1;
+    }
+    waiting.responseCap = 1 << 16;
+    waiting.response = (char*)malloc(waiting.responseCap + 1);
+
+    loadSleep(g_load.warmup * 1000);
+    double cpuStart = serverCpuSeconds();
+    double start = loadNanos();
+    loadSleep(g_load.duration * 1000);
+    double seconds = (loadNanos() - start) / 1e9;
+    double cpuEnd = serverCpuSeconds();
+    double cpu = cpuStart >= 0 && cpuEnd >= 0 ? (cpuEnd - cpuStart) / seconds : -1;
+
+    sockClose(held[0]);
+    loadRecvTimeout(waiting.sock, LOAD_CAP_TIMEOUT_MS);
+    buildRequest(&waiting.request, "GET", "/metrics", NULL, NULL);
+    int served = exchange(&waiting) == 200;
+    for (int c = 1; c < LOAD_CAP_CONNECTIONS; c++) sockClose(held[c]);
+    sockClose(waiting.sock);
+    free(waiting.request.data);
+    free(waiting.response);
+
+    printf("Scenario conn-cap (%d connections, cap %d, %.1f s)\n", LOAD_CAP_CONNECTIONS + 1, LOAD_CAP_CONNECTIONS, seconds);
+    if (cpu >= 0) printf("  server CPU at the cap  %.1f%% of a core\n", cpu * 100);
+    else printf("  server CPU at the cap  not measurable here\n");
+    printf("  waiting connection     %s\n", served ? "served after a slot freed" : "not served");
+    jsonOpen(json, NULL, '{');
+    jsonPutString(json, "name", "conn-cap");
+    jsonPutInt(json, "maxConnections", LOAD_CAP_CONNECTIONS);
+    if (cpu >= 0) jsonPutNumber(json, "serverCpu", cpu);
+    else jsonPutRaw(json, "serverCpu", "null");
+    jsonPutRaw(json, "waitingServed", served ? "true" : "false");
+    jsonClose(json, '}');
+    if (cpu > LOAD_CAP_MAX_CPU) printf("  ✗ The server spins while connections wait at the cap\n");
+    return served && cpu <= LOAD_CAP_MAX_CPU ? 0 : -1;
+}
+
+static int parseLoadOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            for (i++; i < argc && g_load.serverArgCount < LOAD_MAX_SERVER_ARGS; i++) {
+                g_load.serverArgs[g_load.serverArgCount++] = argv[i];
+            }
+            break;
+        }
+        if (i + 1 >= argc) return -1;
+        if (strcmp(argv[i], "--server") == 0) {
+            g_load.serverPath = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0) {
+            g_load.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--students") == 0) {
+            g_load.students = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--connections") == 0) {
+            g_load.connections = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0) {
+            g_load.duration = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0) {
+            g_load.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scenario") == 0) {
+            g_load.scenario = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            g_load.jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--label") == 0) {
+            g_load.label = argv[++i];
+        } else {
+            return -1;
+        }
+    }
+    if (g_load.port <= 0 || g_load.port > 65535 || g_load.students < LOAD_DEPARTMENTS) return -1;
+    if (g_load.connections <= 0 || g_load.connections > LOAD_MAX_CONNECTIONS) return -1;
+    if (g_load.duration <= 0 || g_load.warmup < 0) return -1;
+    g_load.teachers = g_load.students / 20 > LOAD_DEPARTMENTS ? g_load.students / 20 : LOAD_DEPARTMENTS;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (parseLoadOptions(argc, argv) != 0) {
+        printf("Usage: %s [--server PATH] [--port N] [--students N] [--connections N]\n"
+               "          [--duration SECONDS] [--warmup SECONDS] [--scenario NAME|all]\n"
+               "          [--json FILE] [--label TEXT] [-- SERVER_OPTIONS...]\n", argv[0]);
+        printf("Scenarios:");
+        for (int s = 0; s < SCENARIO_COUNT; s++) printf(" %s", g_scenarios[s].name);
+        printf(" (or conn-cap, run on its own)\n");
+        return 1;
+    }
+    int capCheck = strcmp(g_load.scenario, "conn-cap") == 0;
+    int selected = capCheck;
+    for (int s = 0; s < SCENARIO_COUNT; s++) {
+        if (strcmp(g_load.scenario, "all") == 0 || strcmp(g_load.scenario, g_scenarios[s].name) == 0) selected++;
+    }
+    if (selected == 0) {
+        printf("Unknown scenario: %s\n", g_load.scenario);
+        return 1;
+    }
+
+    char capArg[16];
+    if (capCheck) {
+        if (g_load.serverArgCount + 2 > LOAD_MAX_SERVER_ARGS) return 1;
+        snprintf(capArg, sizeof(capArg), "%d", LOAD_CAP_CONNECTIONS);
+        g_load.serverArgs[g_load.serverArgCount++] = "--max-connections";
+        g_load.serverArgs[g_load.serverArgCount++] = capArg;
+    }
+
+    netStartup();
+    makeDirectory(LOAD_RUN_DIR);
+    printf("Generating %d students and %d teachers in %s/\n", g_load.students, g_load.teachers, LOAD_RUN_DIR);
+    if (writeLoadDatabase(LOAD_RUN_DIR "/" DATABASE_FILE, g_load.students, g_load.teachers) != 0) {
+        printf("Cannot write %s/%s\n", LOAD_RUN_DIR, DATABASE_FILE);
+        return 1;
+    }
+    if (startServer() != 0) {
+        printf("Cannot start %s\n", g_load.serverPath);
+        return 1;
+    }
+    double loadStart = loadNanos();
+    if (waitForServer() != 0) {
+        printf("Server did not come up on port %d; see %s/server.log\n", g_load.port, LOAD_RUN_DIR);
+        stopServer();
+        return 1;
+    }
+    printf("Server ready in %.1f ms\n", (loadNanos() - loadStart) / 1e6);
+
+    char timestamp[50];
+    OutBuffer json = {NULL, 0, 0};
+    getCurrentTimestamp(timestamp);
+    jsonOpen(&json, NULL, '{');
+    jsonPutString(&json, "label", g_load.label ? g_load.label : "");
+    jsonPutString(&json, "timestamp", timestamp);
+    jsonPutInt(&json, "cpus", cpuCount());
+    jsonPutInt(&json, "students", g_load.students);
+    jsonPutInt(&json, "teachers", g_load.teachers);
+    jsonPutInt(&json, "connections", g_load.connections);
+    jsonPutInt(&json, "durationSec", g_load.duration);
+    jsonPutInt(&json, "warmupSec", g_load.warmup);
+    jsonOpen(&json, "serverOptions", '[');
+    for (int i = 0; i < g_load.serverArgCount; i++) jsonPutString(&json, NULL, g_load.serverArgs[i]);
+    jsonClose(&json, ']');
+    jsonOpen(&json, "scenarios", '[');
+
+    int failed = capCheck && runCapCheck(&json) != 0;
+    for (int s = 0; s < SCENARIO_COUNT && !failed; s++) {
+        if (strcmp(g_load.scenario, "all") != 0 && strcmp(g_load.scenario, g_scenarios[s].name) != 0) continue;
+        failed = runScenario(&g_scenarios[s], &json) != 0;
+    }
+    jsonClose(&json, ']');
+    jsonClose(&json, '}');
+    stopServer();
+
+    if (!failed && g_load.jsonPath) {
+        FILE* f = fopen(g_load.jsonPath, "w");
+        if (!f) {
+            printf("Cannot write %s\n", g_load.jsonPath);
+            return 1;
+        }
+        fwrite(json.data, 1, json.len, f);
+        fputc('\n', f);
+        fclose(f);
+        printf("Results written to %s\n", g_load.jsonPath);
+    }
+    free(json.data);
+    return failed;
+}
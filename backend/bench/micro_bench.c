@@ -0,0 +1,939 @@
+/*
+* Micro-benchmarks for the Student Management server internals
+* Builds the server translation unit without its main() and times the
+* primitives directly against the implementations they replaced
+* (hash indexes vs list walks, department posting lists vs filtered scans,
+* column scans vs record walks, rank indexes vs sorting a copy, JSON
+* tokenizer vs per-key strstr, and the memory-mapped loader vs the
+* per-record copy-and-strstr loader).
+* --sizes runs only the primitives table (parser, serializer, lookups,
+* snapshot save and load) at each dataset size, with ns/op, heap bytes and
+* allocations per op, and cache misses per op where perf_event is available.
+* Compile (Linux): gcc -O2 -o micro_bench bench/micro_bench.c -lpthread
+* Usage: micro_bench [students] | micro_bench --sizes N[,N...]
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+// Heap traffic of the code under test: every malloc, calloc and realloc in
+// the server translation unit below goes through these counters. realloc
+// counts its full new size.
+static long long g_allocBytes, g_allocCount;
+
+static void* countedMalloc(size_t size) {
+    g_allocBytes += size;
+    g_allocCount++;
+    return malloc(size);
+}
+
+static void* countedCalloc(size_t count, size_t size) {
+    g_allocBytes += count * size;
+    g_allocCount++;
+    return calloc(count, size);
+}
+
+static void* countedRealloc(void* p, size_t size) {
+    g_allocBytes += size;
+    g_allocCount++;
+    return realloc(p, size);
+}
+
+#define malloc(size) countedMalloc(size)
+#define calloc(count, size) countedCalloc(count, size)
+#define realloc(p, size) countedRealloc(p, size)
+
+#define SMS_NO_MAIN
+#include "../student_server_enhanced.c"
+#ifdef _WIN32
+#include <direct.h>
+#define makeDirectory(path) _mkdir(path)
+#define changeDirectory(path) _chdir(path)
+#else
+#define makeDirectory(path) mkdir(path, 0755)
+#define changeDirectory(path) chdir(path)
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static volatile long long g_sink;
+
+static double benchNanos() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static unsigned int benchRandom(unsigned int* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static void report(const char* name, const char* variant, double nanos, long ops) {
+    printf("  %-24s %-8s %12.1f ns/op  (%ld ops)\n", name, variant, nanos / ops, ops);
+}
+
+// Full scans: time per pass and rows visited per second
+static void reportScan(const char* name, const char* variant, double nanos, long ops, long rows) {
+    printf("  %-24s %-8s %12.1f ns/op  %8.1f Mrows/s\n", name, variant, nanos / ops, rows * (double)ops * 1e3 / nanos);
+}
+
+// The linked-list walks the hash indexes replaced
+static Student* listFindStudent(int id) {
+    Student* current = g_system.students;
+    while (current) {
+        if (current->studentId == id) return current;
+        current = current->next;
+    }
+    return NULL;
+}
+
+static Subject* scanFindStudentSubject(Student* s, const char* subjectId) {
+    for (int i = 0; i < s->subjectCount; i++) {
+        if (strcmp(s->subjects[i].subjectId, subjectId) == 0) return &s->subjects[i];
+    }
+    return NULL;
+}
+
+static Teacher* listFindTeacherByEmail(char* email) {
+    Teacher* current = g_system.teachers;
+    while (current) {
+        if (strcmp(current->email, email) == 0) return current;
+        current = current->next;
+    }
+    return NULL;
+}
+
+// The per-key strstr parsers the tokenizer replaced
+static void legacyParseJSON(char* json, char* key, char* value) {
+    value[0] = '\0';
+    char search[110];
+    sprintf(search, "\"%s\"", key);
+    char* key_pos = strstr(json, search);
+    if (key_pos) {
+        char* colon = strchr(key_pos + strlen(search), ':');
+        if (colon) {
+            char* start = strchr(colon, '"');
+            if (start) {
+                start++; // Move past opening quote
+                char* end = strchr(start, '"');
+                if (end) {
+                    int len = end - start;
+                    if (len > 99) len = 99;
+                    strncpy(value, start, len);
+                    value[len] = '\0';
+                }
+            }
+        }
+    }
+}
+
+static double legacyParseJSONNumber(char* json, char* key) {
+    char search[110];
+    sprintf(search, "\"%s\"", key);
+    char* key_pos = strstr(json, search);
+    if (key_pos) {
+        char* colon = strchr(key_pos + strlen(search), ':');
+        if (colon) {
+            return atof(colon + 1);
+        }
+    }
+    return 0.0;
+}
+
+// The loader the memory-mapped arena loader replaced: one malloc'd copy and
+// a strstr per key for every record, each prepended to the list
+static void legacyLoadFromFile(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+
+    // Read entire file
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char* content = (char*)malloc(fsize + 1);
+    fread(content, 1, fsize, f);
+    content[fsize] = '\0';
+    fclose(f);
+
+    // Parse JSON metadata
+    g_system.nextStudentId = (int)legacyParseJSONNumber(content, "nextStudentId");
+    g_system.nextTeacherId = (int)legacyParseJSONNumber(content, "nextTeacherId");
+    g_system.nextPrincipalId = (int)legacyParseJSONNumber(content, "nextPrincipalId");
+    g_wal.checkpointLsn = (unsigned long long)legacyParseJSONNumber(content, "walLsn");
+
+    // Parse students array
+    char* studentsArray = strstr(content, "\"students\":");
+    if (studentsArray) {
+        char* studentStart = strchr(studentsArray, '[');
+        if (studentStart) {
+            char* current = studentStart + 1;
+            while (*current && *current != ']') {
+                // Find next student object
+                char* objStart = strchr(current, '{');
+                if (!objStart || objStart > strchr(current, ']')) break;
+
+                char* objEnd = objStart;
+                int braceCount = 1;
+                objEnd++;
+                while (*objEnd && braceCount > 0) {
+                    if (*objEnd == '{') braceCount++;
+                    else if (*objEnd == '}') braceCount--;
+                    objEnd++;
+                }
+
+                // Extract student JSON
+                int len = objEnd - objStart;
+                char* studentJSON = (char*)malloc(len + 1);
+                strncpy(studentJSON, objStart, len);
+                studentJSON[len] = '\0';
+
+                // Parse student
+                Student* s = (Student*)malloc(sizeof(Student));
+                memset(s, 0, sizeof(Student));
+                s->studentId = (int)legacyParseJSONNumber(studentJSON, "studentId");
+                legacyParseJSON(studentJSON, "name", s->name);
+                legacyParseJSON(studentJSON, "password", s->password);
+                legacyParseJSON(studentJSON, "email", s->email);
+                legacyParseJSON(studentJSON, "department", s->department);
+                s->year = (int)legacyParseJSONNumber(studentJSON, "year");
+                s->semester = (int)legacyParseJSONNumber(studentJSON, "semester");
+                s->cgpa = legacyParseJSONNumber(studentJSON, "cgpa");
+                s->attendance = legacyParseJSONNumber(studentJSON, "attendance");
+                s->subjectCount = 0;
+
+                // Parse subjects for this student
+                char* subjArray = strstr(studentJSON, "\"subjects\":");
+                if (subjArray) {
+                    char* subjStart = strchr(subjArray, '[');
+                    if (subjStart) {
+                        char* subjCurrent = subjStart + 1;
+                        while (*subjCurrent && *subjCurrent != ']' && s->subjectCount < 10) {
+                            char* subjObjStart = strchr(subjCurrent, '{');
+                            if (!subjObjStart || subjObjStart > strchr(subjCurrent, ']')) break;
+            
+                            char* subjObjEnd = subjObjStart;
+                            int subjBraces = 1;
+                            subjObjEnd++;
+                            while (*subjObjEnd && subjBraces > 0) {
+                                if (*subjObjEnd == '{') subjBraces++;
+                                else if (*subjObjEnd == '}') subjBraces--;
+                                subjObjEnd++;
+                            }
+            
+                            int subjLen = subjObjEnd - subjObjStart;
+                            char* subjJSON = (char*)malloc(subjLen + 1);
+                            strncpy(subjJSON, subjObjStart, subjLen);
+                            subjJSON[subjLen] = '\0';
+            
+                            char subjectId[20];
+                            legacyParseJSON(subjJSON, "subjectId", subjectId);
+                            Subject* subj = addStudentSubject(s, subjectId);
+                            legacyParseJSON(subjJSON, "name", subj->name);
+                            subj->mid1 = (int)legacyParseJSONNumber(subjJSON, "mid1");
+                            subj->mid2 = (int)legacyParseJSONNumber(subjJSON, "mid2");
+                            subj->final = (int)legacyParseJSONNumber(subjJSON, "final");
+                            subj->attendance_percent = legacyParseJSONNumber(subjJSON, "attendance_percent");
+                            legacyParseJSON(subjJSON, "remarks", subj->remarks);
+                            free(subjJSON);
+                            subjCurrent = subjObjEnd;
+                        }
+                    }
+                }
+
+                addStudent(s);
+                free(studentJSON);
+                current = objEnd;
+            }
+        }
+    }
+
+    // Parse teachers array
+    char* teachersArray = strstr(content, "\"teachers\":");
+    if (teachersArray) {
+        char* teacherStart = strchr(teachersArray, '[');
+        if (teacherStart) {
+            char* current = teacherStart + 1;
+            while (*current && *current != ']') {
+                char* objStart = strchr(current, '{');
+                if (!objStart || objStart > strchr(current, ']')) break;
+
+                char* objEnd = objStart;
+                int braceCount = 1;
+                objEnd++;
+                while (*objEnd && braceCount > 0) {
+                    if (*objEnd == '{') braceCount++;
+                    else if (*objEnd == '}') braceCount--;
+                    objEnd++;
+                }
+
+                int len = objEnd - objStart;
+                char* teacherJSON = (char*)malloc(len + 1);
+                strncpy(teacherJSON, objStart, len);
+                teacherJSON[len] = '\0';
+
+                Teacher* t = (Teacher*)malloc(sizeof(Teacher));
+                memset(t, 0, sizeof(Teacher));
+                t->teacherId = (int)legacyParseJSONNumber(teacherJSON, "teacherId");
+                legacyParseJSON(teacherJSON, "name", t->name);
+                legacyParseJSON(teacherJSON, "password", t->password);
+                legacyParseJSON(teacherJSON, "email", t->email);
+                legacyParseJSON(teacherJSON, "department", t->department);
+                t->approved = (int)legacyParseJSONNumber(teacherJSON, "approved");
+                legacyParseJSON(teacherJSON, "approvalDate", t->approvalDate);
+
+                addTeacher(t);
+                free(teacherJSON);
+                current = objEnd;
+            }
+        }
+    }
+
+    free(content);
+}
+
+static const char* g_benchDepartments[] = {"CSE", "ECE", "EEE", "MECH", "CIVIL", "IT", "AIDS", "CSBS"};
+#define BENCH_DEPARTMENTS 8
+
+static void buildDataset(int students, int teachers) {
+    for (int i = 0; i < students; i++) {
+        Student* s = (Student*)calloc(1, sizeof(Student));
+        s->studentId = g_system.nextStudentId++;
+        sprintf(s->name, "Student %d", i);
+        sprintf(s->email, "student%d@bench.edu", i);
+        strcpy(s->department, g_benchDepartments[i % BENCH_DEPARTMENTS]);
+        s->year = 1 + i % 4;
+        s->cgpa = 5.0 + (i % 500) / 100.0;
+        s->attendance = 60.0 + i % 41;
+        addStudent(s);
+        for (int k = 0; k < 5; k++) {
+            char subjectId[20];
+            sprintf(subjectId, "SUB%d", k);
+            Subject* subj = assignStudentSubject(s, subjectId, "Bench Subject");
+            setSubjectMarks(s, subj, 10 + (i + k) % 15, 10 + (i * k) % 15, 30 + (i + 7 * k) % 40, 55.0 + (i + k) % 45, NULL);
+        }
+    }
+    for (int i = 0; i < teachers; i++) {
+        Teacher* t = (Teacher*)calloc(1, sizeof(Teacher));
+        t->teacherId = g_system.nextTeacherId++;
+        sprintf(t->name, "Teacher %d", i);
+        sprintf(t->email, "teacher%d@bench.edu", i);
+        strcpy(t->department, g_benchDepartments[i % BENCH_DEPARTMENTS]);
+        t->approved = 1;
+        addTeacher(t);
+    }
+}
+
+static void benchLookups(int students, int teachers) {
+    unsigned int seed = 12345;
+    long indexOps = 1000000;
+    long listOps = students > 100000 ? 200 : 2000;
+    char email[64];
+    double start;
+
+    printf("Lookups (%d students, %d teachers)\n", students, teachers);
+
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        Student* s = findStudent(1001 + (int)(benchRandom(&seed) % students));
+        g_sink += s->year;
+    }
+    report("findStudent", "index", benchNanos() - start, indexOps);
+
+    start = benchNanos();
+    for (long i = 0; i < listOps; i++) {
+        Student* s = listFindStudent(1001 + (int)(benchRandom(&seed) % students));
+        g_sink += s->year;
+    }
+    report("findStudent", "list", benchNanos() - start, listOps);
+
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        sprintf(email, "teacher%u@bench.edu", benchRandom(&seed) % teachers);
+        g_sink += findTeacherByEmail(email)->teacherId;
+    }
+    report("findTeacherByEmail", "index", benchNanos() - start, indexOps);
+
+    start = benchNanos();
+    for (long i = 0; i < listOps; i++) {
+        sprintf(email, "teacher%u@bench.edu", benchRandom(&seed) % teachers);
+        g_sink += listFindTeacherByEmail(email)->teacherId;
+    }
+    report("findTeacherByEmail", "list", benchNanos() - start, listOps);
+
+    static char* subjectIds[] = {"SUB0", "SUB1", "SUB2", "SUB3", "SUB4"};
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        Student* s = findStudent(1001 + (int)(benchRandom(&seed) % students));
+        g_sink += findStudentSubject(s, subjectIds[i % 5])->mid1;
+    }
+    report("findStudentSubject", "index", benchNanos() - start, indexOps);
+
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        Student* s = findStudent(1001 + (int)(benchRandom(&seed) % students));
+        g_sink += scanFindStudentSubject(s, subjectIds[i % 5])->mid1;
+    }
+    report("findStudentSubject", "scan", benchNanos() - start, indexOps);
+
+    // One student with a long course list (no column rows needed)
+    Student* many = (Student*)calloc(1, sizeof(Student));
+    char manyIds[64][20];
+    for (int k = 0; k < 64; k++) {
+        sprintf(manyIds[k], "ELECTIVE%02d", k);
+        addStudentSubject(many, manyIds[k])->mid1 = k;
+    }
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) g_sink += findStudentSubject(many, manyIds[i % 64])->mid1;
+    report("findStudentSubject x64", "index", benchNanos() - start, indexOps);
+
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) g_sink += scanFindStudentSubject(many, manyIds[i % 64])->mid1;
+    report("findStudentSubject x64", "scan", benchNanos() - start, indexOps);
+}
+
+// A teacher's department listing: touch every matching student
+static void benchDepartments(int students) {
+    long ops = students > 100000 ? 20 : 200;
+    double start;
+
+    printf("Department listing (%d students, %d departments)\n", students, BENCH_DEPARTMENTS);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        Department* d = findDepartment(g_benchDepartments[i % BENCH_DEPARTMENTS]);
+        for (int k = 0; k < d->students.count; k++) {
+            g_sink += ((Student*)d->students.items[k].record)->year;
+        }
+    }
+    report("department students", "postings", benchNanos() - start, ops);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        const char* dept = g_benchDepartments[i % BENCH_DEPARTMENTS];
+        for (Student* s = g_system.students; s != NULL; s = s->next) {
+            if (strcmp(s->department, dept) == 0) g_sink += s->year;
+        }
+    }
+    report("department students", "scan", benchNanos() - start, ops);
+}
+
+// Analytics-style scans: mean cgpa, low-attendance count, mean subject total
+static void benchScans(int students) {
+    long ops = students > 100000 ? 20 : 200;
+    double start;
+
+    printf("Column scans (%d students, %d subjects)\n", students, g_subjectColumns.count);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        double sum = 0;
+        int low = 0;
+        for (Student* s = g_system.students; s != NULL; s = s->next) {
+            sum += s->cgpa;
+            low += s->attendance < 75.0;
+        }
+        g_sink += (long long)sum + low;
+    }
+    reportScan("cgpa+attendance", "records", benchNanos() - start, ops, students);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        const double* cgpa = g_studentColumns.cgpa;
+        const double* attendance = g_studentColumns.attendance;
+        double sum = 0;
+        int low = 0;
+        for (int r = 0; r < g_studentColumns.count; r++) {
+            sum += cgpa[r];
+            low += attendance[r] < 75.0;
+        }
+        g_sink += (long long)sum + low;
+    }
+    reportScan("cgpa+attendance", "columns", benchNanos() - start, ops, students);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        long long total = 0;
+        for (Student* s = g_system.students; s != NULL; s = s->next) {
+            for (int k = 0; k < s->subjectCount; k++) {
+                total += s->subjects[k].mid1 + s->subjects[k].mid2 + s->subjects[k].final;
+            }
+        }
+        g_sink += total;
+    }
+    reportScan("subject totals", "records", benchNanos() - start, ops, g_subjectColumns.count);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        const double* totals = g_subjectColumns.total;
+        double total = 0;
+        for (int r = 0; r < g_subjectColumns.count; r++) total += totals[r];
+        g_sink += (long long)total;
+    }
+    reportScan("subject totals", "columns", benchNanos() - start, ops, g_subjectColumns.count);
+}
+
+// The /api/stats work: cgpa, attendance and subject-total summaries
+static void benchStats(int students) {
+    long ops = students > 100000 ? 20 : 200;
+    ColumnStats cgpa, attendance, totals;
+    double start;
+
+    printf("Stats summary (%d students, %s kernel)\n", students, statsKernelName());
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        columnStats(g_studentColumns.cgpa, NULL, g_studentColumns.count, 1.0, &cgpa);
+        columnStats(g_studentColumns.attendance, NULL, g_studentColumns.count, 10.0, &attendance);
+        columnStats(g_subjectColumns.total, NULL, g_subjectColumns.count, 10.0, &totals);
+        g_sink += cgpa.count + attendance.buckets[0] + totals.count;
+    }
+    report("whole institution", statsKernelName(), benchNanos() - start, ops);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        ColumnStats* all[3] = {&cgpa, &attendance, &totals};
+        const double* columns[3] = {g_studentColumns.cgpa, g_studentColumns.attendance, g_subjectColumns.total};
+        int rows[3] = {g_studentColumns.count, g_studentColumns.count, g_subjectColumns.count};
+        for (int c = 0; c < 3; c++) {
+            memset(all[c], 0, sizeof(ColumnStats));
+            all[c]->min = DBL_MAX;
+            all[c]->max = -DBL_MAX;
+            statsScalar(columns[c], NULL, 0, rows[c], c == 0 ? 1.0 : 0.1, all[c]);
+        }
+        g_sink += cgpa.count + totals.count;
+    }
+    report("whole institution", "scalar", benchNanos() - start, ops);
+
+    // Per-department cgpa summaries: running aggregates vs a masked scan each
+    long readOps = 100000;
+    start = benchNanos();
+    for (long i = 0; i < readOps; i++) {
+        aggregateRepair();
+        for (int d = 0; d < g_departments.count; d++) g_sink += (long long)g_departments.items[d]->cgpa.sum;
+    }
+    report("department summaries", "running", benchNanos() - start, readOps);
+
+    unsigned char* select = (unsigned char*)malloc(g_studentColumns.count);
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        for (int d = 0; d < g_departments.count; d++) {
+            for (int r = 0; r < g_studentColumns.count; r++) select[r] = g_studentColumns.departmentId[r] == d;
+            columnStats(g_studentColumns.cgpa, select, g_studentColumns.count, 1.0, &cgpa);
+            g_sink += (long long)cgpa.sum;
+        }
+    }
+    report("department summaries", "rescan", benchNanos() - start, ops);
+    free(select);
+}
+
+static int compareRankEntries(const void* a, const void* b) {
+    const RankEntry* x = (const RankEntry*)a;
+    const RankEntry* y = (const RankEntry*)b;
+    if (x->value != y->value) return x->value < y->value ? 1 : -1;
+    return x->id < y->id ? 1 : x->id > y->id ? -1 : 0;
+}
+
+// Top-K and percentiles from the rank indexes vs sorting a copy of the
+// column, which is what the dashboard did with the full student list
+static void benchRankings(int students) {
+    long ops = students > 100000 ? 10 : 100;
+    long indexOps = 100000;
+    RankEntry top[50];
+    double start;
+
+    printf("Rankings (%d students)\n", students);
+
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        g_sink += rankTopK(&g_cgpaRank, RANK_CGPA, NULL, 0, 50, 1, top);
+    }
+    report("top 50 by cgpa", "index", benchNanos() - start, indexOps);
+
+    RankEntry* copy = (RankEntry*)malloc(g_studentColumns.count * sizeof(RankEntry));
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        for (int r = 0; r < g_studentColumns.count; r++) {
+            copy[r].value = g_studentColumns.cgpa[r];
+            copy[r].id = g_studentColumns.studentId[r];
+            copy[r].record = g_studentColumns.record[r];
+        }
+        qsort(copy, g_studentColumns.count, sizeof(RankEntry), compareRankEntries);
+        g_sink += copy[0].id;
+    }
+    report("top 50 by cgpa", "sort", benchNanos() - start, ops);
+    free(copy);
+
+    // One department and year. The dataset puts ECE in year 2 and CSE in
+    // year 1, so CSE year 2 is empty: the index walk gives up after the
+    // department's size and the heap scan of its posting list runs instead.
+    Department* d = findDepartment(g_benchDepartments[1]);
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        g_sink += rankTopK(&g_cgpaRank, RANK_CGPA, d, 2, 50, 1, top);
+    }
+    report("top 50 dept+year", "walk", benchNanos() - start, indexOps);
+
+    d = findDepartment(g_benchDepartments[0]);
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        g_sink += rankTopK(&g_cgpaRank, RANK_CGPA, d, 2, 50, 1, top);
+    }
+    report("top 50 dept+year", "no match", benchNanos() - start, ops);
+
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        RankNode* node = rankSelect(&g_cgpaRank, 1 + (int)(i % g_cgpaRank.count));
+        g_sink += node->id;
+    }
+    report("percentile (select)", "index", benchNanos() - start, indexOps);
+
+    // Academics updates pay for the index: two moves per change
+    unsigned int seed = 7;
+    start = benchNanos();
+    for (long i = 0; i < indexOps; i++) {
+        Student* s = g_studentColumns.record[benchRandom(&seed) % g_studentColumns.count];
+        setStudentAcademics(s, 5.0 + benchRandom(&seed) % 500 / 100.0, 60.0 + benchRandom(&seed) % 41);
+    }
+    report("academics update", "indexed", benchNanos() - start, indexOps);
+}
+
+// Parses a subject-update body the way the handler reads it: nine keys
+static void benchParser() {
+    char body[] = "{\"role\":\"teacher\",\"email\":\"teacher7@bench.edu\",\"password\":\"teacher123\","
+                  "\"principalPassword\":\"\",\"mid1\":18,\"mid2\":22,\"final\":61,"
+                  "\"attendance_percent\":87.5,\"remarks\":\"Consistent work across both mid terms\"}";
+    int len = (int)strlen(body);
+    long ops = 1000000;
+    char role[50], email[120], password[100], principal[100], remarks[200];
+    double start;
+
+    printf("Request body parsing (%d bytes, 9 keys)\n", len);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        JsonObject args;
+        jsonParse(&args, body, len);
+        jsonString(&args, "role", role, sizeof(role));
+        jsonString(&args, "email", email, sizeof(email));
+        jsonString(&args, "password", password, sizeof(password));
+        jsonString(&args, "principalPassword", principal, sizeof(principal));
+        g_sink += jsonInt(&args, "mid1") + jsonInt(&args, "mid2") + jsonInt(&args, "final");
+        g_sink += (long long)jsonNumber(&args, "attendance_percent");
+        jsonString(&args, "remarks", remarks, sizeof(remarks));
+        g_sink += role[0] + remarks[0];
+    }
+    report("parse body", "tokens", benchNanos() - start, ops);
+
+    start = benchNanos();
+    for (long i = 0; i < ops; i++) {
+        legacyParseJSON(body, "role", role);
+        legacyParseJSON(body, "email", email);
+        legacyParseJSON(body, "password", password);
+        legacyParseJSON(body, "principalPassword", principal);
+        g_sink += (int)legacyParseJSONNumber(body, "mid1") + (int)legacyParseJSONNumber(body, "mid2") +
+                  (int)legacyParseJSONNumber(body, "final");
+        g_sink += (long long)legacyParseJSONNumber(body, "attendance_percent");
+        legacyParseJSON(body, "remarks", remarks);
+        g_sink += role[0] + remarks[0];
+    }
+    report("parse body", "strstr", benchNanos() - start, ops);
+}
+
+// Writes a snapshot-format database with five subjects per student
+static void writeDatabase(const char* path, int students, int teachers) {
+    FILE* f = fopen(path, "w");
+    fprintf(f, "{\n  \"nextStudentId\": %d,\n  \"nextTeacherId\": %d,\n  \"nextPrincipalId\": 3001,\n",
+            1001 + students, 2001 + teachers);
+    fprintf(f, "  \"walLsn\": 0,\n  \"students\": [\n");
+    for (int i = 0; i < students; i++) {
+        fprintf(f, "%s    {\n      \"studentId\": %d,\n      \"name\": \"Student %d\",\n", i ? ",\n" : "", 1001 + i, i);
+        fprintf(f, "      \"password\": \"pass%d\",\n      \"email\": \"student%d@bench.edu\",\n", i, i);
+        fprintf(f, "      \"department\": \"%s\",\n      \"year\": %d,\n      \"semester\": %d,\n",
+                i % 2 ? "CSE" : "ECE", 1 + i % 4, 1 + i % 8);
+        fprintf(f, "      \"cgpa\": %.2f,\n      \"attendance\": %.2f,\n      \"subjects\": [\n", (i % 100) / 10.0, 50 + i % 50 * 1.0);
+        for (int j = 0; j < 5; j++) {
+            fprintf(f, "%s        {\n          \"subjectId\": \"SUB%d\",\n          \"name\": \"Subject %d\",\n", j ? ",\n" : "", j, j);
+            fprintf(f, "          \"mid1\": %d,\n          \"mid2\": %d,\n          \"final\": %d,\n", i % 30, (i + j) % 30, i % 70);
+            fprintf(f, "          \"attendance_percent\": %.2f,\n          \"remarks\": \"Good\"\n        }", 60.0 + j);
+        }
+        fprintf(f, "\n      ]\n    }");
+    }
+    fprintf(f, "\n  ],\n  \"teachers\": [\n");
+    for (int i = 0; i < teachers; i++) {
+        fprintf(f, "%s    {\n      \"teacherId\": %d,\n      \"name\": \"Teacher %d\",\n", i ? ",\n" : "", 2001 + i, i);
+        fprintf(f, "      \"password\": \"pass%d\",\n      \"email\": \"teacher%d@bench.edu\",\n", i, i);
+        fprintf(f, "      \"department\": \"%s\",\n      \"approved\": 1,\n      \"approvalDate\": \"2024-01-01 09:00:00\"\n    }",
+                i % 2 ? "CSE" : "ECE");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+}
+
+// Forgets all records so the next load starts from an empty store
+static void resetStore() {
+    free(g_studentIndex.slots);
+    free(g_teacherIndex.slots);
+    free(g_teacherEmailIndex.slots);
+    free(g_studentOrder.items);
+    free(g_departmentIndex.slots);
+    for (int i = 0; i < g_departments.count; i++) {
+        free(g_departments.items[i]->students.items);
+        free(g_departments.items[i]->teachers.items);
+        free(g_departments.items[i]);
+    }
+    free(g_departments.items);
+    free(g_studentColumns.record);
+    free(g_studentColumns.studentId);
+    free(g_studentColumns.departmentId);
+    free(g_studentColumns.year);
+    free(g_studentColumns.cgpa);
+    free(g_studentColumns.attendance);
+    free(g_subjectColumns.studentRow);
+    free(g_subjectColumns.subjectKey);
+    free(g_subjectAggregateIndex.slots);
+    rankFree(&g_cgpaRank);
+    rankFree(&g_attendanceRank);
+    for (int i = 0; i < g_subjectAggregates.count; i++) {
+        rankFree(&g_subjectAggregates.items[i]->ranking);
+        free(g_subjectAggregates.items[i]);
+    }
+    free(g_subjectAggregates.items);
+    free(g_subjectColumns.total);
+    free(g_subjectColumns.attendance);
+    memset(&g_studentIndex, 0, sizeof(g_studentIndex));
+    memset(&g_teacherIndex, 0, sizeof(g_teacherIndex));
+    memset(&g_teacherEmailIndex, 0, sizeof(g_teacherEmailIndex));
+    memset(&g_studentOrder, 0, sizeof(g_studentOrder));
+    memset(&g_departmentIndex, 0, sizeof(g_departmentIndex));
+    memset(&g_departments, 0, sizeof(g_departments));
+    memset(&g_studentColumns, 0, sizeof(g_studentColumns));
+    memset(&g_subjectColumns, 0, sizeof(g_subjectColumns));
+    memset(&g_subjectAggregateIndex, 0, sizeof(g_subjectAggregateIndex));
+    memset(&g_subjectAggregates, 0, sizeof(g_subjectAggregates));
+    initSystem();
+}
+
+// Startup cost: time to load a generated database of this size
+static void benchLoader(int students, int teachers) {
+    const char* path = "bench_database.json";
+    double start;
+
+    writeDatabase(path, students, teachers);
+    printf("Startup load (%d students x 5 subjects, %d teachers)\n", students, teachers);
+
+    resetStore();
+    start = benchNanos();
+    loadDatabase(path);
+    printf("  %-24s %-8s %12.1f ms\n", "loadDatabase", "mmap", (benchNanos() - start) / 1e6);
+    g_sink += g_system.students->studentId;  // file order: first record is 1001
+    printf("  %-24s %-8s %12.1f MB\n", "record arena", "", g_recordArena.bytes / 1048576.0);
+    printf("  %-24s %-8s %12.1f MB\n", "subject pool", "", g_subjectPool.arena.bytes / 1048576.0);
+
+    resetStore();
+    start = benchNanos();
+    legacyLoadFromFile(path);
+    printf("  %-24s %-8s %12.1f ms\n", "loadFromFile", "strstr", (benchNanos() - start) / 1e6);
+
+    remove(path);
+}
+
+// ---------------------------------------------------------------------------
+// Primitives: ns/op, heap bytes and allocations, cache misses
+// ---------------------------------------------------------------------------
+
+#define PRIMITIVES_DIR "microbench_run"
+
+static int g_perfFd = -1;  // hardware cache-miss counter for this thread
+
+static void perfOpen() {
+#if defined(__linux__) && defined(__NR_perf_event_open)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    g_perfFd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static long long perfRead() {
+    long long misses;
+    if (g_perfFd < 0 || read(g_perfFd, &misses, sizeof(misses)) != sizeof(misses)) return -1;
+    return misses;
+}
+
+// Counters at the start of a measurement; sampleEnd turns them into deltas
+typedef struct {
+    double nanos;
+    long long bytes;
+    long long allocs;
+    long long misses;
+} BenchSample;
+
+// Record and subject arenas are carved from mmap'd blocks, not malloc
+static long long arenaBytes() {
+    return (long long)g_recordArena.bytes + (long long)g_subjectPool.arena.bytes;
+}
+
+static void sampleBegin(BenchSample* s) {
+    s->bytes = g_allocBytes + arenaBytes();
+    s->allocs = g_allocCount;
+    s->misses = perfRead();
+    s->nanos = benchNanos();
+}
+
+static void sampleEnd(BenchSample* s) {
+    s->nanos = benchNanos() - s->nanos;
+    long long misses = perfRead();
+    s->misses = misses >= 0 && s->misses >= 0 ? misses - s->misses : -1;
+    s->allocs = g_allocCount - s->allocs;
+    s->bytes = g_allocBytes + arenaBytes() - s->bytes;
+}
+
+static void reportPrimitive(const char* name, const BenchSample* s, long ops) {
+    printf("  %-24s %14.1f ns/op %12.1f B/op %8.2f allocs/op", name, s->nanos / ops,
+           (double)s->bytes / ops, (double)s->allocs / ops);
+    if (s->misses >= 0) printf(" %10.2f misses/op", (double)s->misses / ops);
+    printf("\n");
+}
+
+// The functions optimizations are judged against, on a snapshot of the given
+// size. The snapshot is written to and reloaded from PRIMITIVES_DIR.
+static void benchPrimitives(int students) {
+    int teachers = students / 20 > 0 ? students / 20 : 1;
+    long lookupOps = 1000000;
+    long fileOps = students <= 10000 ? 10 : students <= 100000 ? 3 : 1;
+    unsigned int seed = 4242;
+    BenchSample sample;
+
+    printf("Primitives (%d students x 5 subjects, %d teachers)\n", students, teachers);
+    makeDirectory(PRIMITIVES_DIR);
+    if (changeDirectory(PRIMITIVES_DIR) != 0) {
+        printf("  Cannot enter %s\n", PRIMITIVES_DIR);
+        return;
+    }
+    writeDatabase(DATABASE_FILE, students, teachers);
+
+    // loadFromFile without its banner. Every load but the last is thrown
+    // away; only the load itself is timed.
+    BenchSample total = {0, 0, 0, 0};
+    for (long i = 0; i < fileOps; i++) {
+        resetStore();
+        sampleBegin(&sample);
+        loadDatabase(DATABASE_FILE);
+        sampleEnd(&sample);
+        total.nanos += sample.nanos;
+        total.bytes += sample.bytes;
+        total.allocs += sample.allocs;
+        total.misses = total.misses >= 0 && sample.misses >= 0 ? total.misses + sample.misses : -1;
+    }
+    reportPrimitive("loadDatabase", &total, fileOps);
+
+    char body[] = "{\"role\":\"teacher\",\"email\":\"teacher7@bench.edu\",\"password\":\"teacher123\","
+                  "\"mid1\":18,\"mid2\":22,\"final\":61,\"attendance_percent\":87.5,\"remarks\":\"Good\"}";
+    int len = (int)strlen(body);
+    JsonObject args;
+    char value[120];
+    sampleBegin(&sample);
+    for (long i = 0; i < lookupOps; i++) {
+        jsonParse(&args, body, len);
+        g_sink += args.count;
+    }
+    sampleEnd(&sample);
+    reportPrimitive("jsonParse", &sample, lookupOps);
+
+    static const char* stringKeys[] = {"role", "email", "password", "remarks"};
+    sampleBegin(&sample);
+    for (long i = 0; i < lookupOps; i++) {
+        jsonString(&args, stringKeys[i & 3], value, sizeof(value));
+        g_sink += value[0];
+    }
+    sampleEnd(&sample);
+    reportPrimitive("jsonString", &sample, lookupOps);
+
+    sampleBegin(&sample);
+    for (long i = 0; i < lookupOps; i++) g_sink += (long long)jsonNumber(&args, i & 1 ? "attendance_percent" : "final");
+    sampleEnd(&sample);
+    reportPrimitive("jsonNumber", &sample, lookupOps);
+
+    // The reply buffer is reused, as a connection reuses its body buffer
+    OutBuffer out = {NULL, 0, 0};
+    sampleBegin(&sample);
+    for (long i = 0; i < lookupOps; i++) {
+        Student* s = findStudent(1001 + (int)(benchRandom(&seed) % students));
+        out.len = 0;
+        subjectsToJSON(s->subjects, s->subjectCount, &out);
+        g_sink += out.len;
+    }
+    sampleEnd(&sample);
+    reportPrimitive("subjectsToJSON", &sample, lookupOps);
+    free(out.data);
+
+    sampleBegin(&sample);
+    for (long i = 0; i < lookupOps; i++) g_sink += findStudent(1001 + (int)(benchRandom(&seed) % students))->year;
+    sampleEnd(&sample);
+    reportPrimitive("findStudent", &sample, lookupOps);
+
+    // Emails are formatted outside the timed loop
+    int emailCount = teachers < 4096 ? teachers : 4096;
+    char (*emails)[32] = (char(*)[32])malloc((size_t)emailCount * 32);
+    for (int i = 0; i < emailCount; i++) sprintf(emails[i], "teacher%u@bench.edu", benchRandom(&seed) % teachers);
+    sampleBegin(&sample);
+    for (long i = 0; i < lookupOps; i++) g_sink += findTeacherByEmail(emails[i % emailCount])->teacherId;
+    sampleEnd(&sample);
+    reportPrimitive("findTeacherByEmail", &sample, lookupOps);
+    free(emails);
+
+    sampleBegin(&sample);
+    for (long i = 0; i < fileOps; i++) saveToFile(0);
+    sampleEnd(&sample);
+    reportPrimitive("saveToFile", &sample, fileOps);
+
+    remove(DATABASE_FILE);
+    changeDirectory("..");
+}
+
+int main(int argc, char** argv) {
+    perfOpen();
+    if (argc > 2 && strcmp(argv[1], "--sizes") == 0) {
+        initSystem();
+        printf("Cache misses: %s\n", g_perfFd >= 0 ? "perf_event hardware counter" : "unavailable");
+        for (char* size = argv[2]; size; size = strchr(size, ',') ? strchr(size, ',') + 1 : NULL) {
+            int students = atoi(size);
+            if (students > 0) benchPrimitives(students);
+        }
+        return 0;
+    }
+
+    int students = argc > 1 ? atoi(argv[1]) : 100000;
+    int teachers = students / 20 > 0 ? students / 20 : 1;
+    if (students <= 0) {
+        printf("Usage: %s [students] | %s --sizes N[,N...]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    initSystem();
+    buildDataset(students, teachers);
+    benchLookups(students, teachers);
+    benchDepartments(students);
+    benchScans(students);
+    benchStats(students);
+    benchRankings(students);
+    benchParser();
+    benchLoader(students, teachers);
+    benchPrimitives(students);
+    return 0;
+}
@@ -3,24 +3,194 @@
 * Features: Admin, Principal, Teacher, and Student roles
 *           Teacher registration with Principal approval
 *           Role-based access control
-* Compile: gcc -o student_server student_server_enhanced.c -lws2_32
+*           Non-blocking event loop (epoll on Linux, select elsewhere)
+*           Worker thread pool with reader/writer locking over g_system
+*           HTTP/1.1 keep-alive with pipelined requests and idle timeout
+*           Write-ahead log with group commit; database.json is a checkpoint
+*           Crash-safe background snapshots (temp file, fsync, atomic rename)
+*           Single-pass JSON tokenizer (request bodies parsed once, zero-copy)
+*           Memory-mapped startup loader with arena-allocated records
+*           Growable JSON response builder; header and body sent with one gather write
+*           Cursor pagination (limit/cursor, ordered by studentId) and fields= projection
+*           Interned departments with per-department student and teacher posting lists
+*           Columnar mirror of numeric student and subject fields for analytics scans
+*           Pooled, growable per-student subject lists with a hashed subjectId index
+*           /api/stats summaries from AVX2/SSE2 column kernels (scalar fallback)
+*           Running per-department and per-subject aggregates (/api/aggregates)
+*           Top-K, range and percentile rankings from skip-list order indexes
+*           All-or-nothing batch mark entry logged as a single WAL record
+*           Bulk CSV/NDJSON import (chunked, multi-threaded validation) and export
+*           Login session tokens (Bearer) in a sharded, TTL-expiring table
+*           Single authorization stage with cached teacher/department decisions
+*           Prometheus /metrics: per-route counts, status codes, latency histograms
+*           Leveled logfmt logging through per-thread rings and a writer thread
+*           Table-driven router compiled into a path-segment trie with typed parameters
+* Compile (Windows): gcc -o student_server student_server_enhanced.c -lws2_32
+* Compile (Linux):   gcc -O2 -o student_server student_server_enhanced.c -lpthread
+* Usage: student_server [--port N] [--backlog N] [--max-connections N] [--workers N]
+*                       [--idle-timeout SECONDS] [--max-request BYTES] [--max-import BYTES]
+*                       [--wal-sync-ms N] [--wal-sync-batch N] [--wal-async]
+*                       [--checkpoint-records N] [--checkpoint-sec N] [--session-ttl SECONDS]
+*                       [--log-level error|warn|info|debug]
+* Build with -DLOG_COMPILE_LEVEL=LOG_INFO (or lower) to compile out debug logging.
 */
 
+#ifdef _WIN32
+#ifndef FD_SETSIZE
+#define FD_SETSIZE 1024
+#endif
+#define _CRT_RAND_S  // rand_s() for session tokens
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include <stdarg.h>
 #include <time.h>
+#include <float.h>
+#include <limits.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define STATS_X86 1   // SSE2/AVX2 kernels, AVX2 picked at run time
+#endif
 
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #pragma comment(lib, "ws2_32.lib")
+typedef SOCKET socket_t;
+#define SOCK_INVALID INVALID_SOCKET
+#define sockClose closesocket
+#define SOCK_WOULD_BLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#define SEND_FLAGS 0
+#define strncasecmp _strnicmp
+#include <io.h>
+#define fileSyncFd(fd) _commit(fd)
+#define fileTruncateFd(fd, size) _chsize(fd, size)
+#define fileno _fileno
+#define fileReplace(from, to) (MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1)
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+typedef int socket_t;
+#define SOCK_INVALID (-1)
+#define sockClose close
+#define fileSyncFd(fd) fsync(fd)
+#define fileTruncateFd(fd, size) ftruncate(fd, size)
+int fileReplace(const char* from, const char* to);
+#define SOCK_WOULD_BLOCK() (errno == EAGAIN || errno == EWOULDBLOCK)
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+#endif
+
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+// Acquire/release publication for single-producer rings (GCC and Clang builtins)
+#define atomicLoadAcquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define atomicStoreRelease(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#if defined(__linux__)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
+// Threading primitives: Win32 slim locks or pthreads
+#ifdef _WIN32
+typedef SRWLOCK RwLock;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE CondVar;
+#define THREAD_RETURN DWORD WINAPI
+#define rwlockInit(l) InitializeSRWLock(l)
+#define rwlockReadLock(l) AcquireSRWLockShared(l)
+#define rwlockReadUnlock(l) ReleaseSRWLockShared(l)
+#define rwlockWriteLock(l) AcquireSRWLockExclusive(l)
+#define rwlockWriteUnlock(l) ReleaseSRWLockExclusive(l)
+#define mutexInit(m) InitializeCriticalSection(m)
+#define mutexLock(m) EnterCriticalSection(m)
+#define mutexUnlock(m) LeaveCriticalSection(m)
+#define mutexDestroy(m) DeleteCriticalSection(m)
+#define condInit(c) InitializeConditionVariable(c)
+#define condDestroy(c) ((void)(c))
+#define condWait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define condWaitMs(c, m, ms) SleepConditionVariableCS(c, m, ms)
+#define condSignal(c) WakeConditionVariable(c)
+#define condBroadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_rwlock_t RwLock;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t CondVar;
+#define THREAD_RETURN void*
+#define rwlockReadLock(l) pthread_rwlock_rdlock(l)
+#define rwlockReadUnlock(l) pthread_rwlock_unlock(l)
+#define rwlockWriteLock(l) pthread_rwlock_wrlock(l)
+#define rwlockWriteUnlock(l) pthread_rwlock_unlock(l)
+#define mutexInit(m) pthread_mutex_init(m, NULL)
+#define mutexLock(m) pthread_mutex_lock(m)
+#define mutexUnlock(m) pthread_mutex_unlock(m)
+#define mutexDestroy(m) pthread_mutex_destroy(m)
+#define condInit(c) pthread_cond_init(c, NULL)
+#define condDestroy(c) pthread_cond_destroy(c)
+#define condWait(c, m) pthread_cond_wait(c, m)
+#define condSignal(c) pthread_cond_signal(c)
+#define condBroadcast(c) pthread_cond_broadcast(c)
+static void condWaitMs(pthread_cond_t* c, pthread_mutex_t* m, int ms) {
+    struct timeval now;
+    struct timespec until;
+    gettimeofday(&now, NULL);
+    long long nanos = (long long)now.tv_usec * 1000 + (long long)ms * 1000000;
+    until.tv_sec = now.tv_sec + (time_t)(nanos / 1000000000);
+    until.tv_nsec = (long)(nanos % 1000000000);
+    pthread_cond_timedwait(c, m, &until);
+}
+#endif
 
 #define PORT 8080
 #define BUFFER_SIZE 8192
+#define LISTEN_BACKLOG 4096
+#define MAX_CONNECTIONS 10000
+#define MAX_EVENTS 256
+#define MAX_WORKERS 256
+#define IDLE_TIMEOUT 15            // seconds a keep-alive connection may sit idle
+#define IDLE_SWEEP_MS 1000
+#define MAX_REQUEST_SIZE (1 << 20)
+#define MAX_IMPORT_SIZE (64 << 20)  // bulk import bodies (--max-import)
+#define DATABASE_FILE "database.json"
+#define DATABASE_TMP_FILE "database.json.tmp"
+#define WAL_FILE "database.wal"
+#define WAL_OLD_FILE "database.wal.old"  // log segment the running checkpoint covers
+#define SNAPSHOT_CHUNK 256                // records serialized per shared-lock hold
+#define WAL_SYNC_MS 2              // longest a commit waits for others to share its fsync
+#define WAL_SYNC_BATCH 64          // pending records that force an fsync right away
+#define CHECKPOINT_RECORDS 10000
+#define CHECKPOINT_SEC 300
 #define ADMIN_PASSWORD "admin123"
 #define PRINCIPAL_PASSWORD "principal123"
 #define TEACHER_PASSWORD "teacher123"
 #define DEFAULT_STUDENT_PASSWORD "student123"
+#define PAGE_LIMIT_DEFAULT 100     // page size when only a cursor is given
+#define PAGE_LIMIT_MAX 1000
+#define LOG_RING_SLOTS 512         // records a thread can have waiting for the writer
+#define LOG_FIELDS_SIZE 232        // formatted key=value fields per record
+#define LOG_FLUSH_MS 20            // writer wakes at least this often
 
 // Subject structure for per-subject marks and attendance
 typedef struct {
@@ -31,36 +201,50 @@ typedef struct {
     int final;
     double attendance_percent;
     char remarks[200];
+    int row;               // row in g_subjectColumns
 } Subject;
 
+// findStudentSubject index entry; a student's keys are sorted by hash
 typedef struct {
+    unsigned int hash;
+    int index;             // into Student.subjects
+} SubjectKey;
+
+typedef struct Student {
     int studentId;
     char name[100];
     char password[100];
     char email[120];
     char department[80];
+    int departmentId;      // interned department (see g_departments)
     int year;
     int semester;
     double cgpa;
     double attendance;
-    // Per-subject data
-    Subject subjects[10];  // max 10 subjects per student
+    // Per-subject data, in assignment order. Both arrays share one block
+    // from g_subjectPool and move when it grows, so Subject pointers are
+    // only good until the next assignment to this student.
+    Subject* subjects;
+    SubjectKey* subjectKeys;
     int subjectCount;
+    int subjectCapacity;
+    int row;               // row in g_studentColumns
     struct Student* next;
 } Student;
 
-typedef struct {
+typedef struct Teacher {
     int teacherId;
     char name[100];
     char password[100];
     char email[120];
     char department[80];
+    int departmentId;
     int approved;
     char approvalDate[50];
     struct Teacher* next;
 } Teacher;
 
-typedef struct {
+typedef struct Principal {
     int principalId;
     char name[100];
     char password[100];
@@ -79,955 +263,6188 @@ typedef struct {
 
 SystemData g_system = {NULL, NULL, NULL, 1001, 2001, 3001};
 
-// Function prototypes
-void initSystem();
-void loadFromFile();
-void saveToFile();
-Student* findStudent(int id);
-Teacher* findTeacher(int id);
-Teacher* findTeacherByEmail(char* email);
-Principal* findPrincipal(int id);
-void handleRequest(SOCKET client, char* request);
-void sendResponse(SOCKET client, int status, const char* body);
-void sendCORSHeaders(SOCKET client);
-void parseJSON(char* json, char* key, char* value);
-double parseJSONNumber(char* json, char* key);
-int parseJSONInt(char* json, char* key);
-void getCurrentTimestamp(char* buffer);
-void subjectsToJSON(Subject* subjects, int count, char* output);
-Subject* findStudentSubject(Student* s, char* subjectId);
+// Open-addressing hash index (linear probing, power-of-two capacity).
+// Records are never deleted, so no tombstones are needed.
+typedef struct {
+    int key;
+    void* value;
+} IdIndexSlot;
 
-int main() {
-    WSADATA wsa;
-    SOCKET server_sock, client_sock;
-    struct sockaddr_in server, client;
-    int c, size;
-    char buffer[BUFFER_SIZE];
+typedef struct {
+    IdIndexSlot* slots;
+    int capacity;
+    int count;
+} IdIndex;
 
-    printf("=========================================\n");
-    printf("  Enhanced Student Management System\n");
-    printf("=========================================\n");
-    printf("Default Credentials:\n");
-    printf("  Admin:     password = admin123\n");
-    printf("  Principal: password = principal123\n");
-    printf("  Teacher:   password = teacher123\n");
-    printf("  Student:   password = student123\n");
-    printf("=========================================\n\n");
+typedef struct {
+    unsigned int hash;
+    const char* key;  // points into the indexed record
+    void* value;
+} StrIndexSlot;
 
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
-        printf("WSAStartup failed\n");
-        return 1;
-    }
+typedef struct {
+    StrIndexSlot* slots;
+    int capacity;
+    int count;
+} StrIndex;
 
-    initSystem();
-    loadFromFile();
+// Bump allocator for records loaded at startup: a few large zeroed blocks
+// instead of one malloc per record. Records are never freed.
+#define ARENA_BLOCK (4 << 20)
 
-    if ((server_sock = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) {
-        printf("Socket creation failed\n");
-        return 1;
-    }
+typedef struct ArenaBlock {
+    char* data;
+    size_t used;
+    size_t cap;
+    struct ArenaBlock* next;
+} ArenaBlock;
 
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(PORT);
+typedef struct {
+    ArenaBlock* head;
+    size_t bytes;
+} Arena;
 
-    if (bind(server_sock, (struct sockaddr*)&server, sizeof(server)) == SOCKET_ERROR) {
-        printf("Bind failed\n");
-        return 1;
-    }
+Arena g_recordArena;
 
-    listen(server_sock, 3);
-    printf("Server running on http://localhost:%d\n\n", PORT);
+// Subject blocks come in size classes of 4, 6, 8, 12, 16, 24, ... subjects.
+// A block a student outgrows goes on its class's free list for the next one.
+#define SUBJECT_CLASSES 40
 
-    c = sizeof(struct sockaddr_in);
-    while ((client_sock = accept(server_sock, (struct sockaddr*)&client, &c)) != INVALID_SOCKET) {
-        size = recv(client_sock, buffer, BUFFER_SIZE - 1, 0);
-        if (size > 0) {
-            buffer[size] = '\0';
-            
-            // Check if we need to read more (simple handling for split packets)
-            char* body_start = strstr(buffer, "\r\n\r\n");
-            if (body_start && strlen(body_start + 4) == 0) {
-                 char* cl = strstr(buffer, "Content-Length: ");
-                 if (cl) {
-                     int content_len = atoi(cl + 16);
-                     if (content_len > 0) {
-                         int received = recv(client_sock, buffer + size, BUFFER_SIZE - 1 - size, 0);
-                         if (received > 0) {
-                             size += received;
-                             buffer[size] = '\0';
-                         }
-                     }
-                 }
-            }
-            
-            handleRequest(client_sock, buffer);
-        }
-        closesocket(client_sock);
-    }
+typedef struct {
+    Arena arena;
+    void* freeBlocks[SUBJECT_CLASSES];  // first word links to the next free block
+} SubjectPool;
 
-    closesocket(server_sock);
-    WSACleanup();
-    return 0;
-}
+SubjectPool g_subjectPool;
 
-void initSystem() {
-    g_system.students = NULL;
-    g_system.teachers = NULL;
-    g_system.principals = NULL;
-    g_system.nextStudentId = 1001;
-    g_system.nextTeacherId = 2001;
-    g_system.nextPrincipalId = 3001;
-}
+// Read-only view of a whole file
+typedef struct {
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} MappedFile;
 
-void handleRequest(SOCKET client, char* request) {
-    char method[10], path[256];
-    sscanf(request, "%s %s", method, path);
+// Records sorted by id, for cursor pagination and department listings.
+// New ids only grow, so inserts are appends; the loader pushes unsorted
+// and sorts once.
+typedef struct {
+    int id;
+    void* record;
+} IdListEntry;
 
-    printf("[%s] %s\n", method, path);
+typedef struct {
+    IdListEntry* items;
+    int count;
+    int capacity;
+} IdList;
 
-    if (strcmp(method, "OPTIONS") == 0) {
-        sendCORSHeaders(client);
-        return;
-    }
+IdList g_studentOrder;  // every student by studentId
 
-    char* body_start = strstr(request, "\r\n\r\n");
-    char body[BUFFER_SIZE] = {0};
-    if (body_start) {
-        strcpy(body, body_start + 4);
-    }
-
-    // Admin login
-    if (strcmp(method, "POST") == 0 && strcmp(path, "/api/admin/login") == 0) {
-        char password[100];
-        parseJSON(body, "password", password);
-        if (strcmp(password, ADMIN_PASSWORD) == 0) {
-            sendResponse(client, 200, "{\"success\":true,\"role\":\"admin\",\"message\":\"Admin login successful\"}");
-            printf("  ✓ Admin login successful\n");
-        } else {
-            sendResponse(client, 401, "{\"error\":\"Invalid admin password\"}");
-        }
-        return;
-    }
+// Count, sum and sum of squares kept up to date by deltas. min/max cannot
+// be un-applied, so removing a value at either end marks them stale and
+// the next reader rescans that group's rows (see aggregateRepair).
+typedef struct {
+    long long count;
+    double sum;
+    double sumSq;
+    double min;
+    double max;
+    int minMaxStale;
+} RunningStats;
 
-    // Principal login
-    if (strcmp(method, "POST") == 0 && strcmp(path, "/api/principal/login") == 0) {
-        char password[100];
-        parseJSON(body, "password", password);
-        if (strcmp(password, PRINCIPAL_PASSWORD) == 0) {
-            char resp[512];
-            sprintf(resp, "{\"success\":true,\"role\":\"principal\",\"principalId\":3001,\"message\":\"Principal login successful\"}");
-            sendResponse(client, 200, resp);
-            printf("  ✓ Principal login successful\n");
-        } else {
-            sendResponse(client, 401, "{\"error\":\"Invalid principal password\"}");
-        }
-        return;
-    }
+// Department names interned to small ids, each with posting lists of its
+// students and teachers. Departments are never removed.
+typedef struct {
+    int id;
+    char name[80];
+    IdList students;
+    IdList teachers;
+    RunningStats cgpa;
+    RunningStats attendance;
+} Department;
 
-    // Teacher login
-    if (strcmp(method, "POST") == 0 && strcmp(path, "/api/teacher/login") == 0) {
-        char email[120], password[100];
-        parseJSON(body, "email", email);
-        parseJSON(body, "password", password);
+typedef struct {
+    Department** items;  // indexed by department id
+    int count;
+    int capacity;
+} DepartmentTable;
 
-        Teacher* teacher = findTeacherByEmail(email);
-        if (teacher && strcmp(teacher->password, password) == 0) {
-            if (teacher->approved == 0) {
-                sendResponse(client, 403, "{\"error\":\"Your account is pending principal approval\"}");
-            } else if (teacher->approved == -1) {
-                sendResponse(client, 403, "{\"error\":\"Your account has been rejected\"}");
-            } else {
-                char resp[512];
-                sprintf(resp, "{\"success\":true,\"role\":\"teacher\",\"teacherId\":%d,\"name\":\"%s\",\"email\":\"%s\",\"department\":\"%s\",\"approved\":%d,\"password\":\"%s\"}",
-                    teacher->teacherId, teacher->name, teacher->email, teacher->department, teacher->approved, teacher->password);
-                sendResponse(client, 200, resp);
-                printf("  ✓ Teacher login: %s\n", teacher->name);
-            }
-        } else {
-            sendResponse(client, 401, "{\"error\":\"Invalid email or password\"}");
-        }
-        return;
-    }
+DepartmentTable g_departments;
 
-    // Get teacher by ID
-    if (strcmp(method, "GET") == 0 && strstr(path, "/api/teacher/") == path) {
-        int tid = 0;
-        sscanf(path, "/api/teacher/%d", &tid);
-        Teacher* t = findTeacher(tid);
-        if (!t) {
-            sendResponse(client, 404, "{\"error\":\"Teacher not found\"}");
-            return;
-        }
-        char resp[512];
-        sprintf(resp, "{\"teacherId\":%d,\"name\":\"%s\",\"email\":\"%s\",\"department\":\"%s\",\"approved\":%d}",
-            t->teacherId, t->name, t->email, t->department, t->approved);
-        sendResponse(client, 200, resp);
-        return;
-    }
+// Columnar mirror of the numeric student fields, one row per student in
+// insertion order. Scans over cgpa or attendance read these dense arrays
+// instead of pulling whole Student records through the cache. The records
+// stay authoritative; the store mutations keep the columns in step.
+typedef struct {
+    Student** record;
+    int* studentId;
+    int* departmentId;
+    int* year;
+    double* cgpa;
+    double* attendance;
+    int count;
+    int capacity;
+} StudentColumns;
 
-    // Get teachers list (Principal can filter by department)
-    if ((strcmp(method, "GET") == 0 || strcmp(method, "POST") == 0) && strncmp(path, "/api/teachers", 13) == 0) {
-        char department[80] = "";
-        char principalPassword[100] = "";
-        
-        // Parse query string or body
-        char* query = strchr(path, '?');
-        if (query != NULL) {
-            char queryBuf[256];
-            strncpy(queryBuf, query + 1, sizeof(queryBuf) - 1);
-            queryBuf[sizeof(queryBuf) - 1] = '\0';
-            if (strncmp(queryBuf, "department=", 11) == 0) {
-                strncpy(department, queryBuf + 11, sizeof(department) - 1);
-            }
-        }
-        
-        // Also try parsing from JSON body
-        parseJSON(body, "department", department);
-        parseJSON(body, "principalPassword", principalPassword);
+// One row per assigned subject
+typedef struct {
+    int* studentRow;
+    int* subjectKey;      // SubjectAggregate id
+    double* total;        // mid1 + mid2 + final, as double for the stats kernels
+    double* attendance;
+    int count;
+    int capacity;
+} SubjectColumns;
 
-        // Optional: verify principal auth
-        if (strlen(principalPassword) > 0 && strcmp(principalPassword, PRINCIPAL_PASSWORD) != 0) {
-            sendResponse(client, 401, "{\"error\":\"Unauthorized\"}");
-            return;
-        }
+StudentColumns g_studentColumns;
+SubjectColumns g_subjectColumns;
 
-        char resp[BUFFER_SIZE] = "[";
-        Teacher* current = g_system.teachers;
-        int first = 1;
-        while (current != NULL) {
-            int include = 0;
-            if (strlen(department) == 0) {
-                // No filter: include all approved teachers
-                include = (current->approved == 1);
-            } else {
-                // Filter by department and approved status
-                include = (current->approved == 1 && strcmp(current->department, department) == 0);
-            }
+// Order-maintaining index for rankings: a skip list sorted by (value, id)
+// whose links carry spans, so rank and select are O(log n) as well as
+// seeks. The bottom level is doubly linked for descending walks.
+#define RANK_MAX_LEVEL 32
 
-            if (include) {
-                char item[512];
-                sprintf(item, "%s{\"teacherId\":%d,\"name\":\"%s\",\"email\":\"%s\",\"department\":\"%s\"}",
-                    first ? "" : ",", current->teacherId, current->name, current->email, current->department);
-                strcat(resp, item);
-                first = 0;
-            }
-            current = current->next;
-        }
-        strcat(resp, "]");
-        sendResponse(client, 200, resp);
-        printf("  ✓ Teachers fetched (filter: %s)\n", strlen(department) > 0 ? department : "none");
-        return;
-    }
+typedef struct RankNode {
+    double value;
+    int id;                 // studentId; breaks ties
+    int level;
+    Student* record;
+    struct RankNode* prev;
+    struct {
+        struct RankNode* next;
+        int span;           // bottom-level nodes skipped by this link
+    } links[];
+} RankNode;
 
-    // Student login
-    if (strcmp(method, "POST") == 0 && strcmp(path, "/api/student/login") == 0) {
-        int studentId = parseJSONInt(body, "studentId");
-        char password[100];
-        parseJSON(body, "password", password);
+typedef struct {
+    RankNode* head;
+    RankNode* tail;
+    int count;
+    int level;
+    unsigned int seed;
+} RankIndex;
 
-        Student* student = findStudent(studentId);
-        if (student && strcmp(student->password, password) == 0) {
-            char resp[1024];
-            sprintf(resp, "{\"success\":true,\"role\":\"student\",\"studentId\":%d,\"name\":\"%s\",\"email\":\"%s\",\"department\":\"%s\",\"year\":%d,\"cgpa\":%.2f,\"attendance\":%.2f}",
-                student->studentId, student->name, student->email, student->department, student->year, student->cgpa, student->attendance);
-            sendResponse(client, 200, resp);
-            printf("  ✓ Student login: #%d\n", studentId);
-        } else {
-            sendResponse(client, 401, "{\"error\":\"Invalid student ID or password\"}");
-        }
-        return;
-    }
+RankIndex g_cgpaRank;
+RankIndex g_attendanceRank;
 
-    // Student registration
-    if (strcmp(method, "POST") == 0 && strcmp(path, "/api/student/register") == 0) {
-        char name[100], password[100], email[120], department[80];
-        int year;
-        parseJSON(body, "name", name);
-        parseJSON(body, "password", password);
-        parseJSON(body, "email", email);
-        parseJSON(body, "department", department);
-        year = parseJSONInt(body, "year");
-
-        if (strlen(name) == 0 || strlen(password) < 4 || year < 1 || year > 6) {
-            sendResponse(client, 400, "{\"error\":\"Invalid input\"}");
-            return;
-        }
+enum { RANK_CGPA, RANK_ATTENDANCE, RANK_SUBJECT };
 
-        Student* stu = (Student*)malloc(sizeof(Student));
-        stu->studentId = g_system.nextStudentId++;
-        strcpy(stu->name, name);
-        strcpy(stu->password, password);
-        strcpy(stu->email, email);
-        strcpy(stu->department, department);
-        stu->year = year;
-        stu->semester = 1;  // default semester
-        stu->cgpa = 0.0;
-        stu->attendance = 0.0;
-        stu->subjectCount = 0;  // no subjects initially
-        stu->next = g_system.students;
-        g_system.students = stu;
-
-        char resp[512];
-        sprintf(resp, "{\"studentId\":%d,\"name\":\"%s\",\"message\":\"Registration successful\"}", stu->studentId, stu->name);
-        sendResponse(client, 201, resp);
-        saveToFile();
-        printf("  ✓ Student registered: #%d\n", stu->studentId);
-        return;
-    }
+// One ranking result, copied out of the index
+typedef struct {
+    double value;
+    int id;
+    Student* record;
+} RankEntry;
 
-    // Teacher registration (pending approval)
-    if (strcmp(method, "POST") == 0 && strcmp(path, "/api/teacher/register") == 0) {
-        char name[100], password[100], email[120], department[80];
-        parseJSON(body, "name", name);
-        parseJSON(body, "password", password);
-        parseJSON(body, "email", email);
-        parseJSON(body, "department", department);
+// Running aggregates for one subjectId across every student taking it
+typedef struct {
+    int id;
+    char subjectId[20];
+    char name[100];       // name it was first assigned with
+    RunningStats total;
+    RunningStats attendance;
+    RankIndex ranking;    // mid1 + mid2 + final per enrolled student
+} SubjectAggregate;
 
-        if (strlen(name) == 0 || strlen(password) < 4 || strlen(email) == 0) {
-            sendResponse(client, 400, "{\"error\":\"Invalid input\"}");
-            return;
-        }
+typedef struct {
+    SubjectAggregate** items;  // indexed by id
+    int count;
+    int capacity;
+} SubjectAggregateTable;
 
-        if (findTeacherByEmail(email) != NULL) {
-            sendResponse(client, 400, "{\"error\":\"Email already registered\"}");
-            return;
-        }
+SubjectAggregateTable g_subjectAggregates;
+Mutex g_aggregateRepairLock;  // serializes readers of the running aggregates (see aggregateRepair)
 
-        Teacher* teacher = (Teacher*)malloc(sizeof(Teacher));
-        teacher->teacherId = g_system.nextTeacherId++;
-        strcpy(teacher->name, name);
-        strcpy(teacher->password, password);
-        strcpy(teacher->email, email);
-        strcpy(teacher->department, department);
-        teacher->approved = 0;
-        strcpy(teacher->approvalDate, "");
-        teacher->next = g_system.teachers;
-        g_system.teachers = teacher;
-
-        char resp[512];
-        sprintf(resp, "{\"teacherId\":%d,\"message\":\"Registration submitted. Pending principal approval\"}", teacher->teacherId);
-        sendResponse(client, 201, resp);
-        saveToFile();
-        printf("  ✓ Teacher registered (pending): #%d - %s\n", teacher->teacherId, teacher->name);
-        return;
-    }
+// Summary of one column over the selected rows. Histogram buckets are
+// [i*width, (i+1)*width); values past the ends land in the first/last bucket.
+#define STATS_BUCKETS 10
 
-    // Get pending teachers (Principal only)
-    if (strcmp(method, "GET") == 0 && strcmp(path, "/api/principal/pending-teachers") == 0) {
-        char resp[BUFFER_SIZE] = "[";
-        Teacher* current = g_system.teachers;
-        int first = 1;
-        while (current != NULL) {
-            if (current->approved == 0) {
-                char item[512];
-                sprintf(item, "%s{\"teacherId\":%d,\"name\":\"%s\",\"email\":\"%s\",\"department\":\"%s\"}",
-                    first ? "" : ",", current->teacherId, current->name, current->email, current->department);
-                strcat(resp, item);
-                first = 0;
-            }
-            current = current->next;
-        }
-        strcat(resp, "]");
-        sendResponse(client, 200, resp);
-        printf("  ✓ Retrieved pending teachers\n");
-        return;
-    }
+typedef struct {
+    long long count;
+    double sum;
+    double sumSq;
+    double min;
+    double max;
+    long long buckets[STATS_BUCKETS];
+} ColumnStats;
 
-    // Approve/Reject teacher
-    if (strcmp(method, "POST") == 0 && strstr(path, "/api/principal/teachers/") && strstr(path, "/approve")) {
-        int teacherId;
-        sscanf(path, "/api/principal/teachers/%d/approve", &teacherId);
-        char auth[100];
-        int action;
-        parseJSON(body, "password", auth);
-        action = parseJSONInt(body, "action");
+// Student list projection (fields=); studentId is always sent
+#define FIELD_NAME       0x01
+#define FIELD_EMAIL      0x02
+#define FIELD_DEPARTMENT 0x04
+#define FIELD_YEAR       0x08
+#define FIELD_CGPA       0x10
+#define FIELD_ATTENDANCE 0x20
+#define FIELD_ALL        0x3f
 
-        if (strcmp(auth, PRINCIPAL_PASSWORD) != 0) {
-            sendResponse(client, 401, "{\"error\":\"Unauthorized\"}");
-            return;
-        }
+// One row of a batch mark entry (POST /api/marks/batch). Every row is
+// resolved and validated before any is applied.
+#define MARK_BATCH_MAX 1000
 
-        Teacher* teacher = findTeacher(teacherId);
-        if (!teacher) {
-            sendResponse(client, 404, "{\"error\":\"Teacher not found\"}");
-            return;
-        }
+typedef struct {
+    Student* student;
+    Subject* subject;
+    int mid1;
+    int mid2;
+    int final;
+    double attendance;
+    char remarks[200];
+} MarkRow;
 
-        if (action == 1) {
-            teacher->approved = 1;
-            getCurrentTimestamp(teacher->approvalDate);
-            sendResponse(client, 200, "{\"message\":\"Teacher approved\"}");
-            printf("  ✓ Teacher approved: #%d\n", teacherId);
-        } else {
-            teacher->approved = -1;
-            sendResponse(client, 200, "{\"message\":\"Teacher rejected\"}");
-            printf("  ✓ Teacher rejected: #%d\n", teacherId);
-        }
-        saveToFile();
-        return;
-    }
+// Bulk import (/api/import/...): bodies are processed IMPORT_CHUNK_ROWS lines
+// at a time, parsed and validated by up to IMPORT_MAX_THREADS helper threads
+#define IMPORT_CHUNK_ROWS 4096
+#define IMPORT_MAX_THREADS 8
+#define IMPORT_MAX_ERRORS 100  // errors listed in a rejection; all are counted
+#define IMPORT_MAX_COLUMNS 32
 
-    // Get student by ID (with subjects) - must come before list students
-    if (strcmp(method, "GET") == 0 && strstr(path, "/api/students/") == path) {
-        // Check if this is actually a single student request (has ID after /api/students/)
-        char pathCopy[256];
-        strncpy(pathCopy, path, sizeof(pathCopy) - 1);
-        pathCopy[sizeof(pathCopy) - 1] = '\0';
-        
-        // Remove query string if present
-        char* queryStart = strchr(pathCopy, '?');
-        if (queryStart) *queryStart = '\0';
-        
-        // Check if there's a student ID (path is longer than just "/api/students")
-        if (strlen(pathCopy) > 14) {  // "/api/students/" is 14 chars
-            int studentId = 0;
-            sscanf(path, "/api/students/%d", &studentId);
-            Student* s = findStudent(studentId);
-            if (!s) {
-                sendResponse(client, 404, "{\"error\":\"Student not found\"}");
-                return;
-            }
-            char subjectsJson[2048];
-            subjectsToJSON(s->subjects, s->subjectCount, subjectsJson);
-            char resp[4096];
-            sprintf(resp, "{\"id\":%d,\"studentId\":%d,\"name\":\"%s\",\"email\":\"%s\",\"department\":\"%s\",\"year\":%d,\"semester\":%d,\"cgpa\":%.2f,\"attendance\":%.2f,\"attendance_percent\":%.2f,\"subjects\":%s}",
-                s->studentId, s->studentId, s->name, s->email, s->department, s->year, s->semester, s->cgpa, s->attendance, s->attendance, subjectsJson);
-            sendResponse(client, 200, resp);
-            return;
-        }
-    }
+enum { IMPORT_STUDENTS, IMPORT_TEACHERS, IMPORT_MARKS };
+enum { FORMAT_CSV, FORMAT_NDJSON };
 
-    // Role-based student fetch (supports GET with query or POST with JSON)
-    if ((strcmp(method, "GET") == 0 || strcmp(method, "POST") == 0) && (strcmp(path, "/api/students") == 0 || strstr(path, "/api/students?") == path)) {
-        char role[50];
-        char dept[80];
-        char teacherEmail[120];
-        char principalPassword[100];
-        int studentIdFilter = 0;
-        role[0] = '\0'; dept[0] = '\0'; teacherEmail[0] = '\0'; principalPassword[0] = '\0';
-
-        // Parse JSON body first
-        parseJSON(body, "role", role);
-        parseJSON(body, "department", dept);
-        parseJSON(body, "email", teacherEmail);
-        parseJSON(body, "principalPassword", principalPassword);
-        studentIdFilter = parseJSONInt(body, "studentId");
-
-        // Fallback: parse query string for role/department if body was empty
-        char* query = strchr(path, '?');
-        if (query != NULL) {
-            char queryBuf[256];
-            strncpy(queryBuf, query + 1, sizeof(queryBuf) - 1);
-            queryBuf[sizeof(queryBuf) - 1] = '\0';
-            char* token = strtok(queryBuf, "&");
-            while (token != NULL) {
-                if (strncmp(token, "role=", 5) == 0 && strlen(role) == 0) {
-                    strncpy(role, token + 5, sizeof(role) - 1);
-                } else if (strncmp(token, "department=", 11) == 0 && strlen(dept) == 0) {
-                    strncpy(dept, token + 11, sizeof(dept) - 1);
-                }
-                token = strtok(NULL, "&");
-            }
-        }
+// Importable fields. CSV header names and NDJSON keys are the same strings
+// (g_importColumns); studentId/teacherId both fill ImportRow.id.
+enum {
+    COL_STUDENT_ID, COL_TEACHER_ID, COL_NAME, COL_PASSWORD, COL_EMAIL, COL_DEPARTMENT,
+    COL_YEAR, COL_SEMESTER, COL_CGPA, COL_ATTENDANCE, COL_APPROVED, COL_APPROVAL_DATE,
+    COL_SUBJECT_ID, COL_MID1, COL_MID2, COL_FINAL, COL_ATTENDANCE_PERCENT, COL_REMARKS,
+    COL_COUNT
+};
 
-        if (strlen(role) == 0) {
-            sendResponse(client, 400, "{\"error\":\"Role required\"}");
-            return;
-        }
+typedef struct {
+    int line;             // 1-based line in the body, for error reports
+    int present;          // bit (1 << COL_*) per field given
+    int id;
+    int year;
+    int semester;
+    int approved;
+    int mid1;
+    int mid2;
+    int final;
+    double cgpa;
+    double attendance;    // attendance (students) or attendance_percent (marks)
+    char name[100];       // student or teacher name, or subject name for marks
+    char password[100];
+    char email[120];
+    char department[80];
+    char approvalDate[50];
+    char subjectId[20];
+    char remarks[200];
+    char error[160];      // empty when the row is valid
+} ImportRow;
 
-        // Optional authorization for principal
-        if (strcmp(role, "principal") == 0 && strlen(principalPassword) > 0 && strcmp(principalPassword, PRINCIPAL_PASSWORD) != 0) {
-            sendResponse(client, 401, "{\"error\":\"Unauthorized\"}");
-            return;
-        }
+// One chunk of lines and the rows parsed from them
+typedef struct {
+    int kind;
+    int format;
+    int validate;
+    int columns[IMPORT_MAX_COLUMNS];  // CSV: COL_* per position
+    int columnCount;
+    const char* lines[IMPORT_CHUNK_ROWS];
+    int lengths[IMPORT_CHUNK_ROWS];
+    int lineNumbers[IMPORT_CHUNK_ROWS];
+    ImportRow rows[IMPORT_CHUNK_ROWS];
+    int count;
+} ImportChunk;
 
-        // Ensure teachers are approved before listing students
-        if (strcmp(role, "teacher") == 0) {
-            Teacher* t = NULL;
-            if (strlen(teacherEmail) > 0) {
-                t = findTeacherByEmail(teacherEmail);
-            }
-            if (t == NULL || t->approved != 1) {
-                sendResponse(client, 403, "{\"error\":\"Forbidden: teacher not approved\"}");
-                return;
-            }
-            if (strlen(dept) == 0 && t != NULL) {
-                strncpy(dept, t->department, sizeof(dept) - 1);
-            }
-        }
+// Session tokens issued at login and sent back as "Authorization: Bearer <token>".
+// The table is split into independently locked shards picked by token hash;
+// entries expire sessionTtl seconds after login.
+#define SESSION_SHARDS 16
+#define SESSION_BUCKETS 1024       // hash chains per shard
+#define SESSION_TOKEN_BYTES 16     // random bytes, sent as twice as many hex digits
+#define SESSION_TTL_SEC 3600
 
-        char resp[BUFFER_SIZE] = "[";
-        Student* current = g_system.students;
-        int first = 1;
-        while (current != NULL) {
-            int include = 0;
-            if (strcmp(role, "student") == 0) {
-                include = (studentIdFilter == 0 || current->studentId == studentIdFilter);
-            } else if (strcmp(role, "teacher") == 0) {
-                // Teacher sees only matching department
-                include = (strlen(dept) > 0 && strcmp(current->department, dept) == 0);
-            } else if (strcmp(role, "principal") == 0) {
-                include = 1;
-            }
+enum { ROLE_NONE, ROLE_STUDENT, ROLE_TEACHER, ROLE_PRINCIPAL, ROLE_ADMIN };
 
-            if (include) {
-                char item[512];
-                sprintf(item, "%s{\"studentId\":%d,\"name\":\"%s\",\"email\":\"%s\",\"department\":\"%s\",\"year\":%d,\"cgpa\":%.2f,\"attendance\":%.2f}",
-                    first ? "" : ",", current->studentId, current->name, current->email, current->department, current->year, current->cgpa, current->attendance);
-                strcat(resp, item);
-                first = 0;
-            }
-            current = current->next;
-        }
-        strcat(resp, "]");
-        sendResponse(client, 200, resp);
-        printf("  ✓ Students fetched for role %s\n", role);
-        return;
-    }
+typedef struct Session {
+    char token[SESSION_TOKEN_BYTES * 2 + 1];
+    unsigned int hash;
+    int role;
+    int userId;            // studentId, teacherId or principalId
+    int departmentId;      // the teacher's or student's department, else -1
+    long long expires;     // nowMillis() deadline
+    struct Session* next;
+} Session;
 
-    // Update subject marks and attendance (role-based)
-    if (strcmp(method, "PUT") == 0 && strstr(path, "/api/students/") && strstr(path, "/subjects/")) {
-        int studentId = 0;
-        char subjectId[20];
-        sscanf(path, "/api/students/%d/subjects/%19[^/]", &studentId, subjectId);
-        
-        Student* s = findStudent(studentId);
-        if (!s) {
-            sendResponse(client, 404, "{\"error\":\"Student not found\"}");
-            return;
-        }
+typedef struct {
+    Mutex lock;
+    Session* buckets[SESSION_BUCKETS];
+    int sweep;             // next bucket to purge of expired entries
+    int count;
+} SessionShard;
 
-        // Parse authorization
-        char role[50], teacherEmail[120], teacherPassword[100], principalPassword[100];
-        role[0] = '\0'; teacherEmail[0] = '\0'; teacherPassword[0] = '\0'; principalPassword[0] = '\0';
-        parseJSON(body, "role", role);
-        parseJSON(body, "email", teacherEmail);
-        parseJSON(body, "password", teacherPassword);
-        parseJSON(body, "principalPassword", principalPassword);
-
-        int authorized = 0;
-        char authError[256] = "";
-        
-        printf("  [DEBUG] Update Subject - Role: '%s', Email: '%s', Pass: '%s', PrincipalPass: '%s'\n", 
-            role, teacherEmail, teacherPassword, principalPassword);
-        
-        if (strcmp(role, "teacher") == 0) {
-            // Teacher must be from same department
-            Teacher* t = findTeacherByEmail(teacherEmail);
-            if (!t) {
-                sprintf(authError, "{\"error\":\"Teacher not found with email: %s\"}", teacherEmail);
-                printf("  [DEBUG] Teacher not found: %s\n", teacherEmail);
-            } else {
-                printf("  [DEBUG] Found teacher: %s, approved=%d, password=%s, dept=%s\n", 
-                    t->name, t->approved, t->password, t->department);
-                
-                if (t->approved != 1) {
-                    sprintf(authError, "{\"error\":\"Teacher not approved (status: %d)\"}", t->approved);
-                } else if (strcmp(t->password, teacherPassword) != 0) {
-                    strcpy(authError, "{\"error\":\"Invalid teacher password\"}");
-                } else if (strcmp(t->department, s->department) != 0) {
-                    sprintf(authError, "{\"error\":\"Department mismatch: teacher=%s, student=%s\"}", t->department, s->department);
-                } else {
-                    authorized = 1;
-                }
-            }
-        } else if (strcmp(role, "principal") == 0) {
-            // Principal can update any student
-            printf("  [DEBUG] Checking principal password: '%s' vs '%s'\n", principalPassword, PRINCIPAL_PASSWORD);
-            if (strcmp(principalPassword, PRINCIPAL_PASSWORD) == 0) {
-                authorized = 1;
-            } else {
-                strcpy(authError, "{\"error\":\"Invalid principal password\"}");
-            }
-        } else {
-            sprintf(authError, "{\"error\":\"Invalid role: %s\"}", role);
-        }
+SessionShard g_sessions[SESSION_SHARDS];
 
-        if (!authorized) {
-            if (strlen(authError) == 0) {
-                sendResponse(client, 403, "{\"error\":\"Forbidden: insufficient role or department mismatch\"}");
-            } else {
-                sendResponse(client, 403, authError);
-            }
-            printf("  ✗ Authorization failed for subject update: %s\n", authError);
-            return;
-        }
+// Staff routes are authorized once, before their handler runs (authorizeRequest);
+// each route table entry names its scope. Scopes: no check, teacher or
+// principal acting on the student in the path, teacher or principal,
+// principal only.
+enum { AUTH_SCOPE_NONE, AUTH_SCOPE_STUDENT, AUTH_SCOPE_STAFF, AUTH_SCOPE_PRINCIPAL };
 
-        // Find subject in student's subjects
-        Subject* subj = findStudentSubject(s, subjectId);
-        if (!subj) {
-            sendResponse(client, 404, "{\"error\":\"Subject not found for this student\"}");
-            return;
-        }
+enum {
+    AUTH_OK, AUTH_SESSION, AUTH_NO_CREDENTIALS, AUTH_NO_TEACHER, AUTH_BAD_PASSWORD,
+    AUTH_BAD_PRINCIPAL, AUTH_NOT_APPROVED, AUTH_DEPARTMENT, AUTH_FORBIDDEN, AUTH_RESULT_COUNT
+};
 
-        // Parse marks and attendance
-        int mid1 = parseJSONInt(body, "mid1");
-        int mid2 = parseJSONInt(body, "mid2");
-        int final = parseJSONInt(body, "final");
-        double attendance = parseJSONNumber(body, "attendance_percent");
-        char remarks[200];
-        parseJSON(body, "remarks", remarks);
+// Fixed responses for each refusal; message is the same text for per-row errors
+typedef struct {
+    int status;
+    const char* message;
+    const char* body;
+} AuthFailure;
 
-        // Validation: marks should be non-negative
-        if (mid1 < 0 || mid2 < 0 || final < 0 || attendance < 0.0 || attendance > 100.0) {
-            sendResponse(client, 400, "{\"error\":\"Validation failed: marks must be non-negative, attendance 0-100\"}");
-            return;
-        }
+#define AUTH_FAILURE(status, text) {status, text, "{\"error\":\"" text "\"}"}
 
-        // Update subject
-        subj->mid1 = mid1;
-        subj->mid2 = mid2;
-        subj->final = final;
-        subj->attendance_percent = attendance;
-        if (strlen(remarks) > 0) {
-            strncpy(subj->remarks, remarks, sizeof(subj->remarks) - 1);
-        }
-
-        saveToFile();
-        
-        // Return updated subject
-        char respBody[512];
-        int total = subj->mid1 + subj->mid2 + subj->final;
-        sprintf(respBody, "{\"message\":\"Subject updated\",\"subjectId\":\"%s\",\"marks\":{\"mid1\":%d,\"mid2\":%d,\"final\":%d,\"total\":%d},\"attendance_percent\":%.2f}",
-            subj->subjectId, subj->mid1, subj->mid2, subj->final, total, subj->attendance_percent);
-        sendResponse(client, 200, respBody);
-        printf("  ✓ Subject updated for student #%d - %s\n", studentId, subjectId);
-        return;
-    }
+const AuthFailure g_authFailures[AUTH_RESULT_COUNT] = {
+    {200, "", ""},
+    AUTH_FAILURE(401, "Session expired or invalid; log in again"),
+    AUTH_FAILURE(401, "Credentials required: a session token, or role with email/password or principalPassword"),
+    AUTH_FAILURE(403, "Teacher not found"),
+    AUTH_FAILURE(403, "Invalid teacher password"),
+    AUTH_FAILURE(403, "Invalid principal password"),
+    AUTH_FAILURE(403, "Teacher not approved"),
+    AUTH_FAILURE(403, "Forbidden: student is in another department"),
+    AUTH_FAILURE(403, "Forbidden: insufficient role")
+};
 
-    // Update student academics (role-based)
-    if (strcmp(method, "PUT") == 0 && strstr(path, "/api/students/") == path && strstr(path, "/academics") != NULL) {
-        int studentId = 0;
-        sscanf(path, "/api/students/%d/academics", &studentId);
-        Student* s = findStudent(studentId);
-        if (!s) {
-            sendResponse(client, 404, "{\"error\":\"Student not found\"}");
-            return;
-        }
+// Who an authorized staff request acts as
+typedef struct {
+    int role;    // ROLE_TEACHER or ROLE_PRINCIPAL
+    int userId;  // teacherId or principalId
+} Caller;
 
-        char role[50];
-        char teacherEmail[120];
-        char teacherPassword[100];
-        char principalPassword[100];
-        role[0] = '\0'; teacherEmail[0] = '\0'; teacherPassword[0] = '\0'; principalPassword[0] = '\0';
-        parseJSON(body, "role", role);
-        parseJSON(body, "email", teacherEmail);
-        parseJSON(body, "password", teacherPassword);
-        parseJSON(body, "principalPassword", principalPassword);
-
-        int authorized = 0;
-        char authError[256] = "";
-        
-        printf("  [DEBUG] Update Academics - Role: '%s', Email: '%s', Pass: '%s', PrincipalPass: '%s'\n", 
-            role, teacherEmail, teacherPassword, principalPassword);
-        
-        if (strcmp(role, "teacher") == 0) {
-            Teacher* t = findTeacherByEmail(teacherEmail);
-            if (!t) {
-                sprintf(authError, "{\"error\":\"Teacher not found with email: %s\"}", teacherEmail);
-                printf("  [DEBUG] Teacher not found: %s\n", teacherEmail);
-            } else {
-                printf("  [DEBUG] Found teacher: %s, approved=%d, password=%s, dept=%s\n", 
-                    t->name, t->approved, t->password, t->department);
-                
-                if (t->approved != 1) {
-                    sprintf(authError, "{\"error\":\"Teacher not approved (status: %d)\"}", t->approved);
-                } else if (strcmp(t->password, teacherPassword) != 0) {
-                    strcpy(authError, "{\"error\":\"Invalid teacher password\"}");
-                } else {
-                    // ensure teacher can only update own department
-                    Student* target = findStudent(studentId);
-                    if (!target) {
-                        strcpy(authError, "{\"error\":\"Student not found\"}");
-                    } else if (strcmp(target->department, t->department) != 0) {
-                        sprintf(authError, "{\"error\":\"Department mismatch: teacher=%s, student=%s\"}", t->department, target->department);
-                    } else {
-                        authorized = 1;
-                    }
-                }
-            }
-        } else if (strcmp(role, "principal") == 0) {
-            printf("  [DEBUG] Checking principal password: '%s' vs '%s'\n", principalPassword, PRINCIPAL_PASSWORD);
-            if (strcmp(principalPassword, PRINCIPAL_PASSWORD) == 0) {
-                authorized = 1;
-            } else {
-                strcpy(authError, "{\"error\":\"Invalid principal password\"}");
-            }
-        } else {
-            sprintf(authError, "{\"error\":\"Invalid role: %s\"}", role);
-        }
+// Direct-mapped cache of (teacherId, departmentId) decisions. Bumping the
+// generation (authInvalidate, on any approval change) drops every entry.
+// Only staff mutations use it, under the exclusive g_systemLock.
+#define AUTH_CACHE_SIZE 4096
 
-        if (!authorized) {
-            if (strlen(authError) == 0) {
-                sendResponse(client, 403, "{\"error\":\"Forbidden: insufficient role\"}");
-            } else {
-                sendResponse(client, 403, authError);
-            }
-            printf("  ✗ Authorization failed for academics update: %s\n", authError);
-            return;
-        }
+typedef struct {
+    int teacherId;
+    int departmentId;
+    unsigned int generation;  // 0 = empty
+    int decision;
+} AuthCacheEntry;
 
-        double newCgpa = parseJSONNumber(body, "cgpa");
-        double newAttendance = parseJSONNumber(body, "attendance_percent");
-        if (newAttendance == 0.0) {
-            // allow key 'attendance' as well
-            newAttendance = parseJSONNumber(body, "attendance");
-        }
+AuthCacheEntry g_authCache[AUTH_CACHE_SIZE];
+unsigned int g_authGeneration = 1;
 
-        if (newCgpa < 0.0 || newCgpa > 10.0 || newAttendance < 0.0 || newAttendance > 100.0) {
-            sendResponse(client, 400, "{\"error\":\"Validation failed: CGPA 0-10, Attendance 0-100\"}");
-            return;
-        }
+IdIndex g_studentIndex;       // studentId -> Student*
+IdIndex g_teacherIndex;       // teacherId -> Teacher*
+StrIndex g_teacherEmailIndex; // email -> Teacher*
+StrIndex g_departmentIndex;   // department name -> Department*
+StrIndex g_subjectAggregateIndex; // subjectId -> SubjectAggregate*
 
-        s->cgpa = newCgpa;
-        s->attendance = newAttendance;
-        saveToFile();
-        char resp[256];
-        sprintf(resp, "{\"message\":\"Academics updated\",\"cgpa\":%.2f,\"attendance_percent\":%.2f}", s->cgpa, s->attendance);
-        sendResponse(client, 200, resp);
-        printf("  ✓ Academics updated for student #%d by %s\n", studentId, strlen(role)?role:"unknown");
-        return;
-    }
+// Members of one parsed JSON object. Spans point into the parsed text and
+// are not NUL-terminated; string values exclude their quotes.
+#define JSON_MAX_FIELDS 32
 
-    // Assign new subject to student (POST /api/students/:id/subjects)
-    if (strcmp(method, "POST") == 0 && strstr(path, "/api/students/") && strstr(path, "/subjects") && !strstr(path, "/subjects/")) {
-        int studentId = 0;
-        sscanf(path, "/api/students/%d/subjects", &studentId);
-        
-        Student* s = findStudent(studentId);
-        if (!s) {
-            sendResponse(client, 404, "{\"error\":\"Student not found\"}");
-            return;
-        }
+enum { JSON_STRING, JSON_LITERAL, JSON_OBJECT, JSON_ARRAY };
 
-        // Parse authorization
-        char role[50], teacherEmail[120], teacherPassword[100], principalPassword[100];
-        role[0] = '\0'; teacherEmail[0] = '\0'; teacherPassword[0] = '\0'; principalPassword[0] = '\0';
-        parseJSON(body, "role", role);
-        parseJSON(body, "email", teacherEmail);
-        parseJSON(body, "password", teacherPassword);
-        parseJSON(body, "principalPassword", principalPassword);
-
-        int authorized = 0;
-        char authError[256] = "";
-        
-        printf("  [DEBUG] Assign Subject - Role: '%s', Email: '%s', Pass: '%s', PrincipalPass: '%s'\n", 
-            role, teacherEmail, teacherPassword, principalPassword);
-        
-        if (strcmp(role, "teacher") == 0) {
-            // Teacher must be from same department
-            Teacher* t = findTeacherByEmail(teacherEmail);
-            if (!t) {
-                sprintf(authError, "{\"error\":\"Teacher not found with email: %s\"}", teacherEmail);
-                printf("  [DEBUG] Teacher not found: %s\n", teacherEmail);
-            } else {
-                printf("  [DEBUG] Found teacher: %s, approved=%d, password=%s, dept=%s\n", 
-                    t->name, t->approved, t->password, t->department);
-                printf("  [DEBUG] Student dept=%s, Passwords match=%d\n", 
-                    s->department, strcmp(t->password, teacherPassword) == 0);
-                
-                if (t->approved != 1) {
-                    sprintf(authError, "{\"error\":\"Teacher not approved (status: %d)\"}", t->approved);
-                } else if (strcmp(t->password, teacherPassword) != 0) {
-                    strcpy(authError, "{\"error\":\"Invalid teacher password\"}");
-                } else if (strcmp(t->department, s->department) != 0) {
-                    sprintf(authError, "{\"error\":\"Department mismatch: teacher=%s, student=%s\"}", t->department, s->department);
-                } else {
-                    authorized = 1;
-                }
-            }
-        } else if (strcmp(role, "principal") == 0) {
-            // Principal can assign subjects to any student
-            printf("  [DEBUG] Checking principal password: '%s' vs '%s'\n", principalPassword, PRINCIPAL_PASSWORD);
-            if (strcmp(principalPassword, PRINCIPAL_PASSWORD) == 0) {
-                authorized = 1;
-            } else {
-                strcpy(authError, "{\"error\":\"Invalid principal password\"}");
-            }
-        } else {
-            sprintf(authError, "{\"error\":\"Invalid role: %s\"}", role);
-        }
+typedef struct {
+    const char* key;
+    int keyLen;
+    const char* value;
+    int valueLen;
+    char type;
+    char escaped;  // string value contains backslash escapes
+} JsonField;
 
-        if (!authorized) {
-            if (strlen(authError) == 0) {
-                sendResponse(client, 403, "{\"error\":\"Forbidden: insufficient role or department mismatch\"}");
-            } else {
-                sendResponse(client, 403, authError);
-            }
-            printf("  ✗ Authorization failed for subject assignment: %s\n", authError);
-            return;
-        }
+typedef struct {
+    JsonField fields[JSON_MAX_FIELDS];
+    int count;
+} JsonObject;
 
-        // Parse subject data
-        char subjectId[20], name[100];
-        subjectId[0] = '\0'; name[0] = '\0';
-        parseJSON(body, "subjectId", subjectId);
-        parseJSON(body, "name", name);
+// Guards g_system: handlers that only read take it shared, mutations exclusive
+RwLock g_systemLock;
 
-        if (strlen(subjectId) == 0 || strlen(name) == 0) {
-            sendResponse(client, 400, "{\"error\":\"Validation failed: subjectId and name are required\"}");
-            return;
-        }
+// Server configuration (overridable from the command line)
+typedef struct {
+    int port;
+    int backlog;
+    int maxConnections;
+    int workers;  // 0 = one per online CPU
+    int idleTimeout;
+    int maxRequestSize;
+    int walSyncMs;
+    int walSyncBatch;
+    int walAsync;  // 1 = respond before the commit is fsynced
+    int checkpointRecords;
+    int checkpointSec;
+    int maxImportSize;  // request limit for /api/import, which takes whole files
+    int sessionTtl;     // seconds a login token stays valid
+    int logLevel;       // most verbose level written
+} ServerConfig;
 
-        // Check if subject already exists for this student
-        Subject* existing = findStudentSubject(s, subjectId);
-        if (existing != NULL) {
-            sendResponse(client, 400, "{\"error\":\"Subject already assigned to this student\"}");
-            return;
-        }
+enum { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG };
 
-        // Check capacity
-        if (s->subjectCount >= 10) {
-            sendResponse(client, 400, "{\"error\":\"Student can have maximum 10 subjects\"}");
-            return;
-        }
+ServerConfig g_config = {PORT, LISTEN_BACKLOG, MAX_CONNECTIONS, 0, IDLE_TIMEOUT, MAX_REQUEST_SIZE,
+                         WAL_SYNC_MS, WAL_SYNC_BATCH, 0, CHECKPOINT_RECORDS, CHECKPOINT_SEC, MAX_IMPORT_SIZE,
+                         SESSION_TTL_SEC, LOG_INFO};
 
-        // Parse marks and attendance
-        int mid1 = parseJSONInt(body, "mid1");
-        int mid2 = parseJSONInt(body, "mid2");
-        int final = parseJSONInt(body, "final");
-        double attendance = parseJSONNumber(body, "attendance_percent");
+// Leveled, structured logging: an event name and printf-formatted key=value
+// fields, written as one logfmt line, e.g.
+//     logInfo("student_login", "studentId=%d", id);
+// A level the runtime setting excludes costs one compare and formats
+// nothing; one above LOG_COMPILE_LEVEL compiles to nothing at all.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+#define LOG_AT(level, event, ...) \
+    do { \
+        if ((level) <= LOG_COMPILE_LEVEL && (level) <= g_config.logLevel) logWrite(level, event, __VA_ARGS__); \
+    } while (0)
+#define logError(event, ...) LOG_AT(LOG_ERROR, event, __VA_ARGS__)
+#define logWarn(event, ...) LOG_AT(LOG_WARN, event, __VA_ARGS__)
+#define logInfo(event, ...) LOG_AT(LOG_INFO, event, __VA_ARGS__)
+#define logDebug(event, ...) LOG_AT(LOG_DEBUG, event, __VA_ARGS__)
 
-        // Validation
-        if (mid1 < 0 || mid2 < 0 || final < 0 || attendance < 0.0 || attendance > 100.0) {
-            sendResponse(client, 400, "{\"error\":\"Validation failed: marks must be non-negative, attendance 0-100\"}");
+// One pending line. event must be a string literal (only the pointer is kept).
+typedef struct {
+    long long wallMillis;
+    const char* event;
+    int level;
+    char fields[LOG_FIELDS_SIZE];
+} LogRecord;
+
+// Single-producer ring owned by one thread and drained by the log writer.
+// The owner publishes head, the writer publishes tail; a full ring drops
+// the new record rather than block the owner.
+typedef struct LogRing {
+    LogRecord slots[LOG_RING_SLOTS];
+    unsigned int head;
+    unsigned int tail;
+    unsigned long long dropped;  // written by the owner, read by /metrics and the writer
+    struct LogRing* next;
+} LogRing;
+
+typedef struct {
+    Mutex lock;        // guards registration and the writer's sleep
+    CondVar wake;
+    LogRing* rings;    // every thread's ring; only ever prepended to
+    int running;       // writer started: records go through the rings
+    unsigned long long reportedDrops;
+} LogState;
+
+LogState g_log;
+
+// Append-only mutation log. Records are appended under the exclusive
+// g_systemLock, so LSN order is apply order; a flusher thread fsyncs them
+// in groups and periodically folds them into a database.json checkpoint.
+typedef struct {
+    FILE* file;
+    Mutex lock;
+    CondVar flushNeeded;
+    CondVar checkpointNeeded;
+    struct Request* committing;        // responses parked until their record is durable
+    unsigned long long nextLsn;
+    unsigned long long writtenLsn;
+    unsigned long long durableLsn;
+    unsigned long long checkpointLsn;  // last LSN folded into database.json
+    unsigned long long snapshotLsn;    // LSN the running checkpoint starts from
+    int pending;                       // records written but not yet fsynced
+    int sinceCheckpoint;
+    int checkpointRunning;
+    int oldLogPending;                 // WAL_OLD_FILE exists and is not yet covered
+    int recordOpen;                    // a streamed record (walBegin) is being written
+    int failed;                        // no segment could be kept open: mutations are refused
+    long long lastCheckpoint;
+} WriteAheadLog;
+
+#define WAL_LSN_FAILED (~0ULL)  // returned for records the failed log could not take
+
+WriteAheadLog g_wal;
+
+// Checkpoint snapshot timings, for monitoring
+typedef struct {
+    unsigned long long count;
+    unsigned long long failures;
+    long long lastDurationMs;
+    long long lastBytes;
+    long long totalDurationMs;
+} SnapshotStats;
+
+SnapshotStats g_snapshotStats;
+
+// /metrics counts each g_routes entry in its own slot, after these two
+enum { METRICS_ROUTE_OTHER, METRICS_ROUTE_OPTIONS, METRICS_ROUTE_FIRST };
+
+#define ROUTE_MAX 40         // capacity of the route table
+#define ROUTE_MAX_PARAMS 4
+#define METRICS_ROUTES (METRICS_ROUTE_FIRST + ROUTE_MAX)
+#define METRICS_STATUS_SLOTS 13  // 200 201 400 401 403 404 405 409 413 422 500 503, other
+#define LATENCY_BUCKETS 104      // 4 per doubling from 1 us (up to ~59 s)
+
+// Counters for one route, bucketed HDR-style: the bucket bounds grow
+// geometrically, so relative precision is the same at every latency
+typedef struct {
+    unsigned long long requests;
+    unsigned long long status[METRICS_STATUS_SLOTS];
+    unsigned long long latency[LATENCY_BUCKETS + 1];  // last slot: above every bound
+    unsigned long long latencyNanos;
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+} RouteMetrics;
+
+// One per worker, plus one for the WAL flusher, which finishes parked
+// commits. Each has a single writer, so recording takes no lock or atomic;
+// /metrics sums all shards and may catch one mid-update.
+typedef struct {
+    RouteMetrics routes[METRICS_ROUTES];
+    char pad[64];  // keep neighbouring shards off each other's cache lines
+} MetricsShard;
+
+MetricsShard* g_metrics;
+int g_metricsShards;
+long long g_latencyBounds[LATENCY_BUCKETS];  // upper bounds in nanoseconds
+
+// Growable byte buffer for outgoing data
+typedef struct {
+    char* data;
+    int len;
+    int cap;
+} OutBuffer;
+
+// One accepted client socket with its pending input and output
+typedef struct Connection {
+    socket_t sock;
+    char* in;
+    int inLen;
+    int inCap;
+    OutBuffer out;
+    int outSent;
+    int closeAfterWrite;
+    int busy;    // a worker is handling a request from this connection
+    int closed;  // socket closed; freed at the end of the loop pass
+    long long lastActive;
+    struct Connection* prev;
+    struct Connection* next;
+} Connection;
+
+// A path parameter; text points into the request and is not NUL-terminated
+typedef struct {
+    const char* text;
+    int len;
+    int value;  // integer parameters (:id) only
+} RouteParam;
+
+// A complete HTTP request handed to a worker, and the response it builds
+typedef struct Request {
+    Connection* conn;
+    char* data;
+    int keepAlive;
+    int route;                            // g_routes index, or ROUTE_NOT_FOUND / ROUTE_BAD_METHOD
+    RouteParam params[ROUTE_MAX_PARAMS];  // the route's path parameters, in pattern order
+    unsigned long long walLsn;  // commit the response waits on (0 = none)
+    int status;                 // HTTP status of the response, for /metrics
+    int dataLen;
+    long long received;         // nowNanos() when the request was framed
+    OutBuffer header;           // status line and headers, written by sendBody
+    const char* contentType;    // NULL = application/json
+    OutBuffer body;             // handlers build the JSON body here
+    struct Request* next;
+} Request;
+
+// FIFO of requests shared between the event loop and the workers
+typedef struct {
+    Request* head;
+    Request* tail;
+    Mutex lock;
+    CondVar ready;
+} RequestQueue;
+
+// What a route handler gets besides its Request
+typedef struct {
+    const char* method;
+    const char* query;       // the '?' starting the query string, or NULL
+    const char* request;     // raw request, for findHeader
+    const char* headerEnd;   // the blank line ending the headers, or NULL
+    const char* body;
+    JsonObject* args;        // body parsed as a JSON object
+    Caller caller;           // resolved by the authorization stage for staff routes
+    const RouteParam* params;
+} RouteContext;
+
+typedef void (*RouteHandler)(Request* client, RouteContext* ctx);
+
+enum { METHOD_GET, METHOD_POST, METHOD_PUT, METHOD_COUNT };
+enum { ROUTE_NOT_FOUND = -1, ROUTE_BAD_METHOD = -2 };
+enum { PARAM_TEXT, PARAM_INT };
+enum { ROUTE_LOCK_EXCLUSIVE, ROUTE_LOCK_SHARED, ROUTE_LOCK_HANDLER };
+
+// One endpoint. Pattern segments are literals, ":id" (a decimal integer)
+// or ":name" (any non-empty segment); the query string is not matched.
+typedef struct {
+    const char* method;
+    const char* pattern;
+    RouteHandler handler;
+    int scope;     // AUTH_SCOPE_* the authorization stage checks
+    int lock;      // ROUTE_LOCK_*: g_systemLock held around the handler, or
+                   // HANDLER: it locks for itself, around its store access only
+} Route;
+
+// Path-segment trie compiled from g_routes at startup
+typedef struct RouteNode {
+    const char* segment;         // literal text, segmentLen bytes; NULL for a parameter
+    int segmentLen;
+    int paramType;               // PARAM_* of a parameter node
+    int methods;                 // bit per METHOD_* with a route ending here
+    int routes[METHOD_COUNT];    // g_routes index per method
+    struct RouteNode* literals;  // literal children
+    struct RouteNode* param;     // parameter child, tried when no literal matches
+    struct RouteNode* next;      // next literal sibling
+} RouteNode;
+
+const Route* g_routes;
+int g_routeCount;
+RouteNode* g_routeRoot;
+
+RequestQueue g_workQueue;
+RequestQueue g_doneQueue;
+
+// Readiness multiplexer: epoll where available, select() otherwise
+typedef struct {
+    socket_t listenSock;
+    socket_t wakeRecv;  // readable when workers have finished requests
+    socket_t wakeSend;
+    int connectionCount;
+    Connection* connections;      // least recently active first
+    Connection* connectionsTail;
+    Connection* closedList;       // freed once no event can still refer to them
+#ifdef USE_EPOLL
+    int epfd;
+    int listenPaused;  // listener disarmed while at --max-connections
+#endif
+} EventLoop;
+
+EventLoop g_loop;
+
+// Function prototypes
+void initSystem();
+int loadFromFile();
+int loadDatabase(const char* path);
+void* arenaAlloc(Arena* arena, size_t size);
+int mapFile(MappedFile* m, const char* path);
+void unmapFile(MappedFile* m);
+int saveToFile(unsigned long long walLsn);
+Student* findStudent(int id);
+Teacher* findTeacher(int id);
+Teacher* findTeacherByEmail(const char* email);
+Principal* findPrincipal(int id);
+void addStudent(Student* s);
+void addTeacher(Teacher* t);
+void appendStudent(Student* s, Student** tail);
+void appendTeacher(Teacher* t, Teacher** tail);
+void idListPush(IdList* list, int id, void* record);
+void idListInsert(IdList* list, int id, void* record);
+void idListSort(IdList* list);
+int idListSeek(IdList* list, int afterId);
+Department* internDepartment(const char* name);
+Department* findDepartment(const char* name);
+void sortDepartmentLists();
+void columnsAddStudent(Student* s);
+void columnsAddSubject(Student* s, Subject* subj);
+const char* statsKernelName();
+void columnStats(const double* values, const unsigned char* select, int n, double bucketWidth, ColumnStats* st);
+void statsToJSON(OutBuffer* out, const char* key, ColumnStats* st, double bucketWidth);
+void runningAdd(RunningStats* r, double x);
+void runningRemove(RunningStats* r, double x);
+SubjectAggregate* internSubjectAggregate(const char* subjectId, const char* name);
+void aggregateRepair();
+void summaryToJSON(OutBuffer* out, const char* key, long long count, double sum, double sumSq, double min, double max);
+void rankInsert(RankIndex* index, double value, int id, Student* record);
+void rankUpdate(RankIndex* index, double oldValue, int id, double value);
+RankNode* rankSeek(RankIndex* index, double value, int id);
+RankNode* rankSelect(RankIndex* index, int rank);
+int rankCountBelow(RankIndex* index, double value, int id);
+void rankFree(RankIndex* index);
+void buildRankIndexes();
+int rankMatches(Student* s, int departmentId, int year);
+int rankTopK(RankIndex* index, int metric, Department* d, int year, int k, int descending, RankEntry* out);
+void rankEntryToJSON(OutBuffer* out, RankEntry* e, int rank);
+int parseStudentFields(const char* list);
+void studentToJSON(OutBuffer* out, Student* s, int fields);
+void teacherToJSON(OutBuffer* out, Teacher* t);
+void urlDecode(char* text);
+Student* createStudent(int id, const char* name, const char* password, const char* email, const char* department, int year);
+Teacher* createTeacher(int id, const char* name, const char* password, const char* email, const char* department);
+void setTeacherApproval(Teacher* t, int approved, const char* date);
+void setStudentAcademics(Student* s, double cgpa, double attendance);
+Subject* assignStudentSubject(Student* s, const char* subjectId, const char* name);
+Subject* addStudentSubject(Student* s, const char* subjectId);
+void setSubjectMarks(Student* s, Subject* subj, int mid1, int mid2, int final, double attendance, const char* remarks);
+int walOpen();
+int walStartFlusher();
+unsigned long long walAppend(const char* fmt, ...);
+unsigned long long walBegin();
+void walWrite(const char* data, int len);
+void walEnd(unsigned long long lsn);
+unsigned long long walLogStudent(Student* s);
+unsigned long long walLogTeacher(Teacher* t);
+unsigned long long walLogApproval(Teacher* t);
+unsigned long long walLogAcademics(Student* s);
+unsigned long long walLogSubject(Student* s, Subject* subj);
+unsigned long long walLogMarks(MarkRow* rows, int count);
+int walDeferResponse(Request* r);
+int walFailed();
+void walReplayRecord(char* line);
+int walReplayFile(const char* path);
+void walRotate();
+void checkpoint();
+int importColumn(const char* name, int len);
+int importKind(const char* name);
+void importParseObject(JsonObject* obj, ImportRow* row);
+void importApplyRow(int kind, ImportRow* row, OutBuffer* wal);
+int importRun(int kind, int format, const char* data, int len, OutBuffer* out, unsigned long long* walLsn);
+void exportRecords(int kind, int format, OutBuffer* out);
+void idIndexPut(IdIndex* idx, int key, void* value);
+void* idIndexGet(IdIndex* idx, int key);
+void strIndexPut(StrIndex* idx, const char* key, void* value);
+void* strIndexGet(StrIndex* idx, const char* key);
+int sessionInit();
+int sessionCreate(int role, int userId, int departmentId, char* token);
+int sessionLookup(const char* token, Session* out);
+void sessionRevoke(const char* token);
+void sessionRevokeUser(int role, int userId);
+int sessionFromRequest(const char* request, const char* headerEnd, Session* out);
+void sessionToJSON(OutBuffer* out, int role, int userId, int departmentId);
+int authorizeRequest(const char* request, const char* headerEnd, JsonObject* args, int studentId, int scope, Caller* caller);
+int authTeacherDepartment(int teacherId, int departmentId);
+void authInvalidate();
+int routerInit();
+int routerMatch(const char* method, const char* path, RouteParam* params);
+void handleRequest(Request* client, char* request);
+void sendResponse(Request* client, int status, const char* body);
+void sendBody(Request* client, int status);
+void sendCORSHeaders(Request* client);
+int jsonParse(JsonObject* obj, const char* text, int len);
+const char* jsonParseObject(JsonObject* obj, const char* p, const char* end);
+const char* jsonSkipSpace(const char* p, const char* end);
+const char* jsonAddField(JsonObject* obj, const char* key, int keyLen, const char* value, const char* end);
+const char* jsonMemberNext(const char* p, const char* end, const char** key, int* keyLen);
+JsonField* jsonFind(JsonObject* obj, const char* key);
+int jsonString(JsonObject* obj, const char* key, char* value, int size);
+double jsonNumber(JsonObject* obj, const char* key);
+double jsonSpanNumber(const char* text, int len);
+int jsonInt(JsonObject* obj, const char* key);
+const char* jsonEscape(const char* text, char* out, int size);
+void jsonPutKey(OutBuffer* out, const char* key);
+void jsonOpen(OutBuffer* out, const char* key, char bracket);
+void jsonClose(OutBuffer* out, char bracket);
+void jsonPutString(OutBuffer* out, const char* key, const char* value);
+void jsonPutInt(OutBuffer* out, const char* key, long long value);
+void jsonPutNumber(OutBuffer* out, const char* key, double value);
+void jsonPutRaw(OutBuffer* out, const char* key, const char* raw);
+void getCurrentTimestamp(char* buffer);
+void subjectsToJSON(Subject* subjects, int count, OutBuffer* out);
+Subject* findStudentSubject(Student* s, const char* subjectId);
+int parseOptions(int argc, char** argv);
+int netStartup();
+void netCleanup();
+socket_t createListener(int port, int backlog);
+int sockSetNonBlocking(socket_t sock);
+int sockSendv(socket_t sock, const char* a, int aLen, const char* b, int bLen);
+int eventLoopInit(EventLoop* loop, socket_t listenSock);
+void eventLoopRun(EventLoop* loop);
+void acceptConnections(EventLoop* loop);
+void readConnection(EventLoop* loop, Connection* conn);
+void processInput(EventLoop* loop, Connection* conn);
+int flushConnection(EventLoop* loop, Connection* conn);
+void closeConnection(EventLoop* loop, Connection* conn);
+void queueOutput(OutBuffer* buf, const char* data, int len);
+void bufPrintf(OutBuffer* buf, const char* fmt, ...);
+int findHeader(const char* request, const char* headerEnd, const char* name, char* value, int size);
+int requestLength(const char* buf, int len);
+int wantsKeepAlive(const char* request);
+long long nowMillis();
+long long nowNanos();
+int createWakePair(socket_t* recvSock, socket_t* sendSock);
+int startWorkers(int count);
+int cpuCount();
+void queuePush(RequestQueue* q, Request* r);
+void dispatchRequest(EventLoop* loop, Connection* conn, int frameLen);
+void completeRequests(EventLoop* loop);
+void metricsInit(int shards);
+void metricsRecord(MetricsShard* shard, Request* r, const char* method);
+void metricsWrite(OutBuffer* out);
+#if defined(__GNUC__)
+__attribute__((format(printf, 3, 4)))
+#endif
+void logWrite(int level, const char* event, const char* fmt, ...);
+int logStart();
+int logParseLevel(const char* name);
+unsigned long long logDropped();
+
+// Benchmarks include this file with SMS_NO_MAIN defined to reach the internals
+#ifndef SMS_NO_MAIN
+int main(int argc, char** argv) {
+    socket_t server_sock;
+    EventLoop* loop = &g_loop;
+
+    if (parseOptions(argc, argv) != 0) {
+        printf("Usage: %s [--port N] [--backlog N] [--max-connections N] [--workers N]\n"
+               "          [--idle-timeout SECONDS] [--max-request BYTES] [--max-import BYTES]\n"
+               "          [--wal-sync-ms N] [--wal-sync-batch N] [--wal-async]\n"
+               "          [--checkpoint-records N] [--checkpoint-sec N] [--session-ttl SECONDS]\n"
+               "          [--log-level error|warn|info|debug]\n", argv[0]);
+        return 1;
+    }
+
+    printf("=========================================\n");
+    printf("  Enhanced Student Management System\n");
+    printf("=========================================\n");
+    printf("Default Credentials:\n");
+    printf("  Admin:     password = admin123\n");
+    printf("  Principal: password = principal123\n");
+    printf("  Teacher:   password = teacher123\n");
+    printf("  Student:   password = student123\n");
+    printf("=========================================\n\n");
+
+    if (netStartup() != 0) {
+        printf("Network startup failed\n");
+        return 1;
+    }
+
+    initSystem();
+    if (routerInit() != 0) return 1;
+    if (sessionInit() != 0) {
+        printf("No source of random session tokens\n");
+        return 1;
+    }
+    if (loadFromFile() != 0) {
+        printf("Refusing to start: %s is damaged and would be overwritten\n", DATABASE_FILE);
+        return 1;
+    }
+    if (walOpen() != 0) {
+        printf("Cannot open %s\n", WAL_FILE);
+        return 1;
+    }
+
+    server_sock = createListener(g_config.port, g_config.backlog);
+    if (server_sock == SOCK_INVALID) {
+        netCleanup();
+        return 1;
+    }
+
+    if (eventLoopInit(loop, server_sock) != 0) {
+        printf("Event loop initialization failed\n");
+        sockClose(server_sock);
+        netCleanup();
+        return 1;
+    }
+
+    if (g_config.workers == 0) g_config.workers = cpuCount();
+    if (g_config.workers > MAX_WORKERS) g_config.workers = MAX_WORKERS;
+    if (logStart() != 0 || startWorkers(g_config.workers) != 0 || walStartFlusher() != 0) {
+        printf("Failed to start worker threads\n");
+        return 1;
+    }
+
+    printf("Server running on http://localhost:%d (backlog %d, max %d connections, %d workers)\n\n",
+        g_config.port, g_config.backlog, g_config.maxConnections, g_config.workers);
+
+    eventLoopRun(loop);
+
+    sockClose(server_sock);
+    netCleanup();
+    return 0;
+}
+#endif
+
+int parseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--wal-async") == 0) {
+            g_config.walAsync = 1;
+            continue;
+        }
+        if (i + 1 >= argc) return -1;
+        if (strcmp(argv[i], "--port") == 0) {
+            g_config.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--backlog") == 0) {
+            g_config.backlog = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-connections") == 0) {
+            g_config.maxConnections = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0) {
+            g_config.workers = atoi(argv[++i]);
+            if (g_config.workers <= 0) return -1;
+        } else if (strcmp(argv[i], "--idle-timeout") == 0) {
+            g_config.idleTimeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-request") == 0) {
+            g_config.maxRequestSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-import") == 0) {
+            g_config.maxImportSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--wal-sync-ms") == 0) {
+            g_config.walSyncMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--wal-sync-batch") == 0) {
+            g_config.walSyncBatch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint-records") == 0) {
+            g_config.checkpointRecords = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint-sec") == 0) {
+            g_config.checkpointSec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--session-ttl") == 0) {
+            g_config.sessionTtl = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--log-level") == 0) {
+            g_config.logLevel = logParseLevel(argv[++i]);
+            if (g_config.logLevel < 0) return -1;
+        } else {
+            return -1;
+        }
+    }
+    if (g_config.port <= 0 || g_config.port > 65535 || g_config.backlog <= 0 || g_config.maxConnections <= 0 ||
+        g_config.idleTimeout <= 0 || g_config.maxRequestSize < BUFFER_SIZE || g_config.maxImportSize < BUFFER_SIZE ||
+        g_config.walSyncMs < 0 ||
+        g_config.walSyncBatch <= 0 || g_config.checkpointRecords <= 0 || g_config.checkpointSec <= 0 ||
+        g_config.sessionTtl <= 0) {
+        return -1;
+    }
+#ifndef USE_EPOLL
+    // select() cannot watch more descriptors than FD_SETSIZE (listener and wake socket included)
+    if (g_config.maxConnections > FD_SETSIZE - 2) g_config.maxConnections = FD_SETSIZE - 2;
+#endif
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Platform socket layer
+// ---------------------------------------------------------------------------
+
+int netStartup() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) != 0 ? -1 : 0;
+#else
+    // A peer resetting the connection must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+    return 0;
+#endif
+}
+
+void netCleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// Gather write of two buffers; returns bytes sent or -1 (check SOCK_WOULD_BLOCK)
+int sockSendv(socket_t sock, const char* a, int aLen, const char* b, int bLen) {
+#ifdef _WIN32
+    WSABUF parts[2];
+    DWORD sent = 0;
+    parts[0].buf = (char*)a;
+    parts[0].len = (ULONG)aLen;
+    parts[1].buf = (char*)b;
+    parts[1].len = (ULONG)bLen;
+    return WSASend(sock, parts, bLen > 0 ? 2 : 1, &sent, 0, NULL, NULL) == 0 ? (int)sent : -1;
+#else
+    struct iovec parts[2];
+    struct msghdr msg;
+    parts[0].iov_base = (void*)a;
+    parts[0].iov_len = (size_t)aLen;
+    parts[1].iov_base = (void*)b;
+    parts[1].iov_len = (size_t)bLen;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = parts;
+    msg.msg_iovlen = bLen > 0 ? 2 : 1;
+    return (int)sendmsg(sock, &msg, SEND_FLAGS);
+#endif
+}
+
+int sockSetNonBlocking(socket_t sock) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0 ? 0 : -1;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+socket_t createListener(int port, int backlog) {
+    struct sockaddr_in server;
+    int yes = 1;
+
+    socket_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == SOCK_INVALID) {
+        logError("listen_failed", "step=socket port=%d", port);
+        return SOCK_INVALID;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = INADDR_ANY;
+    server.sin_port = htons(port);
+
+    if (bind(sock, (struct sockaddr*)&server, sizeof(server)) != 0) {
+        logError("listen_failed", "step=bind port=%d", port);
+        sockClose(sock);
+        return SOCK_INVALID;
+    }
+    if (listen(sock, backlog) != 0 || sockSetNonBlocking(sock) != 0) {
+        logError("listen_failed", "step=listen port=%d", port);
+        sockClose(sock);
+        return SOCK_INVALID;
+    }
+    return sock;
+}
+
+// Connected socket pair used by workers to wake the event loop
+int createWakePair(socket_t* recvSock, socket_t* sendSock) {
+#ifdef _WIN32
+    struct sockaddr_in addr;
+    int addrLen = sizeof(addr);
+    socket_t listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener == SOCK_INVALID) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        getsockname(listener, (struct sockaddr*)&addr, &addrLen) != 0 ||
+        listen(listener, 1) != 0) {
+        sockClose(listener);
+        return -1;
+    }
+    *sendSock = socket(AF_INET, SOCK_STREAM, 0);
+    if (*sendSock == SOCK_INVALID || connect(*sendSock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        sockClose(listener);
+        return -1;
+    }
+    *recvSock = accept(listener, NULL, NULL);
+    sockClose(listener);
+    if (*recvSock == SOCK_INVALID) return -1;
+#else
+    socket_t pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) return -1;
+    *recvSock = pair[0];
+    *sendSock = pair[1];
+#endif
+    sockSetNonBlocking(*recvSock);
+    sockSetNonBlocking(*sendSock);
+    return 0;
+}
+
+int cpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+#ifndef _WIN32
+// Atomically replaces 'to' with 'from' and makes the rename itself durable
+int fileReplace(const char* from, const char* to) {
+    if (rename(from, to) != 0) return -1;
+    int dir = open(".", O_RDONLY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    return 0;
+}
+#endif
+
+// Monotonic clock in milliseconds
+long long nowMillis() {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+// Monotonic clock in nanoseconds, for request latencies
+long long nowNanos() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (long long)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Event loop
+// ---------------------------------------------------------------------------
+
+int eventLoopInit(EventLoop* loop, socket_t listenSock) {
+    memset(loop, 0, sizeof(*loop));
+    loop->listenSock = listenSock;
+    if (createWakePair(&loop->wakeRecv, &loop->wakeSend) != 0) return -1;
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    loop->epfd = epoll_create1(0);
+    if (loop->epfd < 0) return -1;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;  // NULL marks the listening socket
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, listenSock, &ev) != 0) return -1;
+    ev.data.ptr = loop;  // the loop itself marks the wake socket
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakeRecv, &ev) != 0) return -1;
+#endif
+    return 0;
+}
+
+// Input is only read while no request from the connection is in flight;
+// pipelined bytes wait in the kernel buffer until the response is queued.
+static int connWantsRead(Connection* conn) {
+    return !conn->busy && !conn->closeAfterWrite;
+}
+
+static int connWantsWrite(Connection* conn) {
+    return conn->outSent < conn->out.len;
+}
+
+static void eventLoopWatch(EventLoop* loop, Connection* conn, int isNew) {
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    ev.events = (connWantsRead(conn) ? EPOLLIN : 0) | (connWantsWrite(conn) ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    epoll_ctl(loop->epfd, isNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, conn->sock, &ev);
+#else
+    (void)loop; (void)conn; (void)isNew;  // select() rebuilds its sets every pass
+#endif
+}
+
+// Stops or resumes watching the listener. The level-triggered listener would
+// otherwise wake epoll_wait on every pass while connections wait at the cap.
+static void eventLoopListen(EventLoop* loop, int on) {
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    if (loop->listenPaused == !on) return;
+    ev.events = on ? EPOLLIN : 0;
+    ev.data.ptr = NULL;
+    epoll_ctl(loop->epfd, EPOLL_CTL_MOD, loop->listenSock, &ev);
+    loop->listenPaused = !on;
+#else
+    (void)loop; (void)on;  // select() leaves the listener out of its set at the cap
+#endif
+}
+
+// Frees connections closed during this loop pass
+static void reapConnections(EventLoop* loop) {
+    while (loop->closedList != NULL) {
+        Connection* c = loop->closedList;
+        loop->closedList = c->next;
+        free(c);
+    }
+}
+
+// Keeps loop->connections ordered by last activity, oldest first
+static void touchConnection(EventLoop* loop, Connection* conn) {
+    conn->lastActive = nowMillis();
+    if (loop->connectionsTail == conn) return;
+    if (conn->prev) conn->prev->next = conn->next;
+    else if (loop->connections == conn) loop->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    conn->prev = loop->connectionsTail;
+    conn->next = NULL;
+    if (loop->connectionsTail) loop->connectionsTail->next = conn;
+    else loop->connections = conn;
+    loop->connectionsTail = conn;
+}
+
+// Closes connections that have sat idle past --idle-timeout
+static void sweepIdleConnections(EventLoop* loop) {
+    long long cutoff = nowMillis() - (long long)g_config.idleTimeout * 1000;
+    Connection* c = loop->connections;
+    while (c != NULL && c->lastActive < cutoff) {
+        Connection* next = c->next;
+        if (c->busy || connWantsWrite(c)) touchConnection(loop, c);
+        else closeConnection(loop, c);
+        c = next;
+    }
+}
+
+void eventLoopRun(EventLoop* loop) {
+#ifdef USE_EPOLL
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, IDLE_SWEEP_MS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            logError("event_loop_failed", "call=epoll_wait");
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            Connection* conn = (Connection*)events[i].data.ptr;
+            if (conn == NULL) {
+                acceptConnections(loop);
+                continue;
+            }
+            if (events[i].data.ptr == loop) {
+                completeRequests(loop);
+                continue;
+            }
+            if (conn->closed) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(loop, conn);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flushConnection(loop, conn);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                readConnection(loop, conn);
+            }
+        }
+        sweepIdleConnections(loop);
+        reapConnections(loop);
+    }
+#else
+    fd_set readSet, writeSet;
+    for (;;) {
+        struct timeval tv;
+        socket_t maxSock = loop->listenSock > loop->wakeRecv ? loop->listenSock : loop->wakeRecv;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        FD_SET(loop->wakeRecv, &readSet);
+        if (loop->connectionCount < g_config.maxConnections) {
+            FD_SET(loop->listenSock, &readSet);
+        }
+        for (Connection* c = loop->connections; c != NULL; c = c->next) {
+            if (connWantsWrite(c)) FD_SET(c->sock, &writeSet);
+            else if (connWantsRead(c)) FD_SET(c->sock, &readSet);
+            if (c->sock > maxSock) maxSock = c->sock;
+        }
+        tv.tv_sec = IDLE_SWEEP_MS / 1000;
+        tv.tv_usec = (IDLE_SWEEP_MS % 1000) * 1000;
+        if (select((int)maxSock + 1, &readSet, &writeSet, NULL, &tv) < 0) {
+#ifndef _WIN32
+            if (errno == EINTR) continue;
+#endif
+            logError("event_loop_failed", "call=select");
+            return;
+        }
+        // Snapshot the ready connections first: handlers reorder and free list entries
+        Connection* ready[FD_SETSIZE];
+        int readyCount = 0;
+        for (Connection* c = loop->connections; c != NULL && readyCount < FD_SETSIZE; c = c->next) {
+            if (FD_ISSET(c->sock, &writeSet) || FD_ISSET(c->sock, &readSet)) ready[readyCount++] = c;
+        }
+        for (int i = 0; i < readyCount; i++) {
+            Connection* c = ready[i];
+            if (c->closed) continue;
+            if (FD_ISSET(c->sock, &writeSet)) flushConnection(loop, c);
+            else readConnection(loop, c);
+        }
+        if (FD_ISSET(loop->wakeRecv, &readSet)) {
+            completeRequests(loop);
+        }
+        if (FD_ISSET(loop->listenSock, &readSet)) {
+            acceptConnections(loop);
+        }
+        sweepIdleConnections(loop);
+        reapConnections(loop);
+    }
+#endif
+}
+
+void acceptConnections(EventLoop* loop) {
+    struct sockaddr_in client;
+    for (;;) {
+#ifdef _WIN32
+        int c = sizeof(client);
+#else
+        socklen_t c = sizeof(client);
+#endif
+        if (loop->connectionCount >= g_config.maxConnections) {
+            eventLoopListen(loop, 0);
             return;
         }
+        socket_t sock = accept(loop->listenSock, (struct sockaddr*)&client, &c);
+        if (sock == SOCK_INVALID) return;  // drained (or transient error)
+
+        int yes = 1;
+        sockSetNonBlocking(sock);
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+
+        Connection* conn = (Connection*)calloc(1, sizeof(Connection));
+        conn->sock = sock;
+        conn->inCap = BUFFER_SIZE;
+        conn->in = (char*)malloc(conn->inCap);
+        loop->connectionCount++;
+        touchConnection(loop, conn);
+        eventLoopWatch(loop, conn, 1);
+    }
+}
+
+// Case-insensitive lookup of a header value within the request head.
+// Returns 1 and copies the trimmed value when the header is present.
+int findHeader(const char* request, const char* headerEnd, const char* name, char* value, int size) {
+    int nameLen = (int)strlen(name);
+    const char* line = strstr(request, "\r\n");
+    while (line != NULL && line < headerEnd) {
+        line += 2;
+        if (strncasecmp(line, name, nameLen) == 0 && line[nameLen] == ':') {
+            const char* v = line + nameLen + 1;
+            while (*v == ' ' || *v == '\t') v++;
+            int len = 0;
+            while (v[len] != '\r' && v[len] != '\0' && len < size - 1) len++;
+            memcpy(value, v, len);
+            value[len] = '\0';
+            return 1;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return 0;
+}
+
+// Frames the first request in buf on the header block and Content-Length.
+// Returns its total length, 0 while incomplete, or -1 if it can never fit.
+int requestLength(const char* buf, int len) {
+    const char* headerEnd = strstr(buf, "\r\n\r\n");
+    if (!headerEnd) return len >= g_config.maxRequestSize ? -1 : 0;
+    int headerLen = (int)(headerEnd - buf) + 4;
+    char value[32];
+    long contentLen = 0;
+    if (findHeader(buf, headerEnd, "Content-Length", value, sizeof(value))) {
+        contentLen = atol(value);
+    }
+    long limit = strncmp(buf, "POST /api/import/", 17) == 0 ? g_config.maxImportSize : g_config.maxRequestSize;
+    if (contentLen < 0 || headerLen + contentLen > limit) return -1;
+    return len >= headerLen + contentLen ? headerLen + (int)contentLen : 0;
+}
+
+// HTTP/1.1 keeps the connection open unless the client opts out; 1.0 the reverse
+int wantsKeepAlive(const char* request) {
+    const char* headerEnd = strstr(request, "\r\n\r\n");
+    const char* lineEnd = strstr(request, "\r\n");
+    char value[32];
+    int http11 = lineEnd != NULL && lineEnd - request >= 8 && strncmp(lineEnd - 8, "HTTP/1.1", 8) == 0;
+    if (headerEnd && findHeader(request, headerEnd, "Connection", value, sizeof(value))) {
+        if (strncasecmp(value, "close", 5) == 0) return 0;
+        if (strncasecmp(value, "keep-alive", 10) == 0) return 1;
+    }
+    return http11;
+}
+
+void readConnection(EventLoop* loop, Connection* conn) {
+    for (;;) {
+        if (conn->inLen >= conn->inCap - 1) {
+            int limit = g_config.maxImportSize > g_config.maxRequestSize ? g_config.maxImportSize : g_config.maxRequestSize;
+            if (conn->inCap >= limit + BUFFER_SIZE) break;  // frame check rejects it
+            conn->inCap *= 2;
+            conn->in = (char*)realloc(conn->in, conn->inCap);
+        }
+        int size = recv(conn->sock, conn->in + conn->inLen, conn->inCap - 1 - conn->inLen, 0);
+        if (size > 0) {
+            conn->inLen += size;
+            continue;
+        }
+        if (size < 0 && SOCK_WOULD_BLOCK()) break;
+        closeConnection(loop, conn);  // orderly shutdown or hard error
+        return;
+    }
+    touchConnection(loop, conn);
+    processInput(loop, conn);
+}
+
+// Dispatches the next buffered request, if one is complete and none is in flight
+void processInput(EventLoop* loop, Connection* conn) {
+    if (conn->busy || conn->closeAfterWrite) return;
+    conn->in[conn->inLen] = '\0';
+    int frameLen = requestLength(conn->in, conn->inLen);
+    if (frameLen < 0) {
+        static const char tooLarge[] =
+            "HTTP/1.1 413 Payload Too Large\r\n"
+            "Content-Type: application/json\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "Connection: close\r\n"
+            "Content-Length: 29\r\n"
+            "\r\n{\"error\":\"Request too large\"}";
+        queueOutput(&conn->out, tooLarge, (int)sizeof(tooLarge) - 1);
+        conn->closeAfterWrite = 1;
+        flushConnection(loop, conn);
+        return;
+    }
+    if (frameLen == 0) return;
+    dispatchRequest(loop, conn, frameLen);
+}
+
+// Hands one framed request to the worker pool and keeps any pipelined remainder
+void dispatchRequest(EventLoop* loop, Connection* conn, int frameLen) {
+    Request* r = (Request*)calloc(1, sizeof(Request));
+    r->conn = conn;
+    r->data = (char*)malloc(frameLen + 1);
+    memcpy(r->data, conn->in, frameLen);
+    r->data[frameLen] = '\0';
+    r->dataLen = frameLen;
+    r->received = nowNanos();
+    r->keepAlive = wantsKeepAlive(r->data);
+
+    conn->inLen -= frameLen;
+    memmove(conn->in, conn->in + frameLen, conn->inLen);
+    conn->busy = 1;
+    eventLoopWatch(loop, conn, 0);
+    queuePush(&g_workQueue, r);
+}
+
+// Moves finished responses from the workers onto their connections
+void completeRequests(EventLoop* loop) {
+    char drain[256];
+    while (recv(loop->wakeRecv, drain, sizeof(drain), 0) > 0) {}
+
+    mutexLock(&g_doneQueue.lock);
+    Request* r = g_doneQueue.head;
+    g_doneQueue.head = g_doneQueue.tail = NULL;
+    mutexUnlock(&g_doneQueue.lock);
+
+    while (r != NULL) {
+        Request* next = r->next;
+        Connection* conn = r->conn;
+        conn->busy = 0;
+        if (conn->closed) {
+            conn->next = loop->closedList;  // client went away while the worker was busy
+            loop->closedList = conn;
+        } else {
+            if (!r->keepAlive) conn->closeAfterWrite = 1;
+            touchConnection(loop, conn);
+            // With nothing queued ahead, send header and body straight from the
+            // request's buffers; only what the socket does not take is copied
+            int sent = 0;
+            if (conn->out.len == 0) {
+                sent = sockSendv(conn->sock, r->header.data, r->header.len, r->body.data, r->body.len);
+                if (sent < 0 && !SOCK_WOULD_BLOCK()) {
+                    closeConnection(loop, conn);
+                } else if (sent < 0) {
+                    sent = 0;
+                }
+            }
+            if (sent >= 0) {
+                if (sent < r->header.len) {
+                    queueOutput(&conn->out, r->header.data + sent, r->header.len - sent);
+                    sent = 0;
+                } else {
+                    sent -= r->header.len;
+                }
+                queueOutput(&conn->out, r->body.data + sent, r->body.len - sent);
+                if (flushConnection(loop, conn) == 0) {
+                    processInput(loop, conn);  // next pipelined request, if any
+                }
+            }
+        }
+        free(r->header.data);
+        free(r->body.data);
+        free(r->data);
+        free(r);
+        r = next;
+    }
+}
+
+// Returns -1 if the connection was closed (and freed), 0 otherwise
+int flushConnection(EventLoop* loop, Connection* conn) {
+    while (conn->outSent < conn->out.len) {
+        int sent = send(conn->sock, conn->out.data + conn->outSent, conn->out.len - conn->outSent, SEND_FLAGS);
+        if (sent > 0) {
+            conn->outSent += sent;
+            continue;
+        }
+        if (sent < 0 && SOCK_WOULD_BLOCK()) {
+            eventLoopWatch(loop, conn, 0);
+            return 0;
+        }
+        closeConnection(loop, conn);
+        return -1;
+    }
+    conn->out.len = conn->outSent = 0;
+    if (conn->closeAfterWrite) {
+        closeConnection(loop, conn);
+        return -1;
+    }
+    eventLoopWatch(loop, conn, 0);
+    return 0;
+}
+
+void closeConnection(EventLoop* loop, Connection* conn) {
+#ifdef USE_EPOLL
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->sock, NULL);
+#endif
+    if (conn->prev) conn->prev->next = conn->next;
+    else loop->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    else loop->connectionsTail = conn->prev;
+    sockClose(conn->sock);
+    loop->connectionCount--;
+    if (loop->connectionCount < g_config.maxConnections) eventLoopListen(loop, 1);
+    free(conn->in);
+    free(conn->out.data);
+    conn->in = NULL;
+    conn->out.data = NULL;
+    conn->closed = 1;
+    if (conn->busy) return;  // completeRequests retires it when the worker hands back
+    conn->next = loop->closedList;
+    loop->closedList = conn;
+}
+
+// Appends raw bytes to a growable output buffer
+void queueOutput(OutBuffer* buf, const char* data, int len) {
+    if (len <= 0) return;
+    if (buf->len + len > buf->cap) {
+        int cap = buf->cap ? buf->cap : BUFFER_SIZE;
+        while (cap < buf->len + len) cap *= 2;
+        buf->data = (char*)realloc(buf->data, cap);
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+// printf-style append to a growable output buffer
+void bufPrintf(OutBuffer* buf, const char* fmt, ...) {
+    char local[1024];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(local, sizeof(local), fmt, args);
+    va_end(args);
+    if (len < (int)sizeof(local)) {
+        queueOutput(buf, local, len);
+        return;
+    }
+    char* big = (char*)malloc(len + 1);
+    va_start(args, fmt);
+    vsnprintf(big, len + 1, fmt, args);
+    va_end(args);
+    queueOutput(buf, big, len);
+    free(big);
+}
+
+// ---------------------------------------------------------------------------
+// Metrics
+// ---------------------------------------------------------------------------
+
+static const int g_statusCodes[METRICS_STATUS_SLOTS - 1] = {200, 201, 400, 401, 403, 404, 405, 409, 413, 422, 500, 503};
+
+void metricsInit(int shards) {
+    g_metrics = (MetricsShard*)calloc(shards, sizeof(MetricsShard));
+    g_metricsShards = shards;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        g_latencyBounds[i] = (1000LL << (i / 4)) * (4 + i % 4) / 4;
+    }
+}
+
+static int metricsStatusSlot(int status) {
+    for (int i = 0; i < METRICS_STATUS_SLOTS - 1; i++) {
+        if (g_statusCodes[i] == status) return i;
+    }
+    return METRICS_STATUS_SLOTS - 1;
+}
+
+// First bucket whose bound covers nanos (binary search over the bounds)
+static int latencyBucket(long long nanos) {
+    int lo = 0, hi = LATENCY_BUCKETS;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g_latencyBounds[mid] < nanos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Counts a finished request on the calling thread's shard. Latency runs
+// from framing to a ready response: queueing, lock and WAL commit waits
+// included, the socket write excluded.
+void metricsRecord(MetricsShard* shard, Request* r, const char* method) {
+    long long nanos = nowNanos() - r->received;
+    int slot = METRICS_ROUTE_OTHER;
+    if (strcmp(method, "OPTIONS") == 0) slot = METRICS_ROUTE_OPTIONS;
+    else if (r->route >= 0) slot = METRICS_ROUTE_FIRST + r->route;
+    RouteMetrics* m = &shard->routes[slot];
+    m->requests++;
+    m->status[metricsStatusSlot(r->status)]++;
+    m->latency[latencyBucket(nanos)]++;
+    m->latencyNanos += (unsigned long long)nanos;
+    m->bytesIn += (unsigned long long)r->dataLen;
+    m->bytesOut += (unsigned long long)(r->header.len + r->body.len);
+}
+
+static void metricsLabels(OutBuffer* out, const char* name, int route) {
+    const char* method = route == METRICS_ROUTE_OPTIONS ? "OPTIONS" : "*";
+    const char* path = route == METRICS_ROUTE_OPTIONS ? "*" : "other";
+    if (route >= METRICS_ROUTE_FIRST) {
+        method = g_routes[route - METRICS_ROUTE_FIRST].method;
+        path = g_routes[route - METRICS_ROUTE_FIRST].pattern;
+    }
+    bufPrintf(out, "%s{method=\"%s\",route=\"%s\"", name, method, path);
+}
+
+// Text exposition format (version 0.0.4). Routes that have served nothing
+// are left out. Store sizes are read under the caller's shared g_systemLock.
+void metricsWrite(OutBuffer* out) {
+    RouteMetrics totals[METRICS_ROUTES];
+    int routes = METRICS_ROUTE_FIRST + g_routeCount;
+    memset(totals, 0, sizeof(totals));
+    for (int s = 0; s < g_metricsShards; s++) {
+        for (int route = 0; route < routes; route++) {
+            RouteMetrics* m = &g_metrics[s].routes[route];
+            RouteMetrics* t = &totals[route];
+            t->requests += m->requests;
+            for (int i = 0; i < METRICS_STATUS_SLOTS; i++) t->status[i] += m->status[i];
+            for (int i = 0; i <= LATENCY_BUCKETS; i++) t->latency[i] += m->latency[i];
+            t->latencyNanos += m->latencyNanos;
+            t->bytesIn += m->bytesIn;
+            t->bytesOut += m->bytesOut;
+        }
+    }
+
+    bufPrintf(out, "# HELP sms_http_requests_total Requests served, by route and status code.\n");
+    bufPrintf(out, "# TYPE sms_http_requests_total counter\n");
+    for (int route = 0; route < routes; route++) {
+        for (int i = 0; i < METRICS_STATUS_SLOTS; i++) {
+            if (totals[route].status[i] == 0) continue;
+            metricsLabels(out, "sms_http_requests_total", route);
+            if (i < METRICS_STATUS_SLOTS - 1) bufPrintf(out, ",code=\"%d\"} %llu\n", g_statusCodes[i], totals[route].status[i]);
+            else bufPrintf(out, ",code=\"other\"} %llu\n", totals[route].status[i]);
+        }
+    }
+
+    bufPrintf(out, "# HELP sms_http_request_duration_seconds Time from a request being framed to its response being ready.\n");
+    bufPrintf(out, "# TYPE sms_http_request_duration_seconds histogram\n");
+    for (int route = 0; route < routes; route++) {
+        RouteMetrics* t = &totals[route];
+        if (t->requests == 0) continue;
+        unsigned long long cumulative = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            cumulative += t->latency[i];
+            metricsLabels(out, "sms_http_request_duration_seconds_bucket", route);
+            bufPrintf(out, ",le=\"%g\"} %llu\n", g_latencyBounds[i] / 1e9, cumulative);
+        }
+        metricsLabels(out, "sms_http_request_duration_seconds_bucket", route);
+        bufPrintf(out, ",le=\"+Inf\"} %llu\n", cumulative + t->latency[LATENCY_BUCKETS]);
+        metricsLabels(out, "sms_http_request_duration_seconds_sum", route);
+        bufPrintf(out, "} %.9f\n", t->latencyNanos / 1e9);
+        metricsLabels(out, "sms_http_request_duration_seconds_count", route);
+        bufPrintf(out, "} %llu\n", cumulative + t->latency[LATENCY_BUCKETS]);
+    }
+
+    bufPrintf(out, "# HELP sms_http_request_bytes_total Request bytes received, headers included.\n");
+    bufPrintf(out, "# TYPE sms_http_request_bytes_total counter\n");
+    for (int route = 0; route < routes; route++) {
+        if (totals[route].requests == 0) continue;
+        metricsLabels(out, "sms_http_request_bytes_total", route);
+        bufPrintf(out, "} %llu\n", totals[route].bytesIn);
+    }
+    bufPrintf(out, "# HELP sms_http_response_bytes_total Response bytes sent, headers included.\n");
+    bufPrintf(out, "# TYPE sms_http_response_bytes_total counter\n");
+    for (int route = 0; route < routes; route++) {
+        if (totals[route].requests == 0) continue;
+        metricsLabels(out, "sms_http_response_bytes_total", route);
+        bufPrintf(out, "} %llu\n", totals[route].bytesOut);
+    }
+
+    bufPrintf(out, "# HELP sms_snapshot_duration_seconds saveToFile checkpoint durations.\n");
+    bufPrintf(out, "# TYPE sms_snapshot_duration_seconds summary\n");
+    bufPrintf(out, "sms_snapshot_duration_seconds_sum %.3f\n", g_snapshotStats.totalDurationMs / 1e3);
+    bufPrintf(out, "sms_snapshot_duration_seconds_count %llu\n", g_snapshotStats.count);
+    bufPrintf(out, "# HELP sms_snapshot_last_duration_seconds Duration of the latest successful checkpoint.\n");
+    bufPrintf(out, "# TYPE sms_snapshot_last_duration_seconds gauge\n");
+    bufPrintf(out, "sms_snapshot_last_duration_seconds %.3f\n", g_snapshotStats.lastDurationMs / 1e3);
+    bufPrintf(out, "# HELP sms_snapshot_last_bytes Size of the latest successful checkpoint.\n");
+    bufPrintf(out, "# TYPE sms_snapshot_last_bytes gauge\n");
+    bufPrintf(out, "sms_snapshot_last_bytes %lld\n", g_snapshotStats.lastBytes);
+    bufPrintf(out, "# HELP sms_snapshot_failures_total Checkpoints that could not be written.\n");
+    bufPrintf(out, "# TYPE sms_snapshot_failures_total counter\n");
+    bufPrintf(out, "sms_snapshot_failures_total %llu\n", g_snapshotStats.failures);
+
+    bufPrintf(out, "# HELP sms_store_records Records in the in-memory store.\n");
+    bufPrintf(out, "# TYPE sms_store_records gauge\n");
+    bufPrintf(out, "sms_store_records{kind=\"students\"} %d\n", g_studentIndex.count);
+    bufPrintf(out, "sms_store_records{kind=\"teachers\"} %d\n", g_teacherIndex.count);
+    bufPrintf(out, "sms_store_records{kind=\"subjects\"} %d\n", g_subjectColumns.count);
+    bufPrintf(out, "# HELP sms_open_connections Client connections currently open.\n");
+    bufPrintf(out, "# TYPE sms_open_connections gauge\n");
+    bufPrintf(out, "sms_open_connections %d\n", g_loop.connectionCount);
+    bufPrintf(out, "# HELP sms_log_dropped_total Log records dropped because a thread's ring was full.\n");
+    bufPrintf(out, "# TYPE sms_log_dropped_total counter\n");
+    bufPrintf(out, "sms_log_dropped_total %llu\n", logDropped());
+}
+
+// ---------------------------------------------------------------------------
+// Logging
+// ---------------------------------------------------------------------------
+
+static const char* g_logLevelNames[] = {"error", "warn", "info", "debug"};
+
+static THREAD_LOCAL LogRing* t_logRing;  // the calling thread's ring, once it has logged
+
+int logParseLevel(const char* name) {
+    for (int i = LOG_ERROR; i <= LOG_DEBUG; i++) {
+        if (strcmp(name, g_logLevelNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static long long logWallMillis() {
+#ifdef _WIN32
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    long long ticks = ((long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (ticks - 116444736000000000LL) / 10000;  // 100 ns ticks since 1601
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+// Appends "ts=... level=... event=... fields\n"
+static void logFormat(OutBuffer* out, const LogRecord* r) {
+    time_t seconds = (time_t)(r->wallMillis / 1000);
+    struct tm t;
+#ifdef _WIN32
+    localtime_s(&t, &seconds);
+#else
+    localtime_r(&seconds, &t);
+#endif
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &t);
+    bufPrintf(out, "ts=%s.%03d level=%s event=%s%s%s\n", stamp, (int)(r->wallMillis % 1000),
+              g_logLevelNames[r->level], r->event, r->fields[0] ? " " : "", r->fields);
+}
+
+static LogRing* logRegister() {
+    LogRing* ring = (LogRing*)calloc(1, sizeof(LogRing));
+    mutexLock(&g_log.lock);
+    ring->next = g_log.rings;
+    g_log.rings = ring;
+    mutexUnlock(&g_log.lock);
+    return ring;
+}
+
+// Called through the level macros. Until the writer runs (startup, the
+// benchmarks), and for errors always, the line is written straight away.
+void logWrite(int level, const char* event, const char* fmt, ...) {
+    LogRecord local;
+    LogRing* ring = NULL;
+    LogRecord* r = &local;
+    unsigned int head = 0;
+    if (g_log.running && level != LOG_ERROR) {
+        ring = t_logRing ? t_logRing : (t_logRing = logRegister());
+        head = ring->head;
+        if (head - atomicLoadAcquire(&ring->tail) == LOG_RING_SLOTS) {
+            atomicStoreRelease(&ring->dropped, ring->dropped + 1);  // only the owner writes it
+            return;
+        }
+        r = &ring->slots[head % LOG_RING_SLOTS];
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(r->fields, sizeof(r->fields), fmt, args);
+    va_end(args);
+    r->wallMillis = logWallMillis();
+    r->event = event;
+    r->level = level;
+
+    if (ring) {
+        atomicStoreRelease(&ring->head, head + 1);
+        return;
+    }
+    OutBuffer line = {0};
+    logFormat(&line, r);
+    fwrite(line.data, 1, line.len, stdout);
+    fflush(stdout);
+    free(line.data);
+}
+
+unsigned long long logDropped() {
+    unsigned long long dropped = 0;
+    if (!g_log.running) return 0;
+    mutexLock(&g_log.lock);
+    LogRing* rings = g_log.rings;
+    mutexUnlock(&g_log.lock);
+    for (LogRing* ring = rings; ring; ring = ring->next) dropped += atomicLoadAcquire(&ring->dropped);
+    return dropped;
+}
+
+// Drains every ring in turn, so lines from different threads can be up to
+// one flush interval out of order; their timestamps are exact.
+static THREAD_RETURN logWriterMain(void* arg) {
+    (void)arg;
+    OutBuffer out = {0};
+    for (;;) {
+        mutexLock(&g_log.lock);
+        condWaitMs(&g_log.wake, &g_log.lock, LOG_FLUSH_MS);
+        LogRing* rings = g_log.rings;
+        mutexUnlock(&g_log.lock);
+
+        for (LogRing* ring = rings; ring; ring = ring->next) {
+            unsigned int tail = ring->tail;
+            unsigned int head = atomicLoadAcquire(&ring->head);
+            for (; tail != head; tail++) logFormat(&out, &ring->slots[tail % LOG_RING_SLOTS]);
+            atomicStoreRelease(&ring->tail, tail);
+        }
+        unsigned long long dropped = logDropped();
+        if (dropped != g_log.reportedDrops) {
+            LogRecord r = {logWallMillis(), "log_dropped", LOG_WARN, ""};
+            snprintf(r.fields, sizeof(r.fields), "count=%llu", dropped - g_log.reportedDrops);
+            logFormat(&out, &r);
+            g_log.reportedDrops = dropped;
+        }
+        if (out.len > 0) {
+            fwrite(out.data, 1, out.len, stdout);
+            fflush(stdout);
+            out.len = 0;
+        }
+    }
+    return 0;
+}
+
+// Switches logging from direct writes to the per-thread rings
+int logStart() {
+    mutexInit(&g_log.lock);
+    condInit(&g_log.wake);
+    g_log.running = 1;  // set first, so the writer sees it too
+#ifdef _WIN32
+    HANDLE h = CreateThread(NULL, 0, logWriterMain, NULL, 0, NULL);
+    if (h != NULL) {
+        CloseHandle(h);
+        return 0;
+    }
+#else
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, logWriterMain, NULL) == 0) {
+        pthread_detach(tid);
+        return 0;
+    }
+#endif
+    g_log.running = 0;
+    return -1;
+}
+
+// ---------------------------------------------------------------------------
+// Worker pool
+// ---------------------------------------------------------------------------
+
+void queuePush(RequestQueue* q, Request* r) {
+    r->next = NULL;
+    mutexLock(&q->lock);
+    if (q->tail) q->tail->next = r;
+    else q->head = r;
+    q->tail = r;
+    condSignal(&q->ready);
+    mutexUnlock(&q->lock);
+}
+
+// Counts a finished request and hands it back to the event loop
+static void requestFinish(MetricsShard* metrics, Request* r) {
+    char method[10] = "";
+    sscanf(r->data, "%9s", method);
+    metricsRecord(metrics, r, method);
+    queuePush(&g_doneQueue, r);
+    send(g_loop.wakeSend, "x", 1, SEND_FLAGS);  // full pipe still means a wake is pending
+}
+
+static THREAD_RETURN workerMain(void* arg) {
+    MetricsShard* metrics = (MetricsShard*)arg;
+    for (;;) {
+        mutexLock(&g_workQueue.lock);
+        while (g_workQueue.head == NULL) condWait(&g_workQueue.ready, &g_workQueue.lock);
+        Request* r = g_workQueue.head;
+        g_workQueue.head = r->next;
+        if (g_workQueue.head == NULL) g_workQueue.tail = NULL;
+        mutexUnlock(&g_workQueue.lock);
+
+        // Route once here: the match picks the lock, and its parameters point into r->data
+        char method[10] = "";
+        sscanf(r->data, "%9s", method);
+        const char* target = strchr(r->data, ' ');
+        r->route = routerMatch(method, target ? target + 1 : "", r->params);
+        int lock = r->route >= 0 ? g_routes[r->route].lock : ROUTE_LOCK_SHARED;
+        if (lock == ROUTE_LOCK_HANDLER) {
+            handleRequest(r, r->data);
+        } else if (lock == ROUTE_LOCK_SHARED) {
+            rwlockReadLock(&g_systemLock);
+            handleRequest(r, r->data);
+            rwlockReadUnlock(&g_systemLock);
+        } else {
+            rwlockWriteLock(&g_systemLock);
+            handleRequest(r, r->data);
+            rwlockWriteUnlock(&g_systemLock);
+        }
+        // A write's response waits for its fsync on the flusher, not here,
+        // so reads are not stuck behind a group commit
+        if (r->walLsn && !g_config.walAsync && walDeferResponse(r)) continue;
+        requestFinish(metrics, r);
+    }
+    return 0;
+}
+
+int startWorkers(int count) {
+    mutexInit(&g_workQueue.lock);
+    condInit(&g_workQueue.ready);
+    mutexInit(&g_doneQueue.lock);
+    condInit(&g_doneQueue.ready);
+    metricsInit(count + 1);  // the last shard is the WAL flusher's
+
+    for (int i = 0; i < count; i++) {
+#ifdef _WIN32
+        HANDLE h = CreateThread(NULL, 0, workerMain, &g_metrics[i], 0, NULL);
+        if (h == NULL) return -1;
+        CloseHandle(h);
+#else
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, workerMain, &g_metrics[i]) != 0) return -1;
+        pthread_detach(tid);
+#endif
+    }
+    return 0;
+}
+
+void initSystem() {
+#ifdef _WIN32
+    rwlockInit(&g_systemLock);
+#else
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    // Default glibc rwlocks prefer readers; keep writers from starving under read load
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&g_systemLock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+#endif
+    mutexInit(&g_aggregateRepairLock);
+    g_system.students = NULL;
+    g_system.teachers = NULL;
+    g_system.principals = NULL;
+    g_system.nextStudentId = 1001;
+    g_system.nextTeacherId = 2001;
+    g_system.nextPrincipalId = 3001;
+}
+
+// ---------------------------------------------------------------------------
+// Route handlers
+// ---------------------------------------------------------------------------
+
+// Copies a text parameter, truncated to size - 1 bytes
+static void routeParamCopy(const RouteParam* param, char* out, int size) {
+    int len = param->len < size - 1 ? param->len : size - 1;
+    memcpy(out, param->text, len);
+    out[len] = '\0';
+}
+
+// Prometheus scrape
+static void handleMetrics(Request* client, RouteContext* ctx) {
+    (void)ctx;
+    metricsWrite(&client->body);
+    client->contentType = "text/plain; version=0.0.4";
+    sendBody(client, 200);
+}
+
+// Admin login
+static void handleAdminLogin(Request* client, RouteContext* ctx) {
+    char password[100];
+    jsonString(ctx->args, "password", password, sizeof(password));
+    if (strcmp(password, ADMIN_PASSWORD) == 0) {
+        OutBuffer* out = &client->body;
+        jsonOpen(out, NULL, '{');
+        jsonPutRaw(out, "success", "true");
+        jsonPutString(out, "role", "admin");
+        jsonPutString(out, "message", "Admin login successful");
+        sessionToJSON(out, ROLE_ADMIN, 0, -1);
+        jsonClose(out, '}');
+        sendBody(client, 200);
+        logInfo("login", "role=admin");
+    } else {
+        sendResponse(client, 401, "{\"error\":\"Invalid admin password\"}");
+    }
+}
+
+// Principal login
+static void handlePrincipalLogin(Request* client, RouteContext* ctx) {
+    char password[100];
+    jsonString(ctx->args, "password", password, sizeof(password));
+    if (strcmp(password, PRINCIPAL_PASSWORD) == 0) {
+        OutBuffer* out = &client->body;
+        jsonOpen(out, NULL, '{');
+        jsonPutRaw(out, "success", "true");
+        jsonPutString(out, "role", "principal");
+        jsonPutInt(out, "principalId", 3001);
+        jsonPutString(out, "message", "Principal login successful");
+        sessionToJSON(out, ROLE_PRINCIPAL, 3001, -1);
+        jsonClose(out, '}');
+        sendBody(client, 200);
+        logInfo("login", "role=principal");
+    } else {
+        sendResponse(client, 401, "{\"error\":\"Invalid principal password\"}");
+    }
+}
+
+// Teacher login
+static void handleTeacherLogin(Request* client, RouteContext* ctx) {
+    char email[120], password[100];
+    jsonString(ctx->args, "email", email, sizeof(email));
+    jsonString(ctx->args, "password", password, sizeof(password));
+
+    Teacher* teacher = findTeacherByEmail(email);
+    if (teacher && strcmp(teacher->password, password) == 0) {
+        if (teacher->approved == 0) {
+            sendResponse(client, 403, "{\"error\":\"Your account is pending principal approval\"}");
+        } else if (teacher->approved == -1) {
+            sendResponse(client, 403, "{\"error\":\"Your account has been rejected\"}");
+        } else {
+            OutBuffer* out = &client->body;
+            jsonOpen(out, NULL, '{');
+            jsonPutRaw(out, "success", "true");
+            jsonPutString(out, "role", "teacher");
+            jsonPutInt(out, "teacherId", teacher->teacherId);
+            jsonPutString(out, "name", teacher->name);
+            jsonPutString(out, "email", teacher->email);
+            jsonPutString(out, "department", teacher->department);
+            jsonPutInt(out, "approved", teacher->approved);
+            sessionToJSON(out, ROLE_TEACHER, teacher->teacherId, teacher->departmentId);
+            jsonClose(out, '}');
+            sendBody(client, 200);
+            logInfo("login", "role=teacher teacherId=%d", teacher->teacherId);
+        }
+    } else {
+        sendResponse(client, 401, "{\"error\":\"Invalid email or password\"}");
+    }
+}
+
+// Get teacher by ID
+static void handleGetTeacher(Request* client, RouteContext* ctx) {
+    Teacher* t = findTeacher(ctx->params[0].value);
+    if (!t) {
+        sendResponse(client, 404, "{\"error\":\"Teacher not found\"}");
+        return;
+    }
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutInt(out, "teacherId", t->teacherId);
+    jsonPutString(out, "name", t->name);
+    jsonPutString(out, "email", t->email);
+    jsonPutString(out, "department", t->department);
+    jsonPutInt(out, "approved", t->approved);
+    jsonClose(out, '}');
+    sendBody(client, 200);
+}
+
+// Get teachers list (Principal can filter by department)
+static void handleListTeachers(Request* client, RouteContext* ctx) {
+    char department[80] = "";
+    char principalPassword[100] = "";
+    
+    // Parse query string or body
+    const char* query = ctx->query;
+    if (query != NULL) {
+        char queryBuf[256];
+        strncpy(queryBuf, query + 1, sizeof(queryBuf) - 1);
+        queryBuf[sizeof(queryBuf) - 1] = '\0';
+        urlDecode(queryBuf);
+        if (strncmp(queryBuf, "department=", 11) == 0) {
+            snprintf(department, sizeof(department), "%.*s", (int)sizeof(department) - 1, queryBuf + 11);
+        }
+    }
+    
+    // Also try parsing from JSON body
+    jsonString(ctx->args, "department", department, sizeof(department));
+    jsonString(ctx->args, "principalPassword", principalPassword, sizeof(principalPassword));
+
+    // Optional: verify principal auth
+    if (strlen(principalPassword) > 0 && strcmp(principalPassword, PRINCIPAL_PASSWORD) != 0) {
+        sendResponse(client, 401, "{\"error\":\"Unauthorized\"}");
+        return;
+    }
+
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '[');
+    if (strlen(department) == 0) {
+        // No filter: include all approved teachers
+        for (Teacher* current = g_system.teachers; current != NULL; current = current->next) {
+            if (current->approved == 1) teacherToJSON(out, current);
+        }
+    } else {
+        // Filter by department (its posting list, in teacherId order) and approved status
+        Department* d = findDepartment(department);
+        for (int i = 0; d != NULL && i < d->teachers.count; i++) {
+            Teacher* current = (Teacher*)d->teachers.items[i].record;
+            if (current->approved == 1) teacherToJSON(out, current);
+        }
+    }
+    jsonClose(out, ']');
+    sendBody(client, 200);
+    logDebug("teachers_listed", "department=\"%s\"", department);
+}
+
+// Student login
+static void handleStudentLogin(Request* client, RouteContext* ctx) {
+    int studentId = jsonInt(ctx->args, "studentId");
+    char password[100];
+    jsonString(ctx->args, "password", password, sizeof(password));
+
+    Student* student = findStudent(studentId);
+    if (student && strcmp(student->password, password) == 0) {
+        OutBuffer* out = &client->body;
+        jsonOpen(out, NULL, '{');
+        jsonPutRaw(out, "success", "true");
+        jsonPutString(out, "role", "student");
+        jsonPutInt(out, "studentId", student->studentId);
+        jsonPutString(out, "name", student->name);
+        jsonPutString(out, "email", student->email);
+        jsonPutString(out, "department", student->department);
+        jsonPutInt(out, "year", student->year);
+        jsonPutNumber(out, "cgpa", student->cgpa);
+        jsonPutNumber(out, "attendance", student->attendance);
+        sessionToJSON(out, ROLE_STUDENT, student->studentId, student->departmentId);
+        jsonClose(out, '}');
+        sendBody(client, 200);
+        logInfo("login", "role=student studentId=%d", studentId);
+    } else {
+        sendResponse(client, 401, "{\"error\":\"Invalid student ID or password\"}");
+    }
+}
+
+// Logout: ends the session named by the Authorization header
+static void handleLogout(Request* client, RouteContext* ctx) {
+    char value[128];
+    if (ctx->headerEnd && findHeader(ctx->request, ctx->headerEnd, "Authorization", value, sizeof(value)) &&
+        strncasecmp(value, "Bearer ", 7) == 0) {
+        sessionRevoke(value + 7);
+    }
+    sendResponse(client, 200, "{\"message\":\"Logged out\"}");
+}
+
+// Student registration
+static void handleRegisterStudent(Request* client, RouteContext* ctx) {
+    char name[100], password[100], email[120], department[80];
+    int year;
+    jsonString(ctx->args, "name", name, sizeof(name));
+    jsonString(ctx->args, "password", password, sizeof(password));
+    jsonString(ctx->args, "email", email, sizeof(email));
+    jsonString(ctx->args, "department", department, sizeof(department));
+    year = jsonInt(ctx->args, "year");
+
+    if (strlen(name) == 0 || strlen(password) < 4 || year < 1 || year > 6) {
+        sendResponse(client, 400, "{\"error\":\"Invalid input\"}");
+        return;
+    }
+
+    Student* stu = createStudent(g_system.nextStudentId, name, password, email, department, year);
+    client->walLsn = walLogStudent(stu);
+
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutInt(out, "studentId", stu->studentId);
+    jsonPutString(out, "name", stu->name);
+    jsonPutString(out, "message", "Registration successful");
+    jsonClose(out, '}');
+    sendBody(client, 201);
+    logInfo("student_registered", "studentId=%d", stu->studentId);
+}
+
+// Teacher registration (pending approval)
+static void handleRegisterTeacher(Request* client, RouteContext* ctx) {
+    char name[100], password[100], email[120], department[80];
+    jsonString(ctx->args, "name", name, sizeof(name));
+    jsonString(ctx->args, "password", password, sizeof(password));
+    jsonString(ctx->args, "email", email, sizeof(email));
+    jsonString(ctx->args, "department", department, sizeof(department));
+
+    if (strlen(name) == 0 || strlen(password) < 4 || strlen(email) == 0) {
+        sendResponse(client, 400, "{\"error\":\"Invalid input\"}");
+        return;
+    }
+
+    if (findTeacherByEmail(email) != NULL) {
+        sendResponse(client, 400, "{\"error\":\"Email already registered\"}");
+        return;
+    }
+
+    Teacher* teacher = createTeacher(g_system.nextTeacherId, name, password, email, department);
+    client->walLsn = walLogTeacher(teacher);
+
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutInt(out, "teacherId", teacher->teacherId);
+    jsonPutString(out, "message", "Registration submitted. Pending principal approval");
+    jsonClose(out, '}');
+    sendBody(client, 201);
+    logInfo("teacher_registered", "teacherId=%d approved=0", teacher->teacherId);
+}
+
+// Get pending teachers (Principal only)
+static void handlePendingTeachers(Request* client, RouteContext* ctx) {
+    (void)ctx;
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '[');
+    Teacher* current = g_system.teachers;
+    int pending = 0;
+    while (current != NULL) {
+        if (current->approved == 0) {
+            teacherToJSON(out, current);
+            pending++;
+        }
+        current = current->next;
+    }
+    jsonClose(out, ']');
+    sendBody(client, 200);
+    logDebug("pending_teachers_listed", "count=%d", pending);
+}
+
+// Approve/Reject teacher
+static void handleApproveTeacher(Request* client, RouteContext* ctx) {
+    int teacherId = ctx->params[0].value;
+    char auth[100];
+    int action;
+    jsonString(ctx->args, "password", auth, sizeof(auth));
+    action = jsonInt(ctx->args, "action");
+
+    if (strcmp(auth, PRINCIPAL_PASSWORD) != 0) {
+        sendResponse(client, 401, "{\"error\":\"Unauthorized\"}");
+        return;
+    }
+
+    Teacher* teacher = findTeacher(teacherId);
+    if (!teacher) {
+        sendResponse(client, 404, "{\"error\":\"Teacher not found\"}");
+        return;
+    }
+
+    if (action == 1) {
+        char now[50];
+        getCurrentTimestamp(now);
+        setTeacherApproval(teacher, 1, now);
+        sendResponse(client, 200, "{\"message\":\"Teacher approved\"}");
+        logInfo("teacher_approval", "teacherId=%d approved=1", teacherId);
+    } else {
+        setTeacherApproval(teacher, -1, teacher->approvalDate);
+        sessionRevokeUser(ROLE_TEACHER, teacherId);
+        sendResponse(client, 200, "{\"message\":\"Teacher rejected\"}");
+        logInfo("teacher_approval", "teacherId=%d approved=-1", teacherId);
+    }
+    client->walLsn = walLogApproval(teacher);
+}
+
+// Get student by ID (with subjects)
+static void handleGetStudent(Request* client, RouteContext* ctx) {
+    Student* s = findStudent(ctx->params[0].value);
+    if (!s) {
+        sendResponse(client, 404, "{\"error\":\"Student not found\"}");
+        return;
+    }
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutInt(out, "id", s->studentId);
+    jsonPutInt(out, "studentId", s->studentId);
+    jsonPutString(out, "name", s->name);
+    jsonPutString(out, "email", s->email);
+    jsonPutString(out, "department", s->department);
+    jsonPutInt(out, "year", s->year);
+    jsonPutInt(out, "semester", s->semester);
+    jsonPutNumber(out, "cgpa", s->cgpa);
+    jsonPutNumber(out, "attendance", s->attendance);
+    jsonPutNumber(out, "attendance_percent", s->attendance);
+    jsonPutKey(out, "subjects");
+    subjectsToJSON(s->subjects, s->subjectCount, out);
+    jsonClose(out, '}');
+    sendBody(client, 200);
+}
+
+// Role-based student fetch (supports GET with query or POST with JSON)
+static void handleListStudents(Request* client, RouteContext* ctx) {
+    char role[50];
+    char dept[80];
+    char teacherEmail[120];
+    char principalPassword[100];
+    char fieldList[200];
+    char limitText[16];
+    char cursorText[16];
+    int studentIdFilter = 0;
+    role[0] = '\0'; dept[0] = '\0'; teacherEmail[0] = '\0'; principalPassword[0] = '\0';
+    fieldList[0] = '\0'; limitText[0] = '\0'; cursorText[0] = '\0';
+
+    // Parse JSON body first
+    jsonString(ctx->args, "role", role, sizeof(role));
+    jsonString(ctx->args, "department", dept, sizeof(dept));
+    jsonString(ctx->args, "email", teacherEmail, sizeof(teacherEmail));
+    jsonString(ctx->args, "principalPassword", principalPassword, sizeof(principalPassword));
+    jsonString(ctx->args, "fields", fieldList, sizeof(fieldList));
+    jsonString(ctx->args, "limit", limitText, sizeof(limitText));
+    jsonString(ctx->args, "cursor", cursorText, sizeof(cursorText));
+    studentIdFilter = jsonInt(ctx->args, "studentId");
+
+    // Fallback: parse query string for anything the body did not set
+    const char* query = ctx->query;
+    if (query != NULL) {
+        char queryBuf[512];
+        strncpy(queryBuf, query + 1, sizeof(queryBuf) - 1);
+        queryBuf[sizeof(queryBuf) - 1] = '\0';
+        // Split on '&' by hand: strtok keeps hidden state shared by all workers
+        char* token = queryBuf;
+        while (token != NULL) {
+            char* amp = strchr(token, '&');
+            if (amp) *amp = '\0';
+            urlDecode(token);
+            if (strncmp(token, "role=", 5) == 0 && strlen(role) == 0) {
+                strncpy(role, token + 5, sizeof(role) - 1);
+            } else if (strncmp(token, "department=", 11) == 0 && strlen(dept) == 0) {
+                strncpy(dept, token + 11, sizeof(dept) - 1);
+            } else if (strncmp(token, "fields=", 7) == 0 && strlen(fieldList) == 0) {
+                strncpy(fieldList, token + 7, sizeof(fieldList) - 1);
+            } else if (strncmp(token, "limit=", 6) == 0 && strlen(limitText) == 0) {
+                strncpy(limitText, token + 6, sizeof(limitText) - 1);
+            } else if (strncmp(token, "cursor=", 7) == 0 && strlen(cursorText) == 0) {
+                strncpy(cursorText, token + 7, sizeof(cursorText) - 1);
+            }
+            token = amp ? amp + 1 : NULL;
+        }
+    }
+
+    if (strlen(role) == 0) {
+        sendResponse(client, 400, "{\"error\":\"Role required\"}");
+        return;
+    }
+
+    int fields = FIELD_ALL;
+    if (strlen(fieldList) > 0) {
+        fields = parseStudentFields(fieldList);
+        if (fields < 0) {
+            sendResponse(client, 400, "{\"error\":\"Unknown field in fields\"}");
+            return;
+        }
+    }
+
+    // A limit or cursor switches to a page envelope; without either the
+    // full array is returned as before
+    int paged = strlen(limitText) > 0 || strlen(cursorText) > 0;
+    int limit = strlen(limitText) > 0 ? atoi(limitText) : PAGE_LIMIT_DEFAULT;
+    int cursor = atoi(cursorText);
+    if (limit <= 0 || cursor < 0) {
+        sendResponse(client, 400, "{\"error\":\"Invalid limit or cursor\"}");
+        return;
+    }
+    if (limit > PAGE_LIMIT_MAX) limit = PAGE_LIMIT_MAX;
+
+    // Optional authorization for principal
+    if (strcmp(role, "principal") == 0 && strlen(principalPassword) > 0 && strcmp(principalPassword, PRINCIPAL_PASSWORD) != 0) {
+        sendResponse(client, 401, "{\"error\":\"Unauthorized\"}");
+        return;
+    }
+
+    // Ensure teachers are approved before listing students
+    if (strcmp(role, "teacher") == 0) {
+        Teacher* t = NULL;
+        if (strlen(teacherEmail) > 0) {
+            t = findTeacherByEmail(teacherEmail);
+        }
+        if (t == NULL || t->approved != 1) {
+            sendResponse(client, 403, "{\"error\":\"Forbidden: teacher not approved\"}");
+            return;
+        }
+        if (strlen(dept) == 0 && t != NULL) {
+            snprintf(dept, sizeof(dept), "%s", t->department);
+        }
+    }
+
+    // Teachers read their department's posting list; the other roles
+    // read every student. Both are in studentId order.
+    IdList empty = {NULL, 0, 0};
+    IdList* source = &g_studentOrder;
+    int isStudent = strcmp(role, "student") == 0;
+    int isTeacher = strcmp(role, "teacher") == 0;
+    int isPrincipal = strcmp(role, "principal") == 0;
+    if (isTeacher) {
+        Department* d = strlen(dept) > 0 ? findDepartment(dept) : NULL;
+        source = d ? &d->students : &empty;
+    } else if (!isStudent && !isPrincipal) {
+        source = &empty;
+    }
+
+    OutBuffer* out = &client->body;
+    if (isStudent && studentIdFilter != 0) {
+        // A single student: no scan at all
+        Student* current = findStudent(studentIdFilter);
+        int match = current != NULL && current->studentId > cursor;
+        if (paged) {
+            jsonOpen(out, NULL, '{');
+            jsonOpen(out, "students", '[');
+        } else {
+            jsonOpen(out, NULL, '[');
+        }
+        if (match) studentToJSON(out, current, fields);
+        jsonClose(out, ']');
+        if (paged) {
+            jsonPutRaw(out, "nextCursor", "null");
+            jsonClose(out, '}');
+        }
+    } else if (paged) {
+        // Walk ids upward from the cursor and stop as soon as the page is full
+        int i = idListSeek(source, cursor);
+        int end = i + limit < source->count ? i + limit : source->count;
+        jsonOpen(out, NULL, '{');
+        jsonOpen(out, "students", '[');
+        for (int k = i; k < end; k++) {
+            studentToJSON(out, (Student*)source->items[k].record, fields);
+        }
+        jsonClose(out, ']');
+        if (end < source->count) jsonPutInt(out, "nextCursor", source->items[end - 1].id);
+        else jsonPutRaw(out, "nextCursor", "null");
+        jsonClose(out, '}');
+    } else if (isTeacher) {
+        jsonOpen(out, NULL, '[');
+        for (int k = 0; k < source->count; k++) {
+            studentToJSON(out, (Student*)source->items[k].record, fields);
+        }
+        jsonClose(out, ']');
+    } else {
+        // Full list in store order, as before pagination existed; an
+        // unknown role has an empty source and gets []
+        jsonOpen(out, NULL, '[');
+        Student* current = source->count > 0 ? g_system.students : NULL;
+        while (current != NULL) {
+            studentToJSON(out, current, fields);
+            current = current->next;
+        }
+        jsonClose(out, ']');
+    }
+    sendBody(client, 200);
+    logDebug("students_listed", "role=%s department=\"%s\"", role, dept);
+}
+
+// Aggregate statistics: GET /api/stats?department=&year=
+static void handleStats(Request* client, RouteContext* ctx) {
+    char dept[80] = "";
+    int year = 0;
+    const char* query = ctx->query;
+    if (query != NULL) {
+        char queryBuf[256];
+        strncpy(queryBuf, query + 1, sizeof(queryBuf) - 1);
+        queryBuf[sizeof(queryBuf) - 1] = '\0';
+        char* token = queryBuf;
+        while (token != NULL) {
+            char* amp = strchr(token, '&');
+            if (amp) *amp = '\0';
+            urlDecode(token);
+            if (strncmp(token, "department=", 11) == 0) {
+                strncpy(dept, token + 11, sizeof(dept) - 1);
+            } else if (strncmp(token, "year=", 5) == 0) {
+                year = atoi(token + 5);
+            }
+            token = amp ? amp + 1 : NULL;
+        }
+    }
+
+    // Filters become a per-row byte mask; no filter scans the columns whole
+    int rows = g_studentColumns.count;
+    int subjectRows = g_subjectColumns.count;
+    unsigned char* studentSelect = NULL;
+    unsigned char* subjectSelect = NULL;
+    if (strlen(dept) > 0 || year > 0) {
+        Department* d = strlen(dept) > 0 ? findDepartment(dept) : NULL;
+        int deptId = d ? d->id : -1;
+        studentSelect = (unsigned char*)calloc(rows + 1, 1);
+        subjectSelect = (unsigned char*)calloc(subjectRows + 1, 1);
+        if (strlen(dept) == 0 || d != NULL) {
+            const int* deptColumn = g_studentColumns.departmentId;
+            const int* yearColumn = g_studentColumns.year;
+            for (int r = 0; r < rows; r++) {
+                studentSelect[r] = (strlen(dept) == 0 || deptColumn[r] == deptId) && (year == 0 || yearColumn[r] == year);
+            }
+            for (int r = 0; r < subjectRows; r++) {
+                subjectSelect[r] = studentSelect[g_subjectColumns.studentRow[r]];
+            }
+        }
+    }
+
+    ColumnStats cgpa, attendance, totals;
+    columnStats(g_studentColumns.cgpa, studentSelect, rows, 1.0, &cgpa);
+    columnStats(g_studentColumns.attendance, studentSelect, rows, 10.0, &attendance);
+    columnStats(g_subjectColumns.total, subjectSelect, subjectRows, 10.0, &totals);
+    free(studentSelect);
+    free(subjectSelect);
+
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    if (strlen(dept) > 0) jsonPutString(out, "department", dept);
+    else jsonPutRaw(out, "department", "null");
+    if (year > 0) jsonPutInt(out, "year", year);
+    else jsonPutRaw(out, "year", "null");
+    jsonPutString(out, "kernel", statsKernelName());
+    jsonPutInt(out, "students", cgpa.count);
+    statsToJSON(out, "cgpa", &cgpa, 1.0);
+    statsToJSON(out, "attendance", &attendance, 10.0);
+    statsToJSON(out, "subjectTotals", &totals, 10.0);
+    jsonClose(out, '}');
+    sendBody(client, 200);
+    logDebug("stats", "students=%lld", cgpa.count);
+}
+
+// Running aggregates: one entry per department and per subject, no rescans
+static void handleAggregates(Request* client, RouteContext* ctx) {
+    (void)ctx;
+    OutBuffer* out = &client->body;
+    mutexLock(&g_aggregateRepairLock);
+    aggregateRepair();
+    jsonOpen(out, NULL, '{');
+    jsonOpen(out, "departments", '[');
+    for (int i = 0; i < g_departments.count; i++) {
+        Department* d = g_departments.items[i];
+        if (d->students.count == 0) continue;
+        jsonOpen(out, NULL, '{');
+        jsonPutString(out, "department", d->name);
+        jsonPutInt(out, "students", d->students.count);
+        summaryToJSON(out, "cgpa", d->cgpa.count, d->cgpa.sum, d->cgpa.sumSq, d->cgpa.min, d->cgpa.max);
+        summaryToJSON(out, "attendance", d->attendance.count, d->attendance.sum, d->attendance.sumSq,
+                      d->attendance.min, d->attendance.max);
+        jsonClose(out, '}');
+    }
+    jsonClose(out, ']');
+    jsonOpen(out, "subjects", '[');
+    for (int i = 0; i < g_subjectAggregates.count; i++) {
+        SubjectAggregate* agg = g_subjectAggregates.items[i];
+        jsonOpen(out, NULL, '{');
+        jsonPutString(out, "subjectId", agg->subjectId);
+        jsonPutString(out, "name", agg->name);
+        jsonPutInt(out, "enrolled", agg->total.count);
+        summaryToJSON(out, "total", agg->total.count, agg->total.sum, agg->total.sumSq, agg->total.min, agg->total.max);
+        summaryToJSON(out, "attendance", agg->attendance.count, agg->attendance.sum, agg->attendance.sumSq,
+                      agg->attendance.min, agg->attendance.max);
+        jsonClose(out, '}');
+    }
+    jsonClose(out, ']');
+    jsonClose(out, '}');
+    mutexUnlock(&g_aggregateRepairLock);
+    sendBody(client, 200);
+    logDebug("aggregates", "departments=%d subjects=%d", g_departments.count, g_subjectAggregates.count);
+}
+
+// Rankings over the order indexes; metric is cgpa, attendance or subject (with subjectId=)
+//   GET /api/rankings/top?metric=&k=&order=desc|asc&department=&year=
+//   GET /api/rankings/range?metric=&min=&max=&limit=&department=&year=   (min <= value < max)
+//   GET /api/rankings/percentile?metric=&p=&department=&year=  or  &studentId=
+static void handleRankings(Request* client, RouteContext* ctx) {
+    char kind[16], metricName[20] = "cgpa", subjectId[20] = "", dept[80] = "";
+    int year = 0, k = 10, limit = PAGE_LIMIT_DEFAULT, descending = 1, studentId = 0;
+    double min = -DBL_MAX, max = DBL_MAX, p = -1;
+    routeParamCopy(&ctx->params[0], kind, sizeof(kind));
+    const char* query = ctx->query;
+    if (query != NULL) {
+        char queryBuf[256];
+        strncpy(queryBuf, query + 1, sizeof(queryBuf) - 1);
+        queryBuf[sizeof(queryBuf) - 1] = '\0';
+        char* token = queryBuf;
+        while (token != NULL) {
+            char* amp = strchr(token, '&');
+            if (amp) *amp = '\0';
+            urlDecode(token);
+            if (strncmp(token, "metric=", 7) == 0) {
+                strncpy(metricName, token + 7, sizeof(metricName) - 1);
+            } else if (strncmp(token, "subjectId=", 10) == 0) {
+                strncpy(subjectId, token + 10, sizeof(subjectId) - 1);
+            } else if (strncmp(token, "department=", 11) == 0) {
+                strncpy(dept, token + 11, sizeof(dept) - 1);
+            } else if (strncmp(token, "year=", 5) == 0) {
+                year = atoi(token + 5);
+            } else if (strncmp(token, "k=", 2) == 0) {
+                k = atoi(token + 2);
+            } else if (strncmp(token, "limit=", 6) == 0) {
+                limit = atoi(token + 6);
+            } else if (strcmp(token, "order=asc") == 0) {
+                descending = 0;
+            } else if (strncmp(token, "min=", 4) == 0) {
+                min = atof(token + 4);
+            } else if (strncmp(token, "max=", 4) == 0) {
+                max = atof(token + 4);
+            } else if (strncmp(token, "p=", 2) == 0) {
+                p = atof(token + 2);
+            } else if (strncmp(token, "studentId=", 10) == 0) {
+                studentId = atoi(token + 10);
+            }
+            token = amp ? amp + 1 : NULL;
+        }
+    }
+
+    int metric;
+    RankIndex* index;
+    if (strcmp(metricName, "cgpa") == 0) {
+        metric = RANK_CGPA;
+        index = &g_cgpaRank;
+    } else if (strcmp(metricName, "attendance") == 0) {
+        metric = RANK_ATTENDANCE;
+        index = &g_attendanceRank;
+    } else if (strcmp(metricName, "subject") == 0) {
+        SubjectAggregate* agg = (SubjectAggregate*)strIndexGet(&g_subjectAggregateIndex, subjectId);
+        if (!agg) {
+            sendResponse(client, 404, "{\"error\":\"Subject not found\"}");
+            return;
+        }
+        metric = RANK_SUBJECT;
+        index = &agg->ranking;
+    } else {
+        sendResponse(client, 400, "{\"error\":\"metric must be cgpa, attendance or subject\"}");
+        return;
+    }
+
+    // An unknown department matches no one
+    Department* d = strlen(dept) > 0 ? findDepartment(dept) : NULL;
+    int departmentId = strlen(dept) == 0 ? -1 : (d ? d->id : INT_MAX);
+    int filtered = departmentId >= 0 || year > 0;
+
+    OutBuffer* out = &client->body;
+    if (strcmp(kind, "top") == 0 || strcmp(kind, "range") == 0) {
+        int isTop = kind[0] == 't';
+        int want = isTop ? k : limit;
+        if (want <= 0) want = isTop ? 10 : PAGE_LIMIT_DEFAULT;
+        if (want > PAGE_LIMIT_MAX) want = PAGE_LIMIT_MAX;
+        RankEntry* entries = (RankEntry*)malloc((want + 1) * sizeof(RankEntry));
+        int found = 0, more = 0;
+        if (isTop) {
+            if (departmentId != INT_MAX) found = rankTopK(index, metric, d, year, want, descending, entries);
+        } else {
+            for (RankNode* x = rankSeek(index, min, INT_MIN); x && x->value < max; x = x->links[0].next) {
+                if (!rankMatches(x->record, departmentId, year)) continue;
+                if (found == want) {
+                    more = 1;
+                    break;
+                }
+                entries[found].value = x->value;
+                entries[found].id = x->id;
+                entries[found].record = x->record;
+                found++;
+            }
+        }
+        jsonOpen(out, NULL, '{');
+        jsonPutString(out, "metric", metricName);
+        if (metric == RANK_SUBJECT) jsonPutString(out, "subjectId", subjectId);
+        if (isTop) jsonPutString(out, "order", descending ? "desc" : "asc");
+        else jsonPutRaw(out, "more", more ? "true" : "false");
+        jsonOpen(out, "results", '[');
+        for (int i = 0; i < found; i++) rankEntryToJSON(out, &entries[i], i + 1);
+        jsonClose(out, ']');
+        jsonClose(out, '}');
+        free(entries);
+        sendBody(client, 200);
+        logDebug("rankings", "kind=%s metric=%s results=%d", kind, metricName, found);
+        return;
+    }
+
+    if (strcmp(kind, "percentile") == 0) {
+        jsonOpen(out, NULL, '{');
+        jsonPutString(out, "metric", metricName);
+        if (metric == RANK_SUBJECT) jsonPutString(out, "subjectId", subjectId);
+        if (studentId > 0) {
+            // Share of the (filtered) population at or below the student's value
+            Student* s = findStudent(studentId);
+            Subject* subj = s && metric == RANK_SUBJECT ? findStudentSubject(s, subjectId) : NULL;
+            if (!s || (metric == RANK_SUBJECT && !subj)) {
+                sendResponse(client, 404, "{\"error\":\"Student not ranked for this metric\"}");
+                return;
+            }
+            double value = metric == RANK_CGPA ? s->cgpa
+                         : metric == RANK_ATTENDANCE ? s->attendance
+                         : subj->mid1 + subj->mid2 + subj->final;
+            int count = 0, atOrBelow = 0;
+            if (!filtered) {
+                count = index->count;
+                atOrBelow = rankCountBelow(index, value, INT_MAX);
+            } else {
+                for (RankNode* x = rankSeek(index, -DBL_MAX, INT_MIN); x; x = x->links[0].next) {
+                    if (!rankMatches(x->record, departmentId, year)) continue;
+                    count++;
+                    if (x->value <= value) atOrBelow++;
+                }
+            }
+            jsonPutInt(out, "studentId", studentId);
+            jsonPutNumber(out, "value", value);
+            jsonPutInt(out, "count", count);
+            jsonPutInt(out, "atOrBelow", atOrBelow);
+            if (count > 0) jsonPutNumber(out, "percentile", 100.0 * atOrBelow / count);
+            else jsonPutRaw(out, "percentile", "null");
+        } else {
+            if (p < 0 || p > 100) {
+                sendResponse(client, 400, "{\"error\":\"p must be between 0 and 100\"}");
+                return;
+            }
+            // Nearest rank: the smallest value with at least p% of entries at or below it
+            int count = 0;
+            if (!filtered) {
+                count = index->count;
+            } else {
+                for (RankNode* x = rankSeek(index, -DBL_MAX, INT_MIN); x; x = x->links[0].next) {
+                    count += rankMatches(x->record, departmentId, year);
+                }
+            }
+            int rank = (int)(p * count / 100);
+            if (rank < p * count / 100) rank++;
+            if (rank < 1) rank = 1;
+            RankNode* node = NULL;
+            if (count > 0 && !filtered) {
+                node = rankSelect(index, rank);
+            } else if (count > 0) {
+                int seen = 0;
+                for (node = rankSeek(index, -DBL_MAX, INT_MIN); node; node = node->links[0].next) {
+                    if (rankMatches(node->record, departmentId, year) && ++seen == rank) break;
+                }
+            }
+            jsonPutNumber(out, "p", p);
+            jsonPutInt(out, "count", count);
+            if (node) {
+                jsonPutNumber(out, "value", node->value);
+                jsonPutInt(out, "studentId", node->id);
+            } else {
+                jsonPutRaw(out, "value", "null");
+                jsonPutRaw(out, "studentId", "null");
+            }
+        }
+        jsonClose(out, '}');
+        sendBody(client, 200);
+        logDebug("rankings", "kind=percentile metric=%s", metricName);
+        return;
+    }
+
+    sendResponse(client, 404, "{\"error\":\"Unknown ranking query\"}");
+}
+
+// Batch mark entry: {"rows":[{"studentId","subjectId","mid1","mid2","final",
+// "attendance_percent","remarks"}, ...]} from a teacher or the principal. Teachers'
+// department access is checked per row. Applies every row or none, and logs the
+// batch as one WAL record. Rejections list the failing rows.
+static void handleMarksBatch(Request* client, RouteContext* ctx) {
+    JsonField* rowsField = jsonFind(ctx->args, "rows");
+    if (!rowsField || rowsField->type != JSON_ARRAY) {
+        sendResponse(client, 400, "{\"error\":\"rows must be an array\"}");
+        return;
+    }
+
+    // Resolve and validate every row; errors are collected, nothing is applied yet
+    MarkRow* rows = (MarkRow*)malloc(MARK_BATCH_MAX * sizeof(MarkRow));
+    OutBuffer errors = {NULL, 0, 0};
+    int count = 0, failed = 0, malformed = 0;
+    const char* end = rowsField->value + rowsField->valueLen;
+    const char* p = jsonSkipSpace(rowsField->value + 1, end);
+    JsonObject rec;
+    jsonOpen(&errors, NULL, '[');
+    while (p < end && *p == '{') {
+        if (count == MARK_BATCH_MAX) {
+            malformed = 2;
+            break;
+        }
+        p = jsonParseObject(&rec, p, end);
+        if (!p) {
+            malformed = 1;
+            break;
+        }
+        MarkRow* row = &rows[count];
+        int studentId = jsonInt(&rec, "studentId");
+        char subjectId[20];
+        jsonString(&rec, "subjectId", subjectId, sizeof(subjectId));
+        row->mid1 = jsonInt(&rec, "mid1");
+        row->mid2 = jsonInt(&rec, "mid2");
+        row->final = jsonInt(&rec, "final");
+        row->attendance = jsonNumber(&rec, "attendance_percent");
+        jsonString(&rec, "remarks", row->remarks, sizeof(row->remarks));
+        row->student = findStudent(studentId);
+        row->subject = row->student ? findStudentSubject(row->student, subjectId) : NULL;
+
+        char rowError[200] = "";
+        int decision;
+        if (!row->student) {
+            strcpy(rowError, "Student not found");
+        } else if (ctx->caller.role == ROLE_TEACHER &&
+                   (decision = authTeacherDepartment(ctx->caller.userId, row->student->departmentId)) != AUTH_OK) {
+            strcpy(rowError, g_authFailures[decision].message);
+        } else if (!row->subject) {
+            strcpy(rowError, "Subject not found for this student");
+        } else if (row->mid1 < 0 || row->mid2 < 0 || row->final < 0 || row->attendance < 0.0 || row->attendance > 100.0) {
+            strcpy(rowError, "Validation failed: marks must be non-negative, attendance 0-100");
+        }
+        if (rowError[0] != '\0') {
+            jsonOpen(&errors, NULL, '{');
+            jsonPutInt(&errors, "row", count);
+            jsonPutInt(&errors, "studentId", studentId);
+            jsonPutString(&errors, "subjectId", subjectId);
+            jsonPutString(&errors, "error", rowError);
+            jsonClose(&errors, '}');
+            failed++;
+        }
+        count++;
+        p = jsonSkipSpace(p, end);
+        if (p < end && *p == ',') p = jsonSkipSpace(p + 1, end);
+    }
+    jsonClose(&errors, ']');
+    if (!malformed && (p >= end || *p != ']')) malformed = 1;
+
+    if (malformed || count == 0 || failed > 0) {
+        if (malformed == 2) {
+            sendResponse(client, 400, "{\"error\":\"Too many rows (at most 1000 per batch)\"}");
+        } else if (malformed) {
+            sendResponse(client, 400, "{\"error\":\"Malformed rows array\"}");
+        } else if (count == 0) {
+            sendResponse(client, 400, "{\"error\":\"rows must not be empty\"}");
+        } else {
+            OutBuffer* out = &client->body;
+            jsonOpen(out, NULL, '{');
+            jsonPutString(out, "error", "Batch rejected; no rows were applied");
+            jsonPutInt(out, "rows", count);
+            jsonPutInt(out, "failed", failed);
+            jsonPutKey(out, "errors");
+            queueOutput(out, errors.data, errors.len);
+            jsonClose(out, '}');
+            sendBody(client, 400);
+        }
+        logWarn("marks_batch_rejected", "failed=%d rows=%d", failed, count);
+        free(errors.data);
+        free(rows);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        setSubjectMarks(rows[i].student, rows[i].subject, rows[i].mid1, rows[i].mid2, rows[i].final,
+                        rows[i].attendance, rows[i].remarks);
+    }
+    client->walLsn = walLogMarks(rows, count);
+
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutString(out, "message", "Marks updated");
+    jsonPutInt(out, "applied", count);
+    jsonClose(out, '}');
+    sendBody(client, 200);
+    logInfo("marks_batch_applied", "rows=%d", count);
+    free(errors.data);
+    free(rows);
+}
+
+// Bulk import and export, principal only (e.g. the X-Principal-Password header):
+//   POST /api/import/{students|teachers|marks}?format=csv|ndjson  with the file as the body
+//   GET  /api/export/{students|teachers|marks}?format=csv|ndjson
+// Imports apply every row or none and are logged as one WAL record. The
+// import route locks for itself: importRun parses without g_systemLock.
+static void handleImportExport(Request* client, RouteContext* ctx) {
+    char kindName[16];
+    routeParamCopy(&ctx->params[0], kindName, sizeof(kindName));
+    int kind = importKind(kindName);
+    if (kind < 0) {
+        sendResponse(client, 404, "{\"error\":\"Unknown kind; use students, teachers or marks\"}");
+        return;
+    }
+    const char* query = ctx->query;
+    int format = query && strstr(query, "format=ndjson") ? FORMAT_NDJSON : FORMAT_CSV;
+
+    if (strcmp(ctx->method, "GET") == 0) {
+        exportRecords(kind, format, &client->body);
+        client->contentType = format == FORMAT_CSV ? "text/csv" : "application/x-ndjson";
+        sendBody(client, 200);
+        logInfo("exported", "kind=%s bytes=%d", kindName, client->body.len);
+        return;
+    }
+
+    int status = importRun(kind, format, ctx->body, (int)strlen(ctx->body), &client->body, &client->walLsn);
+    sendBody(client, status);
+    if (status == 200) logInfo("imported", "kind=%s", kindName);
+    else logWarn("import_rejected", "kind=%s status=%d", kindName, status);
+}
+
+// Update subject marks and attendance (role-based)
+static void handleUpdateSubject(Request* client, RouteContext* ctx) {
+    int studentId = ctx->params[0].value;
+    char subjectId[20];
+    routeParamCopy(&ctx->params[1], subjectId, sizeof(subjectId));
+    
+    Student* s = findStudent(studentId);
+    if (!s) {
+        sendResponse(client, 404, "{\"error\":\"Student not found\"}");
+        return;
+    }
+
+    // Find subject in student's subjects
+    Subject* subj = findStudentSubject(s, subjectId);
+    if (!subj) {
+        sendResponse(client, 404, "{\"error\":\"Subject not found for this student\"}");
+        return;
+    }
+
+    // Parse marks and attendance
+    int mid1 = jsonInt(ctx->args, "mid1");
+    int mid2 = jsonInt(ctx->args, "mid2");
+    int final = jsonInt(ctx->args, "final");
+    double attendance = jsonNumber(ctx->args, "attendance_percent");
+    char remarks[200];
+    jsonString(ctx->args, "remarks", remarks, sizeof(remarks));
+
+    // Validation: marks should be non-negative
+    if (mid1 < 0 || mid2 < 0 || final < 0 || attendance < 0.0 || attendance > 100.0) {
+        sendResponse(client, 400, "{\"error\":\"Validation failed: marks must be non-negative, attendance 0-100\"}");
+        return;
+    }
+
+    // Update subject
+    setSubjectMarks(s, subj, mid1, mid2, final, attendance, remarks);
+    client->walLsn = walLogSubject(s, subj);
+    
+    // Return updated subject
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutString(out, "message", "Subject updated");
+    jsonPutString(out, "subjectId", subj->subjectId);
+    jsonOpen(out, "marks", '{');
+    jsonPutInt(out, "mid1", subj->mid1);
+    jsonPutInt(out, "mid2", subj->mid2);
+    jsonPutInt(out, "final", subj->final);
+    jsonPutInt(out, "total", subj->mid1 + subj->mid2 + subj->final);
+    jsonClose(out, '}');
+    jsonPutNumber(out, "attendance_percent", subj->attendance_percent);
+    jsonClose(out, '}');
+    sendBody(client, 200);
+    logInfo("subject_updated", "studentId=%d subjectId=%s", studentId, subjectId);
+}
+
+// Update student academics (role-based)
+static void handleUpdateAcademics(Request* client, RouteContext* ctx) {
+    int studentId = ctx->params[0].value;
+    Student* s = findStudent(studentId);
+    if (!s) {
+        sendResponse(client, 404, "{\"error\":\"Student not found\"}");
+        return;
+    }
+
+    double newCgpa = jsonNumber(ctx->args, "cgpa");
+    double newAttendance = jsonNumber(ctx->args, "attendance_percent");
+    if (newAttendance == 0.0) {
+        // allow key 'attendance' as well
+        newAttendance = jsonNumber(ctx->args, "attendance");
+    }
+
+    if (newCgpa < 0.0 || newCgpa > 10.0 || newAttendance < 0.0 || newAttendance > 100.0) {
+        sendResponse(client, 400, "{\"error\":\"Validation failed: CGPA 0-10, Attendance 0-100\"}");
+        return;
+    }
+
+    setStudentAcademics(s, newCgpa, newAttendance);
+    client->walLsn = walLogAcademics(s);
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutString(out, "message", "Academics updated");
+    jsonPutNumber(out, "cgpa", s->cgpa);
+    jsonPutNumber(out, "attendance_percent", s->attendance);
+    jsonClose(out, '}');
+    sendBody(client, 200);
+    logInfo("academics_updated", "studentId=%d by=%s", studentId, ctx->caller.role == ROLE_PRINCIPAL ? "principal" : "teacher");
+}
+
+// Assign new subject to student (POST /api/students/:id/subjects)
+static void handleAssignSubject(Request* client, RouteContext* ctx) {
+    int studentId = ctx->params[0].value;
+    
+    Student* s = findStudent(studentId);
+    if (!s) {
+        sendResponse(client, 404, "{\"error\":\"Student not found\"}");
+        return;
+    }
+
+    // Parse subject data
+    char subjectId[20], name[100];
+    subjectId[0] = '\0'; name[0] = '\0';
+    jsonString(ctx->args, "subjectId", subjectId, sizeof(subjectId));
+    jsonString(ctx->args, "name", name, sizeof(name));
+
+    if (strlen(subjectId) == 0 || strlen(name) == 0) {
+        sendResponse(client, 400, "{\"error\":\"Validation failed: subjectId and name are required\"}");
+        return;
+    }
+
+    // Check if subject already exists for this student
+    Subject* existing = findStudentSubject(s, subjectId);
+    if (existing != NULL) {
+        sendResponse(client, 400, "{\"error\":\"Subject already assigned to this student\"}");
+        return;
+    }
+
+    // Parse marks and attendance
+    int mid1 = jsonInt(ctx->args, "mid1");
+    int mid2 = jsonInt(ctx->args, "mid2");
+    int final = jsonInt(ctx->args, "final");
+    double attendance = jsonNumber(ctx->args, "attendance_percent");
+
+    // Validation
+    if (mid1 < 0 || mid2 < 0 || final < 0 || attendance < 0.0 || attendance > 100.0) {
+        sendResponse(client, 400, "{\"error\":\"Validation failed: marks must be non-negative, attendance 0-100\"}");
+        return;
+    }
+
+    // Create new subject entry
+    Subject* newSubj = assignStudentSubject(s, subjectId, name);
+    setSubjectMarks(s, newSubj, mid1, mid2, final, attendance, NULL);
+    client->walLsn = walLogSubject(s, newSubj);
+
+    // Return newly created subject
+    OutBuffer* out = &client->body;
+    jsonOpen(out, NULL, '{');
+    jsonPutString(out, "message", "Subject assigned");
+    jsonPutString(out, "subjectId", newSubj->subjectId);
+    jsonPutString(out, "name", newSubj->name);
+    jsonOpen(out, "marks", '{');
+    jsonPutInt(out, "mid1", newSubj->mid1);
+    jsonPutInt(out, "mid2", newSubj->mid2);
+    jsonPutInt(out, "final", newSubj->final);
+    jsonPutInt(out, "total", newSubj->mid1 + newSubj->mid2 + newSubj->final);
+    jsonClose(out, '}');
+    jsonPutNumber(out, "attendance_percent", newSubj->attendance_percent);
+    jsonClose(out, '}');
+    sendBody(client, 201);
+    logInfo("subject_assigned", "studentId=%d subjectId=%s", studentId, subjectId);
+}
+
+// ---------------------------------------------------------------------------
+// Router
+// ---------------------------------------------------------------------------
+
+// Every endpoint. Registering one is a line here; the order does not matter,
+// since literal segments always win over parameters.
+static const Route g_routeTable[] = {
+    {"GET",  "/metrics",                                handleMetrics,         AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/admin/login",                        handleAdminLogin,      AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/principal/login",                    handlePrincipalLogin,  AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/teacher/login",                      handleTeacherLogin,    AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/student/login",                      handleStudentLogin,    AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/logout",                             handleLogout,          AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"GET",  "/api/teacher/:id",                        handleGetTeacher,      AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"GET",  "/api/teachers",                           handleListTeachers,    AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/teachers",                           handleListTeachers,    AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/student/register",                   handleRegisterStudent, AUTH_SCOPE_NONE,      ROUTE_LOCK_EXCLUSIVE},
+    {"POST", "/api/teacher/register",                   handleRegisterTeacher, AUTH_SCOPE_NONE,      ROUTE_LOCK_EXCLUSIVE},
+    {"GET",  "/api/principal/pending-teachers",         handlePendingTeachers, AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/principal/teachers/:id/approve",     handleApproveTeacher,  AUTH_SCOPE_NONE,      ROUTE_LOCK_EXCLUSIVE},
+    {"GET",  "/api/students/:id",                       handleGetStudent,      AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"GET",  "/api/students",                           handleListStudents,    AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/students",                           handleListStudents,    AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"GET",  "/api/stats",                              handleStats,           AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"GET",  "/api/aggregates",                         handleAggregates,      AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"GET",  "/api/rankings/:kind",                     handleRankings,        AUTH_SCOPE_NONE,      ROUTE_LOCK_SHARED},
+    {"POST", "/api/marks/batch",                        handleMarksBatch,      AUTH_SCOPE_STAFF,     ROUTE_LOCK_EXCLUSIVE},
+    {"POST", "/api/import/:kind",                       handleImportExport,    AUTH_SCOPE_PRINCIPAL, ROUTE_LOCK_HANDLER},
+    {"GET",  "/api/export/:kind",                       handleImportExport,    AUTH_SCOPE_PRINCIPAL, ROUTE_LOCK_SHARED},
+    {"PUT",  "/api/students/:id/subjects/:subjectId",   handleUpdateSubject,   AUTH_SCOPE_STUDENT,   ROUTE_LOCK_EXCLUSIVE},
+    {"PUT",  "/api/students/:id/academics",             handleUpdateAcademics, AUTH_SCOPE_STUDENT,   ROUTE_LOCK_EXCLUSIVE},
+    {"POST", "/api/students/:id/subjects",              handleAssignSubject,   AUTH_SCOPE_STUDENT,   ROUTE_LOCK_EXCLUSIVE},
+};
+
+static int methodIndex(const char* method) {
+    if (strcmp(method, "GET") == 0) return METHOD_GET;
+    if (strcmp(method, "POST") == 0) return METHOD_POST;
+    if (strcmp(method, "PUT") == 0) return METHOD_PUT;
+    return -1;
+}
+
+// The request target ends at the query string or the end of the request line
+static int routePathEnd(char c) {
+    return c == '\0' || c == '?' || c == ' ' || c == '\r' || c == '\n';
+}
+
+static RouteNode* routeNodeNew(const char* segment, int len) {
+    RouteNode* node = (RouteNode*)calloc(1, sizeof(RouteNode));
+    node->segment = segment;
+    node->segmentLen = len;
+    return node;
+}
+
+// Adds one g_routes entry to the trie; fails on a duplicate or on two
+// parameter types at the same position
+static int routerAdd(int index) {
+    const Route* route = &g_routes[index];
+    int method = methodIndex(route->method);
+    RouteNode* node = g_routeRoot;
+    const char* p = route->pattern;
+    if (method < 0 || *p != '/') return -1;
+    while (*p == '/') {
+        const char* seg = p + 1;
+        const char* e = seg;
+        while (*e != '\0' && *e != '/') e++;
+        int len = (int)(e - seg);
+        if (*seg == ':') {
+            int type = (len == 3 && memcmp(seg, ":id", 3) == 0) ? PARAM_INT : PARAM_TEXT;
+            if (!node->param) {
+                node->param = routeNodeNew(NULL, 0);
+                node->param->paramType = type;
+            } else if (node->param->paramType != type) {
+                return -1;
+            }
+            node = node->param;
+        } else {
+            RouteNode* child = node->literals;
+            while (child && !(child->segmentLen == len && memcmp(child->segment, seg, len) == 0)) child = child->next;
+            if (!child) {
+                child = routeNodeNew(seg, len);
+                child->next = node->literals;
+                node->literals = child;
+            }
+            node = child;
+        }
+        p = e;
+    }
+    if (*p != '\0' || (node->methods & (1 << method))) return -1;
+    node->methods |= 1 << method;
+    node->routes[method] = index;
+    return 0;
+}
+
+// Compiles g_routeTable into the trie, once at startup
+int routerInit() {
+    g_routes = g_routeTable;
+    g_routeCount = (int)(sizeof(g_routeTable) / sizeof(g_routeTable[0]));
+    if (g_routeCount > ROUTE_MAX) {
+        printf("Route table holds %d routes; raise ROUTE_MAX\n", g_routeCount);
+        return -1;
+    }
+    g_routeRoot = routeNodeNew(NULL, 0);
+    for (int i = 0; i < g_routeCount; i++) {
+        if (routerAdd(i) != 0) {
+            printf("Bad or conflicting route: %s %s\n", g_routes[i].method, g_routes[i].pattern);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Decimal integer segment, at most 9 digits so it fits an int
+static int routeParseInt(const char* text, int len, int* value) {
+    if (len == 0 || len > 9) return 0;
+    int v = 0;
+    for (int i = 0; i < len; i++) {
+        if (text[i] < '0' || text[i] > '9') return 0;
+        v = v * 10 + (text[i] - '0');
+    }
+    *value = v;
+    return 1;
+}
+
+// Walks the trie one path segment at a time, so a lookup costs the length
+// of the path rather than the number of routes. Returns the g_routes index
+// with params filled in, ROUTE_NOT_FOUND, or ROUTE_BAD_METHOD when the path
+// exists but not for this method.
+int routerMatch(const char* method, const char* path, RouteParam* params) {
+    RouteNode* node = g_routeRoot;
+    int count = 0;
+    if (*path != '/') return ROUTE_NOT_FOUND;
+    while (!routePathEnd(*path)) {
+        const char* seg = path + 1;
+        const char* e = seg;
+        while (!routePathEnd(*e) && *e != '/') e++;
+        int len = (int)(e - seg);
+        RouteNode* child = node->literals;
+        while (child && !(child->segmentLen == len && memcmp(child->segment, seg, len) == 0)) child = child->next;
+        if (!child) {
+            child = node->param;
+            if (!child || len == 0 || count == ROUTE_MAX_PARAMS) return ROUTE_NOT_FOUND;
+            if (child->paramType == PARAM_INT && !routeParseInt(seg, len, &params[count].value)) return ROUTE_NOT_FOUND;
+            params[count].text = seg;
+            params[count].len = len;
+            count++;
+        }
+        node = child;
+        path = e;
+    }
+    int m = methodIndex(method);
+    if (m < 0 || !(node->methods & (1 << m))) return node->methods ? ROUTE_BAD_METHOD : ROUTE_NOT_FOUND;
+    return node->routes[m];
+}
+
+// Runs the route the worker matched (client->route) behind the authorization stage
+void handleRequest(Request* client, char* request) {
+    char method[10] = "", path[256] = "";
+    sscanf(request, "%9s %255s", method, path);
+
+    logDebug("request", "method=%s path=%s", method, path);
+
+    if (strcmp(method, "OPTIONS") == 0) {
+        sendCORSHeaders(client);
+        return;
+    }
+    if (client->route == ROUTE_NOT_FOUND) {
+        sendResponse(client, 404, "{\"error\":\"Endpoint not found\"}");
+        return;
+    }
+    if (client->route == ROUTE_BAD_METHOD) {
+        sendResponse(client, 405, "{\"error\":\"Method not allowed\"}");
+        return;
+    }
+    const Route* route = &g_routes[client->route];
+    if (route->lock != ROUTE_LOCK_SHARED && walFailed()) {
+        sendResponse(client, 503, "{\"error\":\"Write-ahead log unavailable; changes are refused\"}");
+        return;
+    }
+
+    // The event loop frames exactly one request per buffer, so the body runs to the NUL
+    char emptyBody[1] = "";
+    char* body_start = strstr(request, "\r\n\r\n");
+    char* body = body_start ? body_start + 4 : emptyBody;
+    JsonObject args;
+    jsonParse(&args, body, (int)strlen(body));
+
+    RouteContext ctx;
+    ctx.method = method;
+    ctx.query = strchr(path, '?');
+    ctx.request = request;
+    ctx.headerEnd = body_start;
+    ctx.body = body;
+    ctx.args = &args;
+    ctx.caller.role = ROLE_NONE;
+    ctx.caller.userId = 0;
+    ctx.params = client->params;
+
+    // Authorization stage: staff routes resolve and check their caller here, once
+    if (route->scope != AUTH_SCOPE_NONE) {
+        int studentId = route->scope == AUTH_SCOPE_STUDENT ? client->params[0].value : 0;
+        int ownLock = route->lock == ROUTE_LOCK_HANDLER;
+        if (ownLock) rwlockReadLock(&g_systemLock);  // callers may be looked up in the store
+        int result = authorizeRequest(request, body_start, &args, studentId, route->scope, &ctx.caller);
+        if (ownLock) rwlockReadUnlock(&g_systemLock);
+        if (result != AUTH_OK) {
+            sendResponse(client, g_authFailures[result].status, g_authFailures[result].body);
+            logWarn("auth_failed", "method=%s path=%s status=%d reason=\"%s\"", method, path,
+                    g_authFailures[result].status, g_authFailures[result].message);
+            return;
+        }
+    }
+
+    route->handler(client, &ctx);
+}
+
+// Replaces the body with a fixed JSON string and sends it
+void sendResponse(Request* client, int status, const char* body) {
+    client->body.len = 0;
+    queueOutput(&client->body, body, (int)strlen(body));
+    sendBody(client, status);
+}
+
+// Sends whatever the handler built in client->body
+void sendBody(Request* client, int status) {
+    const char* status_text = "OK";
+    if (status == 201) status_text = "Created";
+    else if (status == 400) status_text = "Bad Request";
+    else if (status == 401) status_text = "Unauthorized";
+    else if (status == 403) status_text = "Forbidden";
+    else if (status == 404) status_text = "Not Found";
+    else if (status == 405) status_text = "Method Not Allowed";
+    else if (status == 503) status_text = "Service Unavailable";
+
+    client->status = status;
+    client->header.len = 0;
+    bufPrintf(&client->header,
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: %s\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Access-Control-Allow-Methods: GET, POST, PUT, OPTIONS\r\n"
+        "Access-Control-Allow-Headers: Content-Type, Authorization, X-Principal-Password\r\n"
+        "Connection: %s\r\n"
+        "Content-Length: %d\r\n"
+        "\r\n",
+        status, status_text, client->contentType ? client->contentType : "application/json",
+        client->keepAlive ? "keep-alive" : "close", client->body.len);
+}
+
+void sendCORSHeaders(Request* client) {
+    client->status = 200;
+    client->body.len = 0;
+    client->header.len = 0;
+    bufPrintf(&client->header,
+        "HTTP/1.1 200 OK\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Access-Control-Allow-Methods: GET, POST, PUT, OPTIONS\r\n"
+        "Access-Control-Allow-Headers: Content-Type, Authorization, X-Principal-Password\r\n"
+        "Access-Control-Max-Age: 86400\r\n"
+        "Connection: %s\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n",
+        client->keepAlive ? "keep-alive" : "close");
+}
+
+Student* findStudent(int id) {
+    return (Student*)idIndexGet(&g_studentIndex, id);
+}
+
+Teacher* findTeacher(int id) {
+    return (Teacher*)idIndexGet(&g_teacherIndex, id);
+}
+
+Teacher* findTeacherByEmail(const char* email) {
+    return (Teacher*)strIndexGet(&g_teacherEmailIndex, email);
+}
+
+Principal* findPrincipal(int id) {
+    Principal* current = g_system.principals;
+    while (current) {
+        if (current->principalId == id) return current;
+        current = current->next;
+    }
+    return NULL;
+}
+
+// Links a new student into g_system and its lookup index
+void addStudent(Student* s) {
+    s->next = g_system.students;
+    g_system.students = s;
+    idIndexPut(&g_studentIndex, s->studentId, s);
+    idListInsert(&g_studentOrder, s->studentId, s);
+    Department* d = internDepartment(s->department);
+    s->departmentId = d->id;
+    idListInsert(&d->students, s->studentId, s);
+    columnsAddStudent(s);
+    rankInsert(&g_cgpaRank, s->cgpa, s->studentId, s);
+    rankInsert(&g_attendanceRank, s->attendance, s->studentId, s);
+}
+
+// Links a new teacher into g_system and its id and email indexes
+void addTeacher(Teacher* t) {
+    t->next = g_system.teachers;
+    g_system.teachers = t;
+    idIndexPut(&g_teacherIndex, t->teacherId, t);
+    strIndexPut(&g_teacherEmailIndex, t->email, t);
+    Department* d = internDepartment(t->department);
+    t->departmentId = d->id;
+    idListInsert(&d->teachers, t->teacherId, t);
+}
+
+// Bulk-load variants: link at the tail so records keep their file order.
+// The loader builds the rank indexes once at the end (buildRankIndexes).
+void appendStudent(Student* s, Student** tail) {
+    s->next = NULL;
+    if (*tail) (*tail)->next = s;
+    else g_system.students = s;
+    *tail = s;
+    idIndexPut(&g_studentIndex, s->studentId, s);
+    idListPush(&g_studentOrder, s->studentId, s);
+    Department* d = internDepartment(s->department);
+    s->departmentId = d->id;
+    idListPush(&d->students, s->studentId, s);
+    columnsAddStudent(s);
+}
+
+void appendTeacher(Teacher* t, Teacher** tail) {
+    t->next = NULL;
+    if (*tail) (*tail)->next = t;
+    else g_system.teachers = t;
+    *tail = t;
+    idIndexPut(&g_teacherIndex, t->teacherId, t);
+    strIndexPut(&g_teacherEmailIndex, t->email, t);
+    Department* d = internDepartment(t->department);
+    t->departmentId = d->id;
+    idListPush(&d->teachers, t->teacherId, t);
+}
+
+// ---------------------------------------------------------------------------
+// Store mutations (shared by the request handlers and WAL replay)
+// ---------------------------------------------------------------------------
+
+Student* createStudent(int id, const char* name, const char* password, const char* email, const char* department, int year) {
+    Student* stu = (Student*)calloc(1, sizeof(Student));
+    stu->studentId = id;
+    strncpy(stu->name, name, sizeof(stu->name) - 1);
+    strncpy(stu->password, password, sizeof(stu->password) - 1);
+    strncpy(stu->email, email, sizeof(stu->email) - 1);
+    strncpy(stu->department, department, sizeof(stu->department) - 1);
+    stu->year = year;
+    stu->semester = 1;  // default semester
+    stu->cgpa = 0.0;
+    stu->attendance = 0.0;
+    stu->subjectCount = 0;  // no subjects initially
+    addStudent(stu);
+    if (id >= g_system.nextStudentId) g_system.nextStudentId = id + 1;
+    return stu;
+}
+
+Teacher* createTeacher(int id, const char* name, const char* password, const char* email, const char* department) {
+    Teacher* teacher = (Teacher*)calloc(1, sizeof(Teacher));
+    teacher->teacherId = id;
+    strncpy(teacher->name, name, sizeof(teacher->name) - 1);
+    strncpy(teacher->password, password, sizeof(teacher->password) - 1);
+    strncpy(teacher->email, email, sizeof(teacher->email) - 1);
+    strncpy(teacher->department, department, sizeof(teacher->department) - 1);
+    teacher->approved = 0;
+    addTeacher(teacher);
+    if (id >= g_system.nextTeacherId) g_system.nextTeacherId = id + 1;
+    return teacher;
+}
+
+void setTeacherApproval(Teacher* t, int approved, const char* date) {
+    t->approved = approved;
+    authInvalidate();
+    if (date != t->approvalDate) {
+        snprintf(t->approvalDate, sizeof(t->approvalDate), "%s", date);
+    }
+}
+
+void setStudentAcademics(Student* s, double cgpa, double attendance) {
+    Department* d = g_departments.items[s->departmentId];
+    runningRemove(&d->cgpa, s->cgpa);
+    runningAdd(&d->cgpa, cgpa);
+    runningRemove(&d->attendance, s->attendance);
+    runningAdd(&d->attendance, attendance);
+    rankUpdate(&g_cgpaRank, s->cgpa, s->studentId, cgpa);
+    rankUpdate(&g_attendanceRank, s->attendance, s->studentId, attendance);
+    s->cgpa = cgpa;
+    s->attendance = attendance;
+    g_studentColumns.cgpa[s->row] = cgpa;
+    g_studentColumns.attendance[s->row] = attendance;
+}
+
+Subject* assignStudentSubject(Student* s, const char* subjectId, const char* name) {
+    Subject* subj = addStudentSubject(s, subjectId);
+    strncpy(subj->name, name, sizeof(subj->name) - 1);
+    columnsAddSubject(s, subj);
+    SubjectAggregate* agg = g_subjectAggregates.items[g_subjectColumns.subjectKey[subj->row]];
+    rankInsert(&agg->ranking, g_subjectColumns.total[subj->row], s->studentId, s);
+    return subj;
+}
+
+// Empty or NULL remarks keep the existing remarks
+void setSubjectMarks(Student* s, Subject* subj, int mid1, int mid2, int final, double attendance, const char* remarks) {
+    SubjectAggregate* agg = g_subjectAggregates.items[g_subjectColumns.subjectKey[subj->row]];
+    runningRemove(&agg->total, g_subjectColumns.total[subj->row]);
+    runningAdd(&agg->total, mid1 + mid2 + final);
+    rankUpdate(&agg->ranking, g_subjectColumns.total[subj->row], s->studentId, mid1 + mid2 + final);
+    runningRemove(&agg->attendance, subj->attendance_percent);
+    runningAdd(&agg->attendance, attendance);
+    subj->mid1 = mid1;
+    subj->mid2 = mid2;
+    subj->final = final;
+    subj->attendance_percent = attendance;
+    g_subjectColumns.total[subj->row] = mid1 + mid2 + final;
+    g_subjectColumns.attendance[subj->row] = attendance;
+    if (remarks && remarks[0] != '\0') {
+        strncpy(subj->remarks, remarks, sizeof(subj->remarks) - 1);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Write-ahead log
+// ---------------------------------------------------------------------------
+
+// Terminates record lsn; called with g_wal.lock held
+static void walRecordWritten(unsigned long long lsn) {
+    fputs("}\n", g_wal.file);
+    g_wal.writtenLsn = lsn;
+    g_wal.sinceCheckpoint++;
+    // Wake the flusher for the first record of a group, and again once the group is full
+    g_wal.pending++;
+    if (g_wal.pending == 1 || g_wal.pending >= g_config.walSyncBatch) condSignal(&g_wal.flushNeeded);
+}
+
+// Appends one record; the caller holds g_systemLock exclusively.
+// fmt supplies the fields after the LSN, e.g. "\"op\":\"academics\",...".
+unsigned long long walAppend(const char* fmt, ...) {
+    va_list args;
+    mutexLock(&g_wal.lock);
+    if (!g_wal.file) {
+        mutexUnlock(&g_wal.lock);
+        return WAL_LSN_FAILED;
+    }
+    unsigned long long lsn = ++g_wal.nextLsn;
+    fprintf(g_wal.file, "{\"lsn\":%llu,", lsn);
+    va_start(args, fmt);
+    vfprintf(g_wal.file, fmt, args);
+    va_end(args);
+    walRecordWritten(lsn);
+    mutexUnlock(&g_wal.lock);
+    return lsn;
+}
+
+// Streams a record too large to build in memory: walBegin writes its LSN,
+// walWrite appends the fields after it, walEnd terminates it. The caller
+// holds g_systemLock exclusively throughout, so no other record can
+// interleave, and the flusher does not rotate the log while one is open.
+// A crash part way leaves a torn line that replay drops whole.
+unsigned long long walBegin() {
+    mutexLock(&g_wal.lock);
+    if (!g_wal.file) {
+        mutexUnlock(&g_wal.lock);
+        return WAL_LSN_FAILED;
+    }
+    unsigned long long lsn = ++g_wal.nextLsn;
+    fprintf(g_wal.file, "{\"lsn\":%llu,", lsn);
+    g_wal.recordOpen = 1;
+    mutexUnlock(&g_wal.lock);
+    return lsn;
+}
+
+// stdio serializes this against the flusher's fflush. The file cannot
+// change while a record is open; if walBegin failed it stays NULL.
+void walWrite(const char* data, int len) {
+    if (g_wal.file) fwrite(data, 1, len, g_wal.file);
+}
+
+void walEnd(unsigned long long lsn) {
+    if (lsn == WAL_LSN_FAILED) return;
+    mutexLock(&g_wal.lock);
+    walRecordWritten(lsn);
+    g_wal.recordOpen = 0;
+    mutexUnlock(&g_wal.lock);
+}
+
+unsigned long long walLogStudent(Student* s) {
+    char name[600], password[600], email[720], department[480];
+    return walAppend("\"op\":\"student\",\"studentId\":%d,\"name\":\"%s\",\"password\":\"%s\",\"email\":\"%s\",\"department\":\"%s\",\"year\":%d",
+        s->studentId, jsonEscape(s->name, name, sizeof(name)), jsonEscape(s->password, password, sizeof(password)),
+        jsonEscape(s->email, email, sizeof(email)), jsonEscape(s->department, department, sizeof(department)), s->year);
+}
+
+unsigned long long walLogTeacher(Teacher* t) {
+    char name[600], password[600], email[720], department[480];
+    return walAppend("\"op\":\"teacher\",\"teacherId\":%d,\"name\":\"%s\",\"password\":\"%s\",\"email\":\"%s\",\"department\":\"%s\"",
+        t->teacherId, jsonEscape(t->name, name, sizeof(name)), jsonEscape(t->password, password, sizeof(password)),
+        jsonEscape(t->email, email, sizeof(email)), jsonEscape(t->department, department, sizeof(department)));
+}
+
+unsigned long long walLogApproval(Teacher* t) {
+    char date[300];
+    return walAppend("\"op\":\"approval\",\"teacherId\":%d,\"approved\":%d,\"approvalDate\":\"%s\"",
+        t->teacherId, t->approved, jsonEscape(t->approvalDate, date, sizeof(date)));
+}
+
+unsigned long long walLogAcademics(Student* s) {
+    return walAppend("\"op\":\"academics\",\"studentId\":%d,\"cgpa\":%.2f,\"attendance\":%.2f",
+        s->studentId, s->cgpa, s->attendance);
+}
+
+// Subject records carry the full subject state, so assignment and update replay alike
+unsigned long long walLogSubject(Student* s, Subject* subj) {
+    char subjectId[120], name[600], remarks[1200];
+    return walAppend("\"op\":\"subject\",\"studentId\":%d,\"subjectId\":\"%s\",\"name\":\"%s\",\"mid1\":%d,\"mid2\":%d,\"final\":%d,\"attendance_percent\":%.2f,\"remarks\":\"%s\"",
+        s->studentId, jsonEscape(subj->subjectId, subjectId, sizeof(subjectId)), jsonEscape(subj->name, name, sizeof(name)),
+        subj->mid1, subj->mid2, subj->final, subj->attendance_percent, jsonEscape(subj->remarks, remarks, sizeof(remarks)));
+}
+
+// A whole batch is one record, so replay applies all of it or none
+unsigned long long walLogMarks(MarkRow* rows, int count) {
+    OutBuffer batch = {NULL, 0, 0};
+    jsonOpen(&batch, NULL, '[');
+    for (int i = 0; i < count; i++) {
+        jsonOpen(&batch, NULL, '{');
+        jsonPutInt(&batch, "studentId", rows[i].student->studentId);
+        jsonPutString(&batch, "subjectId", rows[i].subject->subjectId);
+        jsonPutInt(&batch, "mid1", rows[i].subject->mid1);
+        jsonPutInt(&batch, "mid2", rows[i].subject->mid2);
+        jsonPutInt(&batch, "final", rows[i].subject->final);
+        jsonPutNumber(&batch, "attendance_percent", rows[i].subject->attendance_percent);
+        jsonPutString(&batch, "remarks", rows[i].subject->remarks);
+        jsonClose(&batch, '}');
+    }
+    jsonClose(&batch, ']');
+    unsigned long long lsn = walAppend("\"op\":\"marks\",\"rows\":%.*s", batch.len, batch.data);
+    free(batch.data);
+    return lsn;
+}
+
+static void walRefuseCommit(Request* r) {
+    sendResponse(r, 503, "{\"error\":\"Change could not be made durable; the write-ahead log has failed\"}");
+}
+
+// Parks a response until its record is on stable storage; the flusher then
+// finishes it. Returns 0 if the caller should finish it now: the record is
+// already durable, or the log failed and the response is now a 503.
+int walDeferResponse(Request* r) {
+    mutexLock(&g_wal.lock);
+    int durable = g_wal.durableLsn >= r->walLsn;
+    int failed = g_wal.failed;
+    if (!durable && !failed) {
+        r->next = g_wal.committing;
+        g_wal.committing = r;
+    }
+    mutexUnlock(&g_wal.lock);
+    if (!durable && failed) walRefuseCommit(r);
+    return !durable && !failed;
+}
+
+// Unlinks the parked responses whose records are durable, or all of them
+// once the log has failed. Called with g_wal.lock held.
+static Request* walTakeCommitted() {
+    Request* done = NULL;
+    Request** link = &g_wal.committing;
+    while (*link) {
+        Request* r = *link;
+        if (r->walLsn <= g_wal.durableLsn || g_wal.failed) {
+            *link = r->next;
+            r->next = done;
+            done = r;
+        } else {
+            link = &r->next;
+        }
+    }
+    return done;
+}
+
+int walFailed() {
+    return atomicLoadAcquire(&g_wal.failed);
+}
+
+// Re-applies one logged mutation. Every record is idempotent: creations
+// skip ids that already exist and updates carry absolute values.
+void walReplayRecord(char* line) {
+    JsonObject rec;
+    char op[32];
+    jsonParse(&rec, line, (int)strlen(line));
+    jsonString(&rec, "op", op, sizeof(op));
+
+    if (strcmp(op, "student") == 0) {
+        int id = jsonInt(&rec, "studentId");
+        if (findStudent(id)) return;
+        char name[100], password[100], email[120], department[80];
+        jsonString(&rec, "name", name, sizeof(name));
+        jsonString(&rec, "password", password, sizeof(password));
+        jsonString(&rec, "email", email, sizeof(email));
+        jsonString(&rec, "department", department, sizeof(department));
+        createStudent(id, name, password, email, department, jsonInt(&rec, "year"));
+    } else if (strcmp(op, "teacher") == 0) {
+        int id = jsonInt(&rec, "teacherId");
+        if (findTeacher(id)) return;
+        char name[100], password[100], email[120], department[80];
+        jsonString(&rec, "name", name, sizeof(name));
+        jsonString(&rec, "password", password, sizeof(password));
+        jsonString(&rec, "email", email, sizeof(email));
+        jsonString(&rec, "department", department, sizeof(department));
+        createTeacher(id, name, password, email, department);
+    } else if (strcmp(op, "approval") == 0) {
+        Teacher* t = findTeacher(jsonInt(&rec, "teacherId"));
+        if (!t) return;
+        char date[50];
+        jsonString(&rec, "approvalDate", date, sizeof(date));
+        setTeacherApproval(t, jsonInt(&rec, "approved"), date);
+    } else if (strcmp(op, "academics") == 0) {
+        Student* s = findStudent(jsonInt(&rec, "studentId"));
+        if (!s) return;
+        setStudentAcademics(s, jsonNumber(&rec, "cgpa"), jsonNumber(&rec, "attendance"));
+    } else if (strcmp(op, "subject") == 0) {
+        Student* s = findStudent(jsonInt(&rec, "studentId"));
+        if (!s) return;
+        char subjectId[20], name[100], remarks[200];
+        jsonString(&rec, "subjectId", subjectId, sizeof(subjectId));
+        jsonString(&rec, "name", name, sizeof(name));
+        jsonString(&rec, "remarks", remarks, sizeof(remarks));
+        Subject* subj = findStudentSubject(s, subjectId);
+        if (!subj) subj = assignStudentSubject(s, subjectId, name);
+        if (!subj) return;
+        setSubjectMarks(s, subj, jsonInt(&rec, "mid1"), jsonInt(&rec, "mid2"), jsonInt(&rec, "final"),
+                        jsonNumber(&rec, "attendance_percent"), remarks);
+    } else if (strcmp(op, "marks") == 0) {
+        JsonField* rows = jsonFind(&rec, "rows");
+        if (!rows || rows->type != JSON_ARRAY) return;
+        const char* end = rows->value + rows->valueLen;
+        const char* p = jsonSkipSpace(rows->value + 1, end);
+        JsonObject row;
+        while (p < end && *p == '{') {
+            p = jsonParseObject(&row, p, end);
+            if (!p) return;
+            char subjectId[20], remarks[200];
+            jsonString(&row, "subjectId", subjectId, sizeof(subjectId));
+            jsonString(&row, "remarks", remarks, sizeof(remarks));
+            Student* s = findStudent(jsonInt(&row, "studentId"));
+            Subject* subj = s ? findStudentSubject(s, subjectId) : NULL;
+            if (subj) {
+                setSubjectMarks(s, subj, jsonInt(&row, "mid1"), jsonInt(&row, "mid2"), jsonInt(&row, "final"),
+                                jsonNumber(&row, "attendance_percent"), remarks);
+            }
+            p = jsonSkipSpace(p, end);
+            if (p < end && *p == ',') p = jsonSkipSpace(p + 1, end);
+        }
+    } else if (strcmp(op, "import") == 0) {
+        char kindName[16];
+        jsonString(&rec, "kind", kindName, sizeof(kindName));
+        int kind = importKind(kindName);
+        JsonField* rows = jsonFind(&rec, "rows");
+        if (kind < 0 || !rows || rows->type != JSON_ARRAY) return;
+        const char* end = rows->value + rows->valueLen;
+        const char* p = jsonSkipSpace(rows->value + 1, end);
+        JsonObject obj;
+        ImportRow row;
+        while (p < end && *p == '{') {
+            p = jsonParseObject(&obj, p, end);
+            if (!p) return;
+            memset(&row, 0, sizeof(row));
+            importParseObject(&obj, &row);
+            importApplyRow(kind, &row, NULL);
+            p = jsonSkipSpace(p, end);
+            if (p < end && *p == ',') p = jsonSkipSpace(p + 1, end);
+        }
+    }
+}
+
+// Applies the records of one log file that are newer than the checkpoint
+int walReplayFile(const char* path) {
+    int replayed = 0;
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    // Batch records can be long, so lines grow past BUFFER_SIZE as needed
+    int cap = BUFFER_SIZE;
+    char* line = (char*)malloc(cap);
+    while (fgets(line, cap, f)) {
+        int len = (int)strlen(line);
+        while (line[len - 1] != '\n' && len == cap - 1) {
+            cap *= 2;
+            line = (char*)realloc(line, cap);
+            if (!fgets(line + len, cap - len, f)) break;
+            len += (int)strlen(line + len);
+        }
+        if (line[len - 1] != '\n') break;  // torn final record from a crash
+        unsigned long long lsn = strtoull(line + 7, NULL, 10);  // records start with {"lsn":
+        if (lsn <= g_wal.checkpointLsn) continue;
+        walReplayRecord(line);
+        if (lsn > g_wal.writtenLsn) g_wal.nextLsn = g_wal.writtenLsn = g_wal.durableLsn = lsn;
+        replayed++;
+    }
+    free(line);
+    fclose(f);
+    if (replayed > 0) {
+        logInfo("wal_replayed", "records=%d file=%s", replayed, path);
+    }
+    return replayed;
+}
+
+// Replays records newer than the loaded checkpoint (including a segment left
+// by an interrupted checkpoint), folds them into a fresh checkpoint, and
+// opens an empty log for appending. Runs before the workers start.
+int walOpen() {
+    mutexInit(&g_wal.lock);
+    condInit(&g_wal.flushNeeded);
+    condInit(&g_wal.checkpointNeeded);
+    g_wal.nextLsn = g_wal.writtenLsn = g_wal.durableLsn = g_wal.checkpointLsn;
+
+    walReplayFile(WAL_OLD_FILE);
+    walReplayFile(WAL_FILE);
+    if (saveToFile(g_wal.writtenLsn) != 0) return -1;
+    g_wal.checkpointLsn = g_wal.writtenLsn;
+    remove(WAL_OLD_FILE);
+
+    g_wal.file = fopen(WAL_FILE, "w");
+    if (!g_wal.file) return -1;
+    g_wal.lastCheckpoint = nowMillis();
+    return 0;
+}
+
+// Called with g_wal.lock held once no log segment can be kept open. From
+// here on mutations get 503, and the flusher answers parked commits with 503.
+static void walFail(const char* step) {
+    g_wal.file = NULL;
+    atomicStoreRelease(&g_wal.failed, 1);
+    logError("wal_failed", "step=%s errno=%d", step, errno);
+}
+
+// Moves the synced segment to WAL_OLD_FILE and opens a fresh WAL_FILE.
+// Returns 0 once switched, or -1 with the old segment still the log (or
+// the log failed).
+static int walSwitchSegment() {
+#ifndef _WIN32
+    // An open file can be renamed here, so the old segment is only let go
+    // once the new one is open
+    if (fileReplace(WAL_FILE, WAL_OLD_FILE) != 0) return -1;
+    FILE* next = fopen(WAL_FILE, "w");
+    if (!next) {
+        logError("wal_rotate_failed", "step=open errno=%d", errno);
+        if (fileReplace(WAL_OLD_FILE, WAL_FILE) == 0) return -1;  // keep appending to it
+        fclose(g_wal.file);
+        walFail("restore");
+        return -1;
+    }
+    fclose(g_wal.file);
+    g_wal.file = next;
+    return 0;
+#else
+    // Windows cannot rename an open file: close it first, and reopen it for
+    // appending if the new segment cannot be had
+    fclose(g_wal.file);
+    g_wal.file = NULL;
+    if (fileReplace(WAL_FILE, WAL_OLD_FILE) == 0) {
+        g_wal.file = fopen(WAL_FILE, "w");
+        if (g_wal.file) return 0;
+        logError("wal_rotate_failed", "step=open errno=%d", errno);
+        if (fileReplace(WAL_OLD_FILE, WAL_FILE) != 0) {
+            walFail("restore");
+            return -1;
+        }
+    }
+    g_wal.file = fopen(WAL_FILE, "a");
+    if (!g_wal.file) walFail("reopen");
+    return -1;
+#endif
+}
+
+// Starts a checkpoint: the current log becomes WAL_OLD_FILE and new records go
+// to a fresh log. Called by the flusher with g_wal.lock held, so no fsync of
+// the outgoing file can be in flight.
+void walRotate() {
+    if (!g_wal.oldLogPending) {
+        fflush(g_wal.file);
+        fileSyncFd(fileno(g_wal.file));
+        g_wal.durableLsn = g_wal.writtenLsn;
+        g_wal.pending = 0;
+        if (walSwitchSegment() != 0) {
+            // Keep logging to the old segment; retry after another interval
+            g_wal.sinceCheckpoint = 0;
+            g_wal.lastCheckpoint = nowMillis();
+            return;
+        }
+        g_wal.snapshotLsn = g_wal.writtenLsn;
+        g_wal.oldLogPending = 1;
+    }
+    // else a failed checkpoint still owns WAL_OLD_FILE: retry from its LSN
+    g_wal.sinceCheckpoint = 0;
+    g_wal.checkpointRunning = 1;
+    condSignal(&g_wal.checkpointNeeded);
+}
+
+// Writes a snapshot covering everything up to snapshotLsn, then drops the
+// rotated log segment. Runs on its own thread so commits keep flowing.
+void checkpoint() {
+    mutexLock(&g_wal.lock);
+    unsigned long long lsn = g_wal.snapshotLsn;
+    mutexUnlock(&g_wal.lock);
+
+    int ok = saveToFile(lsn) == 0;
+    if (ok) remove(WAL_OLD_FILE);
+
+    mutexLock(&g_wal.lock);
+    if (ok) {
+        g_wal.oldLogPending = 0;
+        g_wal.checkpointLsn = lsn;
+    }
+    g_wal.checkpointRunning = 0;
+    g_wal.lastCheckpoint = nowMillis();
+    mutexUnlock(&g_wal.lock);
+
+    if (ok) {
+        logInfo("checkpoint", "lsn=%llu bytes=%lld ms=%lld", lsn, g_snapshotStats.lastBytes, g_snapshotStats.lastDurationMs);
+    } else {
+        logError("checkpoint_failed", "lsn=%llu wal=kept", lsn);
+    }
+}
+
+static THREAD_RETURN checkpointerMain(void* arg) {
+    (void)arg;
+    for (;;) {
+        mutexLock(&g_wal.lock);
+        while (!g_wal.checkpointRunning) condWait(&g_wal.checkpointNeeded, &g_wal.lock);
+        mutexUnlock(&g_wal.lock);
+        checkpoint();
+    }
+    return 0;
+}
+
+// Group commit: one fsync covers every record appended since the last one,
+// and then every response parked on those records is finished here
+static THREAD_RETURN walFlusherMain(void* arg) {
+    MetricsShard* metrics = (MetricsShard*)arg;
+    for (;;) {
+        mutexLock(&g_wal.lock);
+        if (g_wal.failed) {  // nothing left to sync; mutations are refused
+            condWaitMs(&g_wal.flushNeeded, &g_wal.lock, IDLE_SWEEP_MS);
+            mutexUnlock(&g_wal.lock);
+            continue;
+        }
+        if (g_wal.writtenLsn == g_wal.durableLsn) {
+            condWaitMs(&g_wal.flushNeeded, &g_wal.lock, IDLE_SWEEP_MS);  // idle: wake for checkpoints
+        }
+        if (g_wal.pending > 0 && g_wal.pending < g_config.walSyncBatch && g_config.walSyncMs > 0) {
+            condWaitMs(&g_wal.flushNeeded, &g_wal.lock, g_config.walSyncMs);  // let the group fill
+        }
+        unsigned long long target = g_wal.writtenLsn;
+        if (target > g_wal.durableLsn) {
+            fflush(g_wal.file);
+            g_wal.pending = 0;
+            mutexUnlock(&g_wal.lock);
+            fileSyncFd(fileno(g_wal.file));
+            mutexLock(&g_wal.lock);
+            if (target > g_wal.durableLsn) g_wal.durableLsn = target;
+        }
+        int due = !g_wal.checkpointRunning && !g_wal.recordOpen && g_wal.sinceCheckpoint > 0 &&
+                  (g_wal.sinceCheckpoint >= g_config.checkpointRecords ||
+                   nowMillis() - g_wal.lastCheckpoint >= (long long)g_config.checkpointSec * 1000);
+        if (due) walRotate();
+        unsigned long long durableLsn = g_wal.durableLsn;
+        Request* done = walTakeCommitted();
+        mutexUnlock(&g_wal.lock);
+        while (done) {
+            Request* r = done;
+            done = r->next;
+            if (r->walLsn > durableLsn) walRefuseCommit(r);
+            requestFinish(metrics, r);
+        }
+    }
+    return 0;
+}
+
+int walStartFlusher() {
+#ifdef _WIN32
+    HANDLE h = CreateThread(NULL, 0, walFlusherMain, &g_metrics[g_metricsShards - 1], 0, NULL);
+    if (h == NULL) return -1;
+    CloseHandle(h);
+    h = CreateThread(NULL, 0, checkpointerMain, NULL, 0, NULL);
+    if (h == NULL) return -1;
+    CloseHandle(h);
+#else
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, walFlusherMain, &g_metrics[g_metricsShards - 1]) != 0) return -1;
+    pthread_detach(tid);
+    if (pthread_create(&tid, NULL, checkpointerMain, NULL) != 0) return -1;
+    pthread_detach(tid);
+#endif
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Bulk import and export
+// ---------------------------------------------------------------------------
+
+static const char* g_importColumns[COL_COUNT] = {
+    "studentId", "teacherId", "name", "password", "email", "department",
+    "year", "semester", "cgpa", "attendance", "approved", "approvalDate",
+    "subjectId", "mid1", "mid2", "final", "attendance_percent", "remarks"
+};
+
+static const char* g_importKinds[] = {"students", "teachers", "marks"};
+
+// Columns a CSV header must name, per kind. Rows without a password get
+// the default one for their role, as exports carry no passwords.
+static const int g_importRequired[] = {
+    (1 << COL_NAME) | (1 << COL_YEAR),
+    (1 << COL_NAME) | (1 << COL_EMAIL),
+    (1 << COL_STUDENT_ID) | (1 << COL_SUBJECT_ID)
+};
+
+#define COL_NUMERIC ((1 << COL_STUDENT_ID) | (1 << COL_TEACHER_ID) | (1 << COL_YEAR) | (1 << COL_SEMESTER) | \
+                     (1 << COL_CGPA) | (1 << COL_ATTENDANCE) | (1 << COL_APPROVED) | (1 << COL_MID1) | \
+                     (1 << COL_MID2) | (1 << COL_FINAL) | (1 << COL_ATTENDANCE_PERCENT))
+
+int importColumn(const char* name, int len) {
+    for (int c = 0; c < COL_COUNT; c++) {
+        if ((int)strlen(g_importColumns[c]) == len && memcmp(g_importColumns[c], name, len) == 0) return c;
+    }
+    return -1;
+}
+
+int importKind(const char* name) {
+    for (int k = 0; k < 3; k++) {
+        if (strcmp(name, g_importKinds[k]) == 0) return k;
+    }
+    return -1;
+}
+
+static void importCopy(char* dest, int size, const char* text) {
+    snprintf(dest, size, "%s", text);
+}
+
+// Stores one field of a row. Empty values count as not given.
+static void importSetField(ImportRow* row, int col, const char* text) {
+    double number = 0;
+    if (text[0] == '\0') return;
+    if (COL_NUMERIC & (1 << col)) {
+        char* end;
+        if (col == COL_APPROVED && strcmp(text, "true") == 0) text = "1";
+        if (col == COL_APPROVED && strcmp(text, "false") == 0) text = "0";
+        number = strtod(text, &end);
+        if (end == text || *end != '\0') {
+            if (!row->error[0]) snprintf(row->error, sizeof(row->error), "%s is not a number", g_importColumns[col]);
+            return;
+        }
+    }
+    row->present |= 1 << col;
+    switch (col) {
+        case COL_STUDENT_ID:
+        case COL_TEACHER_ID: row->id = (int)number; break;
+        case COL_NAME: importCopy(row->name, sizeof(row->name), text); break;
+        case COL_PASSWORD: importCopy(row->password, sizeof(row->password), text); break;
+        case COL_EMAIL: importCopy(row->email, sizeof(row->email), text); break;
+        case COL_DEPARTMENT: importCopy(row->department, sizeof(row->department), text); break;
+        case COL_YEAR: row->year = (int)number; break;
+        case COL_SEMESTER: row->semester = (int)number; break;
+        case COL_CGPA: row->cgpa = number; break;
+        case COL_ATTENDANCE:
+        case COL_ATTENDANCE_PERCENT: row->attendance = number; break;
+        case COL_APPROVED: row->approved = (int)number; break;
+        case COL_APPROVAL_DATE: importCopy(row->approvalDate, sizeof(row->approvalDate), text); break;
+        case COL_SUBJECT_ID: importCopy(row->subjectId, sizeof(row->subjectId), text); break;
+        case COL_MID1: row->mid1 = (int)number; break;
+        case COL_MID2: row->mid2 = (int)number; break;
+        case COL_FINAL: row->final = (int)number; break;
+        case COL_REMARKS: importCopy(row->remarks, sizeof(row->remarks), text); break;
+    }
+}
+
+// Copies the CSV field starting at p into field (size bytes), unquoting it
+// ("" inside quotes is one quote) and trimming spaces around unquoted text.
+// Returns the position of the comma that ends it, or end.
+static const char* csvField(const char* p, const char* end, char* field, int size) {
+    int n = 0;
+    if (p < end && *p == '"') {
+        for (p++; p < end; p++) {
+            if (*p == '"') {
+                if (p + 1 < end && p[1] == '"') p++;
+                else break;
+            }
+            if (n < size - 1) field[n++] = *p;
+        }
+        while (p < end && *p != ',') p++;
+    } else {
+        while (p < end && *p == ' ') p++;
+        while (p < end && *p != ',') {
+            if (n < size - 1) field[n++] = *p;
+            p++;
+        }
+        while (n > 0 && field[n - 1] == ' ') n--;
+    }
+    field[n] = '\0';
+    return p;
+}
+
+static void importParseCsv(ImportChunk* chunk, const char* p, int len, ImportRow* row) {
+    const char* end = p + len;
+    char field[256];
+    for (int c = 0; ; c++) {
+        p = csvField(p, end, field, sizeof(field));
+        if (c < chunk->columnCount && chunk->columns[c] >= 0) importSetField(row, chunk->columns[c], field);
+        if (p >= end) break;
+        p++;
+    }
+}
+
+// Fills a row from a parsed object; unknown keys are ignored
+void importParseObject(JsonObject* obj, ImportRow* row) {
+    char field[256];
+    for (int i = 0; i < obj->count; i++) {
+        int col = importColumn(obj->fields[i].key, obj->fields[i].keyLen);
+        if (col < 0) continue;
+        jsonString(obj, g_importColumns[col], field, sizeof(field));
+        importSetField(row, col, field);
+    }
+}
+
+// Checks a row on its own; the checks against the store come later, in
+// importCheckStore. Runs on the helper threads without g_systemLock.
+static void importValidate(int kind, ImportRow* row) {
+    const char* error = NULL;
+    if (row->error[0]) return;
+    if (kind == IMPORT_STUDENTS) {
+        if (!row->name[0] || row->year < 1 || row->year > 6) {
+            error = "name and year 1-6 are required";
+        } else if (row->password[0] && strlen(row->password) < 4) {
+            error = "password must be 4+ characters";
+        } else if ((row->present & (1 << COL_CGPA)) && (row->cgpa < 0 || row->cgpa > 10)) {
+            error = "cgpa must be 0-10";
+        } else if ((row->present & (1 << COL_ATTENDANCE)) && (row->attendance < 0 || row->attendance > 100)) {
+            error = "attendance must be 0-100";
+        } else if ((row->present & (1 << COL_STUDENT_ID)) && row->id <= 0) {
+            error = "studentId must be positive";
+        }
+    } else if (kind == IMPORT_TEACHERS) {
+        if (!row->name[0] || !row->email[0]) {
+            error = "name and email are required";
+        } else if (row->password[0] && strlen(row->password) < 4) {
+            error = "password must be 4+ characters";
+        } else if (row->approved != 0 && row->approved != 1) {
+            error = "approved must be 0 or 1";
+        } else if ((row->present & (1 << COL_TEACHER_ID)) && row->id <= 0) {
+            error = "teacherId must be positive";
+        }
+    } else {
+        if (!(row->present & (1 << COL_STUDENT_ID))) {
+            error = "studentId is required";
+        } else if (!row->subjectId[0]) {
+            error = "subjectId is required";
+        } else if (row->mid1 < 0 || row->mid2 < 0 || row->final < 0 || row->attendance < 0 || row->attendance > 100) {
+            error = "marks must be non-negative, attendance 0-100";
+        }
+    }
+    if (error) importCopy(row->error, sizeof(row->error), error);
+}
+
+// Returns the next non-blank line at or after *p with its length (line ending
+// and surrounding spaces stripped) and 1-based line number, and advances *p
+// past it; NULL at the end. CSV lines may hold newlines in quoted fields.
+static const char* importNextLine(const char** p, const char* end, int csv, int* len, int* lineNumber, int* line) {
+    while (*p < end) {
+        const char* start = *p;
+        const char* q = start;
+        int quoted = 0;
+        *line = ++*lineNumber;
+        while (q < end && (quoted || *q != '\n')) {
+            if (csv && *q == '"') quoted = !quoted;
+            else if (*q == '\n') ++*lineNumber;
+            q++;
+        }
+        const char* stop = q;
+        *p = q < end ? q + 1 : q;
+        while (stop > start && (stop[-1] == '\r' || stop[-1] == ' ' || stop[-1] == '\t')) stop--;
+        while (start < stop && (*start == ' ' || *start == '\t')) start++;
+        if (stop > start) {
+            *len = (int)(stop - start);
+            return start;
+        }
+    }
+    return NULL;
+}
+
+// Splits the next IMPORT_CHUNK_ROWS lines into the chunk; returns the count
+static int importFillChunk(ImportChunk* chunk, const char** p, const char* end, int* lineNumber) {
+    chunk->count = 0;
+    while (chunk->count < IMPORT_CHUNK_ROWS) {
+        int i = chunk->count;
+        chunk->lines[i] = importNextLine(p, end, chunk->format == FORMAT_CSV, &chunk->lengths[i], lineNumber, &chunk->lineNumbers[i]);
+        if (!chunk->lines[i]) break;
+        chunk->count++;
+    }
+    return chunk->count;
+}
+
+// Parses (and when chunk->validate is set, validates) rows from..to-1
+static void importParseRows(ImportChunk* chunk, int from, int to) {
+    for (int i = from; i < to; i++) {
+        ImportRow* row = &chunk->rows[i];
+        const char* line = chunk->lines[i];
+        memset(row, 0, sizeof(ImportRow));
+        row->line = chunk->lineNumbers[i];
+        if (chunk->format == FORMAT_CSV) {
+            importParseCsv(chunk, line, chunk->lengths[i], row);
+        } else {
+            JsonObject obj;
+            if (jsonParseObject(&obj, line, line + chunk->lengths[i])) importParseObject(&obj, row);
+            else importCopy(row->error, sizeof(row->error), "Malformed JSON object");
+        }
+        if (chunk->validate) importValidate(chunk->kind, row);
+    }
+}
+
+typedef struct {
+    struct ImportPool* pool;
+    int from;
+    int to;
+} ImportSlice;
+
+// Helper threads for one import, started once and woken for each chunk.
+// Helper t parses slices[t]; the importing thread takes the last slice.
+typedef struct ImportPool {
+    Mutex lock;
+    CondVar work;      // a chunk was posted, or stop was set
+    CondVar idle;      // the last busy helper finished its slice
+    ImportChunk* chunk;
+    int threads;       // slices per chunk: the helpers that started, plus one
+    int round;         // chunks posted so far
+    int busy;          // helpers still on the current chunk
+    int stop;
+    ImportSlice slices[IMPORT_MAX_THREADS];
+#ifdef _WIN32
+    HANDLE helpers[IMPORT_MAX_THREADS];
+#else
+    pthread_t helpers[IMPORT_MAX_THREADS];
+#endif
+} ImportPool;
+
+static THREAD_RETURN importHelperMain(void* arg) {
+    ImportSlice* slice = (ImportSlice*)arg;
+    ImportPool* pool = slice->pool;
+    int seen = 0;
+    mutexLock(&pool->lock);
+    for (;;) {
+        while (pool->round == seen && !pool->stop) condWait(&pool->work, &pool->lock);
+        if (pool->stop) break;
+        seen = pool->round;
+        mutexUnlock(&pool->lock);
+        importParseRows(pool->chunk, slice->from, slice->to);
+        mutexLock(&pool->lock);
+        if (--pool->busy == 0) condSignal(&pool->idle);
+    }
+    mutexUnlock(&pool->lock);
+    return 0;
+}
+
+// Starts up to threads - 1 helpers. A helper that fails to start is not
+// waited for: the chunks are split over the ones that did.
+static void importPoolStart(ImportPool* pool, int threads) {
+    memset(pool, 0, sizeof(ImportPool));
+    mutexInit(&pool->lock);
+    condInit(&pool->work);
+    condInit(&pool->idle);
+    int started = 0;
+    while (started < threads - 1) {
+        pool->slices[started].pool = pool;
+#ifdef _WIN32
+        pool->helpers[started] = CreateThread(NULL, 0, importHelperMain, &pool->slices[started], 0, NULL);
+        if (pool->helpers[started] == NULL) break;
+#else
+        if (pthread_create(&pool->helpers[started], NULL, importHelperMain, &pool->slices[started]) != 0) break;
+#endif
+        started++;
+    }
+    if (started < threads - 1) logWarn("import_threads_short", "started=%d wanted=%d", started, threads - 1);
+    pool->threads = started + 1;
+}
+
+static void importPoolStop(ImportPool* pool) {
+    mutexLock(&pool->lock);
+    pool->stop = 1;
+    condBroadcast(&pool->work);
+    mutexUnlock(&pool->lock);
+    for (int t = 0; t < pool->threads - 1; t++) {
+#ifdef _WIN32
+        WaitForSingleObject(pool->helpers[t], INFINITE);
+        CloseHandle(pool->helpers[t]);
+#else
+        pthread_join(pool->helpers[t], NULL);
+#endif
+    }
+    mutexDestroy(&pool->lock);
+    condDestroy(&pool->work);
+    condDestroy(&pool->idle);
+}
+
+// Parses a chunk's rows split across the pool; small chunks stay on this
+// thread
+static void importParseChunk(ImportPool* pool, ImportChunk* chunk) {
+    int threads = chunk->count < 256 ? 1 : pool->threads;
+    int per = (chunk->count + threads - 1) / threads;
+    if (threads == 1) {
+        importParseRows(chunk, 0, chunk->count);
+        return;
+    }
+    mutexLock(&pool->lock);
+    pool->chunk = chunk;
+    for (int t = 0; t < threads - 1; t++) {
+        pool->slices[t].from = t * per < chunk->count ? t * per : chunk->count;
+        pool->slices[t].to = (t + 1) * per < chunk->count ? (t + 1) * per : chunk->count;
+    }
+    pool->busy = threads - 1;
+    pool->round++;
+    condBroadcast(&pool->work);
+    mutexUnlock(&pool->lock);
+    importParseRows(chunk, (threads - 1) * per < chunk->count ? (threads - 1) * per : chunk->count, chunk->count);
+    mutexLock(&pool->lock);
+    while (pool->busy > 0) condWait(&pool->idle, &pool->lock);
+    mutexUnlock(&pool->lock);
+}
+
+// Applies one validated row. A live import passes wal and gets the row as
+// applied (with the ids the server assigned) appended to it; replay passes
+// NULL, and like the other WAL records skips creations that already exist.
+void importApplyRow(int kind, ImportRow* row, OutBuffer* wal) {
+    if (kind == IMPORT_STUDENTS) {
+        int id = (row->present & (1 << COL_STUDENT_ID)) ? row->id : g_system.nextStudentId;
+        if (findStudent(id)) return;
+        Student* s = createStudent(id, row->name, row->password[0] ? row->password : DEFAULT_STUDENT_PASSWORD,
+                                   row->email, row->department, row->year);
+        if (row->present & (1 << COL_SEMESTER)) s->semester = row->semester;
+        if (row->present & ((1 << COL_CGPA) | (1 << COL_ATTENDANCE))) {
+            setStudentAcademics(s, (row->present & (1 << COL_CGPA)) ? row->cgpa : s->cgpa,
+                                (row->present & (1 << COL_ATTENDANCE)) ? row->attendance : s->attendance);
+        }
+        if (!wal) return;
+        jsonOpen(wal, NULL, '{');
+        jsonPutInt(wal, "studentId", s->studentId);
+        jsonPutString(wal, "name", s->name);
+        jsonPutString(wal, "password", s->password);
+        jsonPutString(wal, "email", s->email);
+        jsonPutString(wal, "department", s->department);
+        jsonPutInt(wal, "year", s->year);
+        jsonPutInt(wal, "semester", s->semester);
+        jsonPutNumber(wal, "cgpa", s->cgpa);
+        jsonPutNumber(wal, "attendance", s->attendance);
+        jsonClose(wal, '}');
+    } else if (kind == IMPORT_TEACHERS) {
+        int id = (row->present & (1 << COL_TEACHER_ID)) ? row->id : g_system.nextTeacherId;
+        if (findTeacher(id)) return;
+        Teacher* t = createTeacher(id, row->name, row->password[0] ? row->password : TEACHER_PASSWORD,
+                                   row->email, row->department);
+        if (row->approved) {
+            char date[50];
+            if (row->approvalDate[0]) importCopy(date, sizeof(date), row->approvalDate);
+            else getCurrentTimestamp(date);
+            setTeacherApproval(t, 1, date);
+        }
+        if (!wal) return;
+        jsonOpen(wal, NULL, '{');
+        jsonPutInt(wal, "teacherId", t->teacherId);
+        jsonPutString(wal, "name", t->name);
+        jsonPutString(wal, "password", t->password);
+        jsonPutString(wal, "email", t->email);
+        jsonPutString(wal, "department", t->department);
+        jsonPutInt(wal, "approved", t->approved);
+        jsonPutString(wal, "approvalDate", t->approvalDate);
+        jsonClose(wal, '}');
+    } else {
+        Student* s = findStudent(row->id);
+        if (!s) return;
+        Subject* subj = findStudentSubject(s, row->subjectId);
+        if (!subj) subj = assignStudentSubject(s, row->subjectId, row->name);
+        if (!subj) return;
+        // Columns left out keep their current values
+        setSubjectMarks(s, subj,
+                        (row->present & (1 << COL_MID1)) ? row->mid1 : subj->mid1,
+                        (row->present & (1 << COL_MID2)) ? row->mid2 : subj->mid2,
+                        (row->present & (1 << COL_FINAL)) ? row->final : subj->final,
+                        (row->present & (1 << COL_ATTENDANCE_PERCENT)) ? row->attendance : subj->attendance_percent,
+                        (row->present & (1 << COL_REMARKS)) ? row->remarks : subj->remarks);
+        if (!wal) return;
+        jsonOpen(wal, NULL, '{');
+        jsonPutInt(wal, "studentId", s->studentId);
+        jsonPutString(wal, "subjectId", subj->subjectId);
+        jsonPutString(wal, "name", subj->name);
+        jsonPutInt(wal, "mid1", subj->mid1);
+        jsonPutInt(wal, "mid2", subj->mid2);
+        jsonPutInt(wal, "final", subj->final);
+        jsonPutNumber(wal, "attendance_percent", subj->attendance_percent);
+        jsonPutString(wal, "remarks", subj->remarks);
+        jsonClose(wal, '}');
+    }
+}
+
+typedef struct {
+    int line;
+    const char* error;
+} ImportFailure;
+
+typedef struct {
+    ImportFailure* items;
+    int count;
+    int capacity;
+} ImportFailures;
+
+static void importFail(ImportFailures* failures, void* line, const char* error) {
+    if (failures->count == failures->capacity) {
+        failures->capacity = failures->capacity ? failures->capacity * 2 : 16;
+        failures->items = (ImportFailure*)realloc(failures->items, failures->capacity * sizeof(ImportFailure));
+    }
+    failures->items[failures->count].line = (int)(size_t)line;
+    failures->items[failures->count].error = error;
+    failures->count++;
+}
+
+static int compareImportFailures(const void* a, const void* b) {
+    int x = ((const ImportFailure*)a)->line;
+    int y = ((const ImportFailure*)b)->line;
+    return (x > y) - (x < y);
+}
+
+// Checks the ids and keys pass 1 collected (each mapped to the first line
+// naming it) against the store, with g_systemLock held exclusively. Leaves
+// the failures in line order, one per line.
+static void importCheckStore(int kind, IdIndex* ids, StrIndex* keys, ImportFailures* failures) {
+    for (int i = 0; i < ids->capacity; i++) {
+        IdIndexSlot* slot = &ids->slots[i];
+        if (!slot->value) continue;
+        if (kind == IMPORT_STUDENTS && findStudent(slot->key)) importFail(failures, slot->value, "studentId already exists");
+        if (kind == IMPORT_TEACHERS && findTeacher(slot->key)) importFail(failures, slot->value, "teacherId already exists");
+        if (kind == IMPORT_MARKS && !findStudent(slot->key)) importFail(failures, slot->value, "Student not found");
+    }
+    for (int i = 0; i < keys->capacity; i++) {
+        StrIndexSlot* slot = &keys->slots[i];
+        if (!slot->value) continue;
+        if (kind == IMPORT_TEACHERS && findTeacherByEmail(slot->key)) {
+            importFail(failures, slot->value, "Email already registered");
+        } else if (kind == IMPORT_MARKS) {
+            // "studentId/subjectId" of a row that names no subject
+            const char* subjectId = strchr(slot->key, '/') + 1;
+            Student* s = findStudent(atoi(slot->key));
+            if (s && !findStudentSubject(s, subjectId)) importFail(failures, slot->value, "name is required to assign a new subject");
+        }
+    }
+    if (failures->count > 1) qsort(failures->items, failures->count, sizeof(ImportFailure), compareImportFailures);
+    int kept = 0;
+    for (int i = 0; i < failures->count; i++) {
+        if (kept == 0 || failures->items[kept - 1].line != failures->items[i].line) failures->items[kept++] = failures->items[i];
+    }
+    failures->count = kept;
+}
+
+static void importListError(OutBuffer* errors, int line, const char* error) {
+    jsonOpen(errors, NULL, '{');
+    jsonPutInt(errors, "line", line);
+    jsonPutString(errors, "error", error);
+    jsonClose(errors, '}');
+}
+
+// Imports a whole body, writing the JSON reply to out; returns the HTTP
+// status. Pass 1 parses and validates every chunk without g_systemLock,
+// keeping only the ids and keys that must be checked against the store.
+// Under the exclusive lock those are checked, so an import lands entirely
+// or not at all, and pass 2 parses each chunk again, applies it, and
+// streams its rows into a single WAL record. Beyond the body itself,
+// memory stays at one chunk plus those ids and keys.
+int importRun(int kind, int format, const char* data, int len, OutBuffer* out, unsigned long long* walLsn) {
+    long long started = nowMillis();
+    const char* end = data + len;
+    const char* body = data;
+    const char* p;
+    int bodyLine = 0, lineNumber, line;
+    char field[256];
+
+    ImportChunk* chunk = (ImportChunk*)malloc(sizeof(ImportChunk));
+    chunk->kind = kind;
+    chunk->format = format;
+    chunk->columnCount = 0;
+
+    if (format == FORMAT_CSV) {
+        int headerLen, present = 0;
+        const char* header = importNextLine(&body, end, 1, &headerLen, &bodyLine, &line);
+        for (p = header; p && chunk->columnCount < IMPORT_MAX_COLUMNS; p++) {
+            p = csvField(p, header + headerLen, field, sizeof(field));
+            int col = importColumn(field, (int)strlen(field));
+            chunk->columns[chunk->columnCount++] = col;
+            if (col >= 0) present |= 1 << col;
+            if (p >= header + headerLen) break;
+        }
+        for (int c = 0; header && c < COL_COUNT; c++) {
+            if ((g_importRequired[kind] & (1 << c)) && !(present & (1 << c))) {
+                char message[100];
+                snprintf(message, sizeof(message), "{\"error\":\"CSV header is missing column %s\"}", g_importColumns[c]);
+                queueOutput(out, message, (int)strlen(message));
+                free(chunk);
+                return 400;
+            }
+        }
+    }
+
+    int threads = cpuCount();
+    if (threads > IMPORT_MAX_THREADS) threads = IMPORT_MAX_THREADS;
+    if (threads < 1) threads = 1;
+    ImportPool pool;
+    importPoolStart(&pool, threads);
+
+    // Pass 1: every row must be valid, and ids and teacher emails must not
+    // repeat within the import. Marks keep their student ids, and the
+    // student/subject pairs of rows that name no subject.
+    IdIndex seenIds = {NULL, 0, 0};
+    StrIndex seenKeys = {NULL, 0, 0};
+    OutBuffer errors = {NULL, 0, 0};
+    int rows = 0, failed = 0, maxId = 0;
+    int idColumn = kind == IMPORT_TEACHERS ? COL_TEACHER_ID : COL_STUDENT_ID;
+    jsonOpen(&errors, NULL, '[');
+    chunk->validate = 1;
+    lineNumber = bodyLine;
+    p = body;
+    while (importFillChunk(chunk, &p, end, &lineNumber) > 0) {
+        importParseChunk(&pool, chunk);
+        for (int i = 0; i < chunk->count; i++) {
+            ImportRow* row = &chunk->rows[i];
+            void* line = (void*)(size_t)row->line;
+            if (!row->error[0] && (row->present & (1 << idColumn))) {
+                if (!idIndexGet(&seenIds, row->id)) {
+                    idIndexPut(&seenIds, row->id, line);
+                } else if (kind != IMPORT_MARKS) {
+                    snprintf(row->error, sizeof(row->error), "%s repeats an earlier row", g_importColumns[idColumn]);
+                }
+                if (row->id > maxId) maxId = row->id;
+            }
+            if (!row->error[0] && kind == IMPORT_TEACHERS) {
+                if (strIndexGet(&seenKeys, row->email)) importCopy(row->error, sizeof(row->error), "email repeats an earlier row");
+                else strIndexPut(&seenKeys, strdup(row->email), line);
+            }
+            if (!row->error[0] && kind == IMPORT_MARKS && !row->name[0]) {
+                char key[40];
+                snprintf(key, sizeof(key), "%d/%s", row->id, row->subjectId);
+                if (!strIndexGet(&seenKeys, key)) strIndexPut(&seenKeys, strdup(key), line);
+            }
+            if (row->error[0] && ++failed <= IMPORT_MAX_ERRORS) importListError(&errors, row->line, row->error);
+        }
+        rows += chunk->count;
+    }
+
+    ImportFailures conflicts = {NULL, 0, 0};
+    if (rows > 0 && failed == 0) {
+        rwlockWriteLock(&g_systemLock);
+        importCheckStore(kind, &seenIds, &seenKeys, &conflicts);
+        if (conflicts.count > 0) rwlockWriteUnlock(&g_systemLock);
+        failed = conflicts.count;
+        for (int i = 0; i < conflicts.count && i < IMPORT_MAX_ERRORS; i++) {
+            importListError(&errors, conflicts.items[i].line, conflicts.items[i].error);
+        }
+        free(conflicts.items);
+    }
+    jsonClose(&errors, ']');
+    for (int i = 0; i < seenKeys.capacity; i++) {
+        if (seenKeys.slots[i].key) free((void*)seenKeys.slots[i].key);
+    }
+    free(seenKeys.slots);
+    free(seenIds.slots);
+
+    if (rows == 0 || failed > 0) {
+        jsonOpen(out, NULL, '{');
+        jsonPutString(out, "error", rows == 0 ? "Import has no rows" : "Import rejected; no rows were applied");
+        jsonPutInt(out, "rows", rows);
+        jsonPutInt(out, "failed", failed);
+        jsonPutKey(out, "errors");
+        queueOutput(out, errors.data, errors.len);
+        jsonClose(out, '}');
+        free(errors.data);
+        importPoolStop(&pool);
+        free(chunk);
+        return 400;
+    }
+    free(errors.data);
+
+    // Pass 2: apply and log. Rows without an id are numbered past every id
+    // the import names.
+    if (kind == IMPORT_STUDENTS && maxId >= g_system.nextStudentId) g_system.nextStudentId = maxId + 1;
+    if (kind == IMPORT_TEACHERS && maxId >= g_system.nextTeacherId) g_system.nextTeacherId = maxId + 1;
+    unsigned long long lsn = walBegin();
+    char prefix[64];
+    walWrite(prefix, snprintf(prefix, sizeof(prefix), "\"op\":\"import\",\"kind\":\"%s\",\"rows\":[", g_importKinds[kind]));
+    OutBuffer logged = {NULL, 0, 0};
+    chunk->validate = 0;
+    lineNumber = bodyLine;
+    p = body;
+    for (int first = 1; importFillChunk(chunk, &p, end, &lineNumber) > 0; first = 0) {
+        importParseChunk(&pool, chunk);
+        logged.len = 0;
+        for (int i = 0; i < chunk->count; i++) {
+            importApplyRow(kind, &chunk->rows[i], &logged);
+        }
+        if (!first) walWrite(",", 1);
+        walWrite(logged.data, logged.len);
+    }
+    walWrite("]", 1);
+    walEnd(lsn);
+    rwlockWriteUnlock(&g_systemLock);
+    *walLsn = lsn;
+    free(logged.data);
+    importPoolStop(&pool);
+    free(chunk);
+
+    long long elapsed = nowMillis() - started;
+    if (elapsed < 1) elapsed = 1;
+    jsonOpen(out, NULL, '{');
+    jsonPutString(out, "message", "Import complete");
+    jsonPutString(out, "kind", g_importKinds[kind]);
+    jsonPutString(out, "format", format == FORMAT_CSV ? "csv" : "ndjson");
+    jsonPutInt(out, "rows", rows);
+    jsonPutInt(out, "threads", pool.threads);
+    jsonPutInt(out, "elapsedMs", elapsed);
+    jsonPutInt(out, "rowsPerSec", rows * 1000LL / elapsed);
+    jsonClose(out, '}');
+    return 200;
+}
+
+// One CSV field, quoted only when it holds a comma, quote or line break
+static void csvPutField(OutBuffer* out, const char* text, int first) {
+    if (!first) queueOutput(out, ",", 1);
+    if (!strpbrk(text, ",\"\r\n")) {
+        queueOutput(out, text, (int)strlen(text));
+        return;
+    }
+    queueOutput(out, "\"", 1);
+    for (const char* q; (q = strchr(text, '"')) != NULL; text = q + 1) {
+        queueOutput(out, text, (int)(q - text) + 1);
+        queueOutput(out, "\"", 1);
+    }
+    queueOutput(out, text, (int)strlen(text));
+    queueOutput(out, "\"", 1);
+}
+
+// Writes one exported record: a CSV line of fields or an NDJSON object.
+// values[i] is the text of g_importColumns[cols[i]]; numeric columns go
+// into NDJSON unquoted.
+static void exportRow(OutBuffer* out, int format, const int* cols, const char** values, int count) {
+    if (format == FORMAT_CSV) {
+        for (int i = 0; i < count; i++) csvPutField(out, values[i], i == 0);
+    } else {
+        queueOutput(out, "{", 1);
+        for (int i = 0; i < count; i++) {
+            if (i > 0) queueOutput(out, ",", 1);
+            bufPrintf(out, "\"%s\":", g_importColumns[cols[i]]);
+            if (COL_NUMERIC & (1 << cols[i])) {
+                queueOutput(out, values[i], (int)strlen(values[i]));
+            } else {
+                OutBuffer text = {NULL, 0, 0};
+                jsonPutString(&text, NULL, values[i]);
+                queueOutput(out, text.data, text.len);
+                free(text.data);
+            }
+        }
+        queueOutput(out, "}", 1);
+    }
+    queueOutput(out, "\n", 1);
+}
+
+// Writes every record of a kind in id order, in the columns import accepts
+// (passwords excepted), so an export of one server imports into another
+void exportRecords(int kind, int format, OutBuffer* out) {
+    static const int studentCols[] = {COL_STUDENT_ID, COL_NAME, COL_EMAIL, COL_DEPARTMENT, COL_YEAR, COL_SEMESTER, COL_CGPA, COL_ATTENDANCE};
+    static const int teacherCols[] = {COL_TEACHER_ID, COL_NAME, COL_EMAIL, COL_DEPARTMENT, COL_APPROVED, COL_APPROVAL_DATE};
+    static const int markCols[] = {COL_STUDENT_ID, COL_SUBJECT_ID, COL_NAME, COL_MID1, COL_MID2, COL_FINAL, COL_ATTENDANCE_PERCENT, COL_REMARKS};
+    const int* cols = kind == IMPORT_STUDENTS ? studentCols : kind == IMPORT_TEACHERS ? teacherCols : markCols;
+    int count = kind == IMPORT_TEACHERS ? 6 : 8;
+    const char* values[8];
+    char numbers[8][32];
+
+    if (format == FORMAT_CSV) {
+        for (int i = 0; i < count; i++) csvPutField(out, g_importColumns[cols[i]], i == 0);
+        queueOutput(out, "\n", 1);
+    }
+
+    if (kind == IMPORT_TEACHERS) {
+        IdList teachers = {NULL, 0, 0};
+        for (Teacher* t = g_system.teachers; t; t = t->next) idListPush(&teachers, t->teacherId, t);
+        idListSort(&teachers);
+        for (int i = 0; i < teachers.count; i++) {
+            Teacher* t = (Teacher*)teachers.items[i].record;
+            snprintf(numbers[0], 32, "%d", t->teacherId);
+            snprintf(numbers[4], 32, "%d", t->approved);
+            values[0] = numbers[0];
+            values[1] = t->name;
+            values[2] = t->email;
+            values[3] = t->department;
+            values[4] = numbers[4];
+            values[5] = t->approvalDate;
+            exportRow(out, format, cols, values, count);
+        }
+        free(teachers.items);
+        return;
+    }
+
+    for (int i = 0; i < g_studentOrder.count; i++) {
+        Student* s = (Student*)g_studentOrder.items[i].record;
+        snprintf(numbers[0], 32, "%d", s->studentId);
+        values[0] = numbers[0];
+        if (kind == IMPORT_STUDENTS) {
+            snprintf(numbers[4], 32, "%d", s->year);
+            snprintf(numbers[5], 32, "%d", s->semester);
+            snprintf(numbers[6], 32, "%.2f", s->cgpa);
+            snprintf(numbers[7], 32, "%.2f", s->attendance);
+            values[1] = s->name;
+            values[2] = s->email;
+            values[3] = s->department;
+            for (int c = 4; c < 8; c++) values[c] = numbers[c];
+            exportRow(out, format, cols, values, count);
+            continue;
+        }
+        for (int j = 0; j < s->subjectCount; j++) {
+            Subject* subj = &s->subjects[j];
+            snprintf(numbers[3], 32, "%d", subj->mid1);
+            snprintf(numbers[4], 32, "%d", subj->mid2);
+            snprintf(numbers[5], 32, "%d", subj->final);
+            snprintf(numbers[6], 32, "%.2f", subj->attendance_percent);
+            values[1] = subj->subjectId;
+            values[2] = subj->name;
+            for (int c = 3; c < 7; c++) values[c] = numbers[c];
+            values[7] = subj->remarks;
+            exportRow(out, format, cols, values, count);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Hash indexes
+// ---------------------------------------------------------------------------
+
+static unsigned int hashId(int key) {
+    return (unsigned int)key * 2654435761u;  // Fibonacci hashing
+}
+
+static unsigned int hashString(const char* key) {
+    unsigned int h = 2166136261u;  // FNV-1a
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void idIndexGrow(IdIndex* idx) {
+    IdIndexSlot* old = idx->slots;
+    int oldCapacity = idx->capacity;
+    idx->capacity = oldCapacity ? oldCapacity * 2 : 1024;
+    idx->slots = (IdIndexSlot*)calloc(idx->capacity, sizeof(IdIndexSlot));
+    idx->count = 0;
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i].value) idIndexPut(idx, old[i].key, old[i].value);
+    }
+    free(old);
+}
+
+void idIndexPut(IdIndex* idx, int key, void* value) {
+    if ((idx->count + 1) * 2 > idx->capacity) idIndexGrow(idx);  // load factor <= 0.5
+    unsigned int mask = idx->capacity - 1;
+    unsigned int i = hashId(key) & mask;
+    while (idx->slots[i].value && idx->slots[i].key != key) i = (i + 1) & mask;
+    if (!idx->slots[i].value) idx->count++;
+    idx->slots[i].key = key;
+    idx->slots[i].value = value;
+}
+
+void* idIndexGet(IdIndex* idx, int key) {
+    if (idx->capacity == 0) return NULL;
+    unsigned int mask = idx->capacity - 1;
+    unsigned int i = hashId(key) & mask;
+    while (idx->slots[i].value) {
+        if (idx->slots[i].key == key) return idx->slots[i].value;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void strIndexGrow(StrIndex* idx) {
+    StrIndexSlot* old = idx->slots;
+    int oldCapacity = idx->capacity;
+    idx->capacity = oldCapacity ? oldCapacity * 2 : 1024;
+    idx->slots = (StrIndexSlot*)calloc(idx->capacity, sizeof(StrIndexSlot));
+    idx->count = 0;
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i].value) strIndexPut(idx, old[i].key, old[i].value);
+    }
+    free(old);
+}
+
+// A later record shadows an earlier one with the same key, as the head-first list walk did
+void strIndexPut(StrIndex* idx, const char* key, void* value) {
+    if ((idx->count + 1) * 2 > idx->capacity) strIndexGrow(idx);
+    unsigned int h = hashString(key);
+    unsigned int mask = idx->capacity - 1;
+    unsigned int i = h & mask;
+    while (idx->slots[i].value && !(idx->slots[i].hash == h && strcmp(idx->slots[i].key, key) == 0)) {
+        i = (i + 1) & mask;
+    }
+    if (!idx->slots[i].value) idx->count++;
+    idx->slots[i].hash = h;
+    idx->slots[i].key = key;
+    idx->slots[i].value = value;
+}
+
+void* strIndexGet(StrIndex* idx, const char* key) {
+    if (idx->capacity == 0) return NULL;
+    unsigned int h = hashString(key);
+    unsigned int mask = idx->capacity - 1;
+    unsigned int i = h & mask;
+    while (idx->slots[i].value) {
+        if (idx->slots[i].hash == h && strcmp(idx->slots[i].key, key) == 0) return idx->slots[i].value;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Session tokens
+// ---------------------------------------------------------------------------
+
+#ifndef _WIN32
+static FILE* g_randomSource;  // /dev/urandom
+#endif
+
+int sessionInit() {
+    for (int i = 0; i < SESSION_SHARDS; i++) mutexInit(&g_sessions[i].lock);
+#ifdef _WIN32
+    return 0;
+#else
+    g_randomSource = fopen("/dev/urandom", "rb");
+    return g_randomSource ? 0 : -1;
+#endif
+}
+
+static int sessionRandom(unsigned char* bytes, int n) {
+#ifdef _WIN32
+    for (int i = 0; i < n; i += 4) {
+        unsigned int word;
+        if (rand_s(&word) != 0) return -1;
+        memcpy(bytes + i, &word, n - i < 4 ? n - i : 4);
+    }
+    return 0;
+#else
+    // stdio locks the stream, so workers can share it
+    return fread(bytes, 1, n, g_randomSource) == (size_t)n ? 0 : -1;
+#endif
+}
+
+// Low hash bits pick the shard, the next ones the chain within it
+static SessionShard* sessionShard(unsigned int hash) {
+    return &g_sessions[hash % SESSION_SHARDS];
+}
+
+static int sessionBucket(unsigned int hash) {
+    return (hash / SESSION_SHARDS) % SESSION_BUCKETS;
+}
+
+// Unlinks expired sessions from one chain; called with the shard locked
+static void sessionPurge(SessionShard* shard, int bucket, long long now) {
+    Session** link = &shard->buckets[bucket];
+    while (*link) {
+        Session* e = *link;
+        if (e->expires <= now) {
+            *link = e->next;
+            free(e);
+            shard->count--;
+        } else {
+            link = &e->next;
+        }
+    }
+}
+
+// Issues a token (SESSION_TOKEN_BYTES * 2 hex digits) for a verified login.
+// Each call also purges the next chain of its shard in turn, so sessions
+// that are never presented again are reclaimed without a sweeper thread.
+int sessionCreate(int role, int userId, int departmentId, char* token) {
+    static const char hex[] = "0123456789abcdef";
+    unsigned char bytes[SESSION_TOKEN_BYTES];
+    if (sessionRandom(bytes, sizeof(bytes)) != 0) return -1;
+
+    Session* e = (Session*)malloc(sizeof(Session));
+    for (int i = 0; i < SESSION_TOKEN_BYTES; i++) {
+        e->token[2 * i] = hex[bytes[i] >> 4];
+        e->token[2 * i + 1] = hex[bytes[i] & 15];
+    }
+    e->token[SESSION_TOKEN_BYTES * 2] = '\0';
+    e->hash = hashString(e->token);
+    e->role = role;
+    e->userId = userId;
+    e->departmentId = departmentId;
+    long long now = nowMillis();
+    e->expires = now + g_config.sessionTtl * 1000LL;
+    strcpy(token, e->token);
+
+    SessionShard* shard = sessionShard(e->hash);
+    int bucket = sessionBucket(e->hash);
+    mutexLock(&shard->lock);
+    sessionPurge(shard, shard->sweep, now);
+    shard->sweep = (shard->sweep + 1) % SESSION_BUCKETS;
+    e->next = shard->buckets[bucket];
+    shard->buckets[bucket] = e;
+    shard->count++;
+    mutexUnlock(&shard->lock);
+    return 0;
+}
+
+// Copies the live session for token into out; returns 0 if unknown or expired
+int sessionLookup(const char* token, Session* out) {
+    unsigned int hash = hashString(token);
+    SessionShard* shard = sessionShard(hash);
+    long long now = nowMillis();
+    int found = 0;
+    mutexLock(&shard->lock);
+    for (Session* e = shard->buckets[sessionBucket(hash)]; e; e = e->next) {
+        if (e->hash == hash && strcmp(e->token, token) == 0) {
+            if (e->expires > now) {
+                *out = *e;
+                found = 1;
+            }
+            break;
+        }
+    }
+    mutexUnlock(&shard->lock);
+    return found;
+}
+
+void sessionRevoke(const char* token) {
+    unsigned int hash = hashString(token);
+    SessionShard* shard = sessionShard(hash);
+    mutexLock(&shard->lock);
+    for (Session** link = &shard->buckets[sessionBucket(hash)]; *link; link = &(*link)->next) {
+        Session* e = *link;
+        if (e->hash == hash && strcmp(e->token, token) == 0) {
+            *link = e->next;
+            free(e);
+            shard->count--;
+            break;
+        }
+    }
+    mutexUnlock(&shard->lock);
+}
+
+// Ends every session of one user, e.g. a teacher whose approval was withdrawn.
+// Walks the whole table; only rare principal actions call it.
+void sessionRevokeUser(int role, int userId) {
+    for (int i = 0; i < SESSION_SHARDS; i++) {
+        SessionShard* shard = &g_sessions[i];
+        mutexLock(&shard->lock);
+        for (int b = 0; b < SESSION_BUCKETS && shard->count > 0; b++) {
+            Session** link = &shard->buckets[b];
+            while (*link) {
+                Session* e = *link;
+                if (e->role == role && e->userId == userId) {
+                    *link = e->next;
+                    free(e);
+                    shard->count--;
+                } else {
+                    link = &e->next;
+                }
+            }
+        }
+        mutexUnlock(&shard->lock);
+    }
+}
+
+// Adds "token" and "expiresIn" members for a new session to a login reply.
+// token is null if no random bytes could be had; credentials still work.
+void sessionToJSON(OutBuffer* out, int role, int userId, int departmentId) {
+    char token[SESSION_TOKEN_BYTES * 2 + 1];
+    if (sessionCreate(role, userId, departmentId, token) != 0) {
+        jsonPutRaw(out, "token", "null");
+        return;
+    }
+    jsonPutString(out, "token", token);
+    jsonPutInt(out, "expiresIn", g_config.sessionTtl);
+}
+
+// Reads "Authorization: Bearer <token>". Returns 1 with out filled for a
+// live session, 0 when the request has no such header, -1 for an unknown
+// or expired token.
+int sessionFromRequest(const char* request, const char* headerEnd, Session* out) {
+    char value[128];
+    if (!headerEnd || !findHeader(request, headerEnd, "Authorization", value, sizeof(value))) return 0;
+    if (strncasecmp(value, "Bearer ", 7) != 0) return -1;
+    return sessionLookup(value + 7, out) ? 1 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Authorization
+// ---------------------------------------------------------------------------
+
+void authInvalidate() {
+    g_authGeneration++;
+}
+
+// Whether an approved teacher may act on a department (departmentId < 0:
+// approval alone), answered from g_authCache when possible
+int authTeacherDepartment(int teacherId, int departmentId) {
+    AuthCacheEntry* e = &g_authCache[hashId(teacherId * 31 + departmentId) & (AUTH_CACHE_SIZE - 1)];
+    if (e->generation == g_authGeneration && e->teacherId == teacherId && e->departmentId == departmentId) {
+        return e->decision;
+    }
+    Teacher* t = findTeacher(teacherId);
+    int decision = AUTH_OK;
+    if (!t) decision = AUTH_NO_TEACHER;
+    else if (t->approved != 1) decision = AUTH_NOT_APPROVED;
+    else if (departmentId >= 0 && t->departmentId != departmentId) decision = AUTH_DEPARTMENT;
+    e->teacherId = teacherId;
+    e->departmentId = departmentId;
+    e->generation = g_authGeneration;
+    e->decision = decision;
+    return decision;
+}
+
+// Resolves the caller of a staff route once and checks it against the
+// route's scope. Credentials are tried in order: a session token, the
+// X-Principal-Password header, then role with email/password or
+// principalPassword in the JSON body. studentId is the route's :id for
+// AUTH_SCOPE_STUDENT. Returns AUTH_OK or the g_authFailures entry to send.
+int authorizeRequest(const char* request, const char* headerEnd, JsonObject* args, int studentId, int scope, Caller* caller) {
+    Session session;
+    char password[100];
+    int found = sessionFromRequest(request, headerEnd, &session);
+    if (found < 0) return AUTH_SESSION;
+    if (found) {
+        caller->role = session.role;
+        caller->userId = session.userId;
+    } else if (headerEnd && findHeader(request, headerEnd, "X-Principal-Password", password, sizeof(password))) {
+        if (strcmp(password, PRINCIPAL_PASSWORD) != 0) return AUTH_BAD_PRINCIPAL;
+        caller->role = ROLE_PRINCIPAL;
+        caller->userId = 3001;
+    } else {
+        char role[50];
+        jsonString(args, "role", role, sizeof(role));
+        if (strcmp(role, "principal") == 0) {
+            jsonString(args, "principalPassword", password, sizeof(password));
+            if (strcmp(password, PRINCIPAL_PASSWORD) != 0) return AUTH_BAD_PRINCIPAL;
+            caller->role = ROLE_PRINCIPAL;
+            caller->userId = 3001;
+        } else if (strcmp(role, "teacher") == 0) {
+            char email[120];
+            jsonString(args, "email", email, sizeof(email));
+            jsonString(args, "password", password, sizeof(password));
+            Teacher* t = findTeacherByEmail(email);
+            if (!t) return AUTH_NO_TEACHER;
+            if (strcmp(t->password, password) != 0) return AUTH_BAD_PASSWORD;
+            caller->role = ROLE_TEACHER;
+            caller->userId = t->teacherId;
+        } else {
+            return AUTH_NO_CREDENTIALS;
+        }
+    }
+
+    if (caller->role == ROLE_PRINCIPAL) return AUTH_OK;
+    if (caller->role != ROLE_TEACHER || scope == AUTH_SCOPE_PRINCIPAL) return AUTH_FORBIDDEN;
+    if (scope == AUTH_SCOPE_STAFF) return authTeacherDepartment(caller->userId, -1);
+
+    // AUTH_SCOPE_STUDENT: a missing student is left to the handler's 404
+    Student* s = findStudent(studentId);
+    return authTeacherDepartment(caller->userId, s ? s->departmentId : -1);
+}
+
+// ---------------------------------------------------------------------------
+// Id-ordered lists and departments
+// ---------------------------------------------------------------------------
+
+void idListPush(IdList* list, int id, void* record) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = (IdListEntry*)realloc(list->items, list->capacity * sizeof(IdListEntry));
+    }
+    list->items[list->count].id = id;
+    list->items[list->count].record = record;
+    list->count++;
+}
+
+void idListInsert(IdList* list, int id, void* record) {
+    int at = idListSeek(list, id);
+    idListPush(list, id, record);
+    if (at < list->count - 1) {
+        memmove(list->items + at + 1, list->items + at, (list->count - 1 - at) * sizeof(IdListEntry));
+        list->items[at].id = id;
+        list->items[at].record = record;
+    }
+}
+
+static int compareIdListEntries(const void* a, const void* b) {
+    int x = ((const IdListEntry*)a)->id;
+    int y = ((const IdListEntry*)b)->id;
+    return (x > y) - (x < y);
+}
+
+void idListSort(IdList* list) {
+    if (list->count > 1) qsort(list->items, list->count, sizeof(IdListEntry), compareIdListEntries);
+}
+
+// Index of the first entry whose id is greater than afterId
+int idListSeek(IdList* list, int afterId) {
+    int lo = 0;
+    int hi = list->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (list->items[mid].id <= afterId) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Called with the store write-locked (or single-threaded at startup)
+Department* internDepartment(const char* name) {
+    Department* d = findDepartment(name);
+    if (d) return d;
+    d = (Department*)calloc(1, sizeof(Department));
+    strncpy(d->name, name, sizeof(d->name) - 1);
+    if (g_departments.count == g_departments.capacity) {
+        g_departments.capacity = g_departments.capacity ? g_departments.capacity * 2 : 16;
+        g_departments.items = (Department**)realloc(g_departments.items, g_departments.capacity * sizeof(Department*));
+    }
+    d->id = g_departments.count;
+    g_departments.items[g_departments.count++] = d;
+    strIndexPut(&g_departmentIndex, d->name, d);
+    return d;
+}
+
+Department* findDepartment(const char* name) {
+    return (Department*)strIndexGet(&g_departmentIndex, name);
+}
+
+// After a bulk load pushed records in file order
+void sortDepartmentLists() {
+    idListSort(&g_studentOrder);
+    for (int i = 0; i < g_departments.count; i++) {
+        idListSort(&g_departments.items[i]->students);
+        idListSort(&g_departments.items[i]->teachers);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Subject pool
+// ---------------------------------------------------------------------------
+
+static int subjectClassCapacity(int sizeClass) {
+    return (sizeClass % 2 ? 6 : 4) << (sizeClass / 2);
+}
+
+// Moves s's subjects into a block of the next size class and recycles the
+// old one. Keys come first so they share a cache line with the first subjects.
+static void growStudentSubjects(Student* s) {
+    int oldClass = 0;
+    while (s->subjectCapacity > subjectClassCapacity(oldClass)) oldClass++;
+    int newClass = s->subjectCapacity ? oldClass + 1 : 0;
+    int capacity = subjectClassCapacity(newClass);
+
+    char* block = (char*)g_subjectPool.freeBlocks[newClass];
+    if (block) g_subjectPool.freeBlocks[newClass] = *(void**)block;
+    else block = (char*)arenaAlloc(&g_subjectPool.arena, (size_t)capacity * (sizeof(SubjectKey) + sizeof(Subject)));
+
+    SubjectKey* keys = (SubjectKey*)block;
+    Subject* subjects = (Subject*)(block + (size_t)capacity * sizeof(SubjectKey));
+    if (s->subjectCount > 0) {
+        memcpy(subjects, s->subjects, s->subjectCount * sizeof(Subject));
+        memcpy(keys, s->subjectKeys, s->subjectCount * sizeof(SubjectKey));
+    }
+    if (s->subjectCapacity) {
+        *(void**)s->subjectKeys = g_subjectPool.freeBlocks[oldClass];
+        g_subjectPool.freeBlocks[oldClass] = s->subjectKeys;
+    }
+    s->subjects = subjects;
+    s->subjectKeys = keys;
+    s->subjectCapacity = capacity;
+}
+
+// First key position whose hash is not below h
+static int subjectKeySeek(Student* s, unsigned int h) {
+    int lo = 0;
+    int hi = s->subjectCount;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (s->subjectKeys[mid].hash < h) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Appends a zeroed subject with this id and indexes it. The caller fills in
+// the rest; assignStudentSubject also gives it a column row.
+Subject* addStudentSubject(Student* s, const char* subjectId) {
+    if (s->subjectCount == s->subjectCapacity) growStudentSubjects(s);
+    int index = s->subjectCount;
+    Subject* subj = &s->subjects[index];
+    memset(subj, 0, sizeof(Subject));
+    strncpy(subj->subjectId, subjectId, sizeof(subj->subjectId) - 1);
+
+    unsigned int h = hashString(subj->subjectId);
+    int at = subjectKeySeek(s, h);
+    memmove(s->subjectKeys + at + 1, s->subjectKeys + at, (index - at) * sizeof(SubjectKey));
+    s->subjectKeys[at].hash = h;
+    s->subjectKeys[at].index = index;
+    s->subjectCount++;
+    return subj;
+}
+
+// ---------------------------------------------------------------------------
+// Columnar student store
+// ---------------------------------------------------------------------------
+
+// Gives s the next row and copies its numeric fields, plus any subjects it
+// already carries (bulk loads fill subjects before linking the record)
+void columnsAddStudent(Student* s) {
+    StudentColumns* c = &g_studentColumns;
+    if (c->count == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 1024;
+        c->record = (Student**)realloc(c->record, c->capacity * sizeof(Student*));
+        c->studentId = (int*)realloc(c->studentId, c->capacity * sizeof(int));
+        c->departmentId = (int*)realloc(c->departmentId, c->capacity * sizeof(int));
+        c->year = (int*)realloc(c->year, c->capacity * sizeof(int));
+        c->cgpa = (double*)realloc(c->cgpa, c->capacity * sizeof(double));
+        c->attendance = (double*)realloc(c->attendance, c->capacity * sizeof(double));
+    }
+    s->row = c->count++;
+    c->record[s->row] = s;
+    c->studentId[s->row] = s->studentId;
+    c->departmentId[s->row] = s->departmentId;
+    c->year[s->row] = s->year;
+    c->cgpa[s->row] = s->cgpa;
+    c->attendance[s->row] = s->attendance;
+    Department* d = g_departments.items[s->departmentId];
+    runningAdd(&d->cgpa, s->cgpa);
+    runningAdd(&d->attendance, s->attendance);
+    for (int i = 0; i < s->subjectCount; i++) columnsAddSubject(s, &s->subjects[i]);
+}
+
+void columnsAddSubject(Student* s, Subject* subj) {
+    SubjectColumns* c = &g_subjectColumns;
+    if (c->count == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 1024;
+        c->studentRow = (int*)realloc(c->studentRow, c->capacity * sizeof(int));
+        c->subjectKey = (int*)realloc(c->subjectKey, c->capacity * sizeof(int));
+        c->total = (double*)realloc(c->total, c->capacity * sizeof(double));
+        c->attendance = (double*)realloc(c->attendance, c->capacity * sizeof(double));
+    }
+    SubjectAggregate* agg = internSubjectAggregate(subj->subjectId, subj->name);
+    subj->row = c->count++;
+    c->studentRow[subj->row] = s->row;
+    c->subjectKey[subj->row] = agg->id;
+    c->total[subj->row] = subj->mid1 + subj->mid2 + subj->final;
+    c->attendance[subj->row] = subj->attendance_percent;
+    runningAdd(&agg->total, c->total[subj->row]);
+    runningAdd(&agg->attendance, subj->attendance_percent);
+}
+
+// ---------------------------------------------------------------------------
+// Column statistics (/api/stats)
+// ---------------------------------------------------------------------------
+
+// Bucket index for x, clamped in the double domain so huge or negative
+// values cannot overflow the integer conversion
+static int statsBucket(double x, double inverseWidth) {
+    double slot = x * inverseWidth;
+    if (slot < 0) slot = 0;
+    if (slot > STATS_BUCKETS - 1) slot = STATS_BUCKETS - 1;
+    return (int)slot;
+}
+
+// Rows [from, n). select is one byte per row (nonzero = include) or NULL
+// for every row.
+static void statsScalar(const double* v, const unsigned char* select, int from, int n, double inverseWidth, ColumnStats* st) {
+    for (int i = from; i < n; i++) {
+        if (select && !select[i]) continue;
+        double x = v[i];
+        st->count++;
+        st->sum += x;
+        st->sumSq += x * x;
+        if (x < st->min) st->min = x;
+        if (x > st->max) st->max = x;
+        st->buckets[statsBucket(x, inverseWidth)]++;
+    }
+}
+
+#ifdef STATS_X86
+// Four lanes at a time. Unselected lanes add zero, never win min/max and
+// count into a spare bucket; each lane has its own histogram so the
+// increments do not wait on each other. Returns the rows it covered.
+__attribute__((target("avx2")))
+static int statsAvx2(const double* v, const unsigned char* select, int n, double inverseWidth, ColumnStats* st) {
+    __m256d sum = _mm256_setzero_pd();
+    __m256d sumSq = _mm256_setzero_pd();
+    __m256d lo = _mm256_set1_pd(st->min);
+    __m256d hi = _mm256_set1_pd(st->max);
+    __m256d top = _mm256_set1_pd(DBL_MAX);
+    __m256d bottom = _mm256_set1_pd(-DBL_MAX);
+    __m256d scale = _mm256_set1_pd(inverseWidth);
+    __m256d lastSlot = _mm256_set1_pd(STATS_BUCKETS - 1);
+    __m128i spare = _mm_set1_epi32(STATS_BUCKETS);
+    long long lanes[4][STATS_BUCKETS + 1];
+    long long count = 0;
+    int idx[4];
+    int i = 0;
+    memset(lanes, 0, sizeof(lanes));
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        __m256d slot = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(x, scale), _mm256_setzero_pd()), lastSlot);
+        __m128i bucket = _mm256_cvttpd_epi32(slot);
+        if (select) {
+            int bytes;
+            memcpy(&bytes, select + i, 4);
+            __m128i keep32 = _mm_cmpgt_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)), _mm_setzero_si128());
+            __m256d keep = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(keep32));
+            count += __builtin_popcount(_mm256_movemask_pd(keep));
+            lo = _mm256_min_pd(lo, _mm256_blendv_pd(top, x, keep));
+            hi = _mm256_max_pd(hi, _mm256_blendv_pd(bottom, x, keep));
+            x = _mm256_and_pd(x, keep);
+            bucket = _mm_blendv_epi8(spare, bucket, keep32);
+        } else {
+            count += 4;
+            lo = _mm256_min_pd(lo, x);
+            hi = _mm256_max_pd(hi, x);
+        }
+        sum = _mm256_add_pd(sum, x);
+        sumSq = _mm256_add_pd(sumSq, _mm256_mul_pd(x, x));
+        _mm_storeu_si128((__m128i*)idx, bucket);
+        lanes[0][idx[0]]++;
+        lanes[1][idx[1]]++;
+        lanes[2][idx[2]]++;
+        lanes[3][idx[3]]++;
+    }
+    double out[4];
+    _mm256_storeu_pd(out, sum);
+    st->sum += out[0] + out[1] + out[2] + out[3];
+    _mm256_storeu_pd(out, sumSq);
+    st->sumSq += out[0] + out[1] + out[2] + out[3];
+    _mm256_storeu_pd(out, lo);
+    for (int k = 0; k < 4; k++) if (out[k] < st->min) st->min = out[k];
+    _mm256_storeu_pd(out, hi);
+    for (int k = 0; k < 4; k++) if (out[k] > st->max) st->max = out[k];
+    for (int b = 0; b < STATS_BUCKETS; b++) st->buckets[b] += lanes[0][b] + lanes[1][b] + lanes[2][b] + lanes[3][b];
+    st->count += count;
+    return i;
+}
+
+// Baseline x86-64 path: two lanes at a time, same scheme
+static int statsSse2(const double* v, const unsigned char* select, int n, double inverseWidth, ColumnStats* st) {
+    __m128d sum = _mm_setzero_pd();
+    __m128d sumSq = _mm_setzero_pd();
+    __m128d lo = _mm_set1_pd(st->min);
+    __m128d hi = _mm_set1_pd(st->max);
+    __m128d top = _mm_set1_pd(DBL_MAX);
+    __m128d bottom = _mm_set1_pd(-DBL_MAX);
+    __m128d scale = _mm_set1_pd(inverseWidth);
+    __m128d lastSlot = _mm_set1_pd(STATS_BUCKETS - 1);
+    long long lanes[2][STATS_BUCKETS + 1];
+    long long count = 0;
+    int idx[4];
+    int i = 0;
+    memset(lanes, 0, sizeof(lanes));
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v + i);
+        __m128d slot = _mm_min_pd(_mm_max_pd(_mm_mul_pd(x, scale), _mm_setzero_pd()), lastSlot);
+        _mm_storeu_si128((__m128i*)idx, _mm_cvttpd_epi32(slot));
+        if (select) {
+            int keep0 = select[i] != 0;
+            int keep1 = select[i + 1] != 0;
+            __m128d keep = _mm_castsi128_pd(_mm_set_epi64x(-(long long)keep1, -(long long)keep0));
+            count += keep0 + keep1;
+            lo = _mm_min_pd(lo, _mm_or_pd(_mm_and_pd(keep, x), _mm_andnot_pd(keep, top)));
+            hi = _mm_max_pd(hi, _mm_or_pd(_mm_and_pd(keep, x), _mm_andnot_pd(keep, bottom)));
+            x = _mm_and_pd(x, keep);
+            if (!keep0) idx[0] = STATS_BUCKETS;
+            if (!keep1) idx[1] = STATS_BUCKETS;
+        } else {
+            count += 2;
+            lo = _mm_min_pd(lo, x);
+            hi = _mm_max_pd(hi, x);
+        }
+        sum = _mm_add_pd(sum, x);
+        sumSq = _mm_add_pd(sumSq, _mm_mul_pd(x, x));
+        lanes[0][idx[0]]++;
+        lanes[1][idx[1]]++;
+    }
+    double out[2];
+    _mm_storeu_pd(out, sum);
+    st->sum += out[0] + out[1];
+    _mm_storeu_pd(out, sumSq);
+    st->sumSq += out[0] + out[1];
+    _mm_storeu_pd(out, lo);
+    for (int k = 0; k < 2; k++) if (out[k] < st->min) st->min = out[k];
+    _mm_storeu_pd(out, hi);
+    for (int k = 0; k < 2; k++) if (out[k] > st->max) st->max = out[k];
+    for (int b = 0; b < STATS_BUCKETS; b++) st->buckets[b] += lanes[0][b] + lanes[1][b];
+    st->count += count;
+    return i;
+}
+
+static int statsHasAvx2() {
+    static int cached = -1;
+    if (cached < 0) cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return cached;
+}
+#endif
+
+const char* statsKernelName() {
+#ifdef STATS_X86
+    return statsHasAvx2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+void columnStats(const double* values, const unsigned char* select, int n, double bucketWidth, ColumnStats* st) {
+    double inverseWidth = 1.0 / bucketWidth;
+    int done = 0;
+    memset(st, 0, sizeof(ColumnStats));
+    st->min = DBL_MAX;
+    st->max = -DBL_MAX;
+#ifdef STATS_X86
+    done = statsHasAvx2() ? statsAvx2(values, select, n, inverseWidth, st) : statsSse2(values, select, n, inverseWidth, st);
+#endif
+    statsScalar(values, select, done, n, inverseWidth, st);
+}
+
+// Newton's method; keeps the server free of a libm dependency
+static double statsSqrt(double x) {
+    if (x <= 0) return 0;
+    double r = x > 1 ? x / 2 : 1;
+    for (int i = 0; i < 64; i++) {
+        double next = (r + x / r) / 2;
+        if (next == r) break;
+        r = next;
+    }
+    return r;
+}
+
+// {"count":..,"mean":..,"min":..,"max":..,"stddev":..,"bucketWidth":..,"histogram":[..]}
+// Writes the count/mean/min/max/stddev members of an open object
+static void putSummary(OutBuffer* out, long long count, double sum, double sumSq, double min, double max) {
+    jsonPutInt(out, "count", count);
+    if (count > 0) {
+        double mean = sum / count;
+        jsonPutNumber(out, "mean", mean);
+        jsonPutNumber(out, "min", min);
+        jsonPutNumber(out, "max", max);
+        jsonPutNumber(out, "stddev", statsSqrt(sumSq / count - mean * mean));
+    } else {
+        jsonPutRaw(out, "mean", "null");
+        jsonPutRaw(out, "min", "null");
+        jsonPutRaw(out, "max", "null");
+        jsonPutRaw(out, "stddev", "null");
+    }
+}
+
+void summaryToJSON(OutBuffer* out, const char* key, long long count, double sum, double sumSq, double min, double max) {
+    jsonOpen(out, key, '{');
+    putSummary(out, count, sum, sumSq, min, max);
+    jsonClose(out, '}');
+}
+
+void statsToJSON(OutBuffer* out, const char* key, ColumnStats* st, double bucketWidth) {
+    jsonOpen(out, key, '{');
+    putSummary(out, st->count, st->sum, st->sumSq, st->min, st->max);
+    jsonPutNumber(out, "bucketWidth", bucketWidth);
+    jsonOpen(out, "histogram", '[');
+    for (int i = 0; i < STATS_BUCKETS; i++) jsonPutInt(out, NULL, st->buckets[i]);
+    jsonClose(out, ']');
+    jsonClose(out, '}');
+}
+
+// ---------------------------------------------------------------------------
+// Running aggregates (/api/aggregates)
+// ---------------------------------------------------------------------------
 
-        // Create new subject entry
-        Subject* newSubj = &s->subjects[s->subjectCount];
-        strncpy(newSubj->subjectId, subjectId, sizeof(newSubj->subjectId) - 1);
-        strncpy(newSubj->name, name, sizeof(newSubj->name) - 1);
-        newSubj->mid1 = mid1;
-        newSubj->mid2 = mid2;
-        newSubj->final = final;
-        newSubj->attendance_percent = attendance;
-        newSubj->remarks[0] = '\0';
-
-        s->subjectCount++;
-        saveToFile();
-
-        // Return newly created subject
-        char respBody[512];
-        int total = newSubj->mid1 + newSubj->mid2 + newSubj->final;
-        sprintf(respBody, "{\"message\":\"Subject assigned\",\"subjectId\":\"%s\",\"name\":\"%s\",\"marks\":{\"mid1\":%d,\"mid2\":%d,\"final\":%d,\"total\":%d},\"attendance_percent\":%.2f}",
-            newSubj->subjectId, newSubj->name, newSubj->mid1, newSubj->mid2, newSubj->final, total, newSubj->attendance_percent);
-        sendResponse(client, 201, respBody);
-        printf("  ✓ Subject assigned to student #%d - %s\n", studentId, subjectId);
+void runningAdd(RunningStats* r, double x) {
+    if (r->count == 0) {
+        r->min = x;
+        r->max = x;
+        r->minMaxStale = 0;
+    } else if (!r->minMaxStale) {
+        if (x < r->min) r->min = x;
+        if (x > r->max) r->max = x;
+    }
+    r->count++;
+    r->sum += x;
+    r->sumSq += x * x;
+}
+
+void runningRemove(RunningStats* r, double x) {
+    r->count--;
+    if (r->count <= 0) {
+        memset(r, 0, sizeof(RunningStats));
         return;
     }
+    r->sum -= x;
+    r->sumSq -= x * x;
+    if (x <= r->min || x >= r->max) r->minMaxStale = 1;
+}
 
-    sendResponse(client, 404, "{\"error\":\"Endpoint not found\"}");
+static void runningRescan(RunningStats* r, double x, int first) {
+    if (first || x < r->min) r->min = x;
+    if (first || x > r->max) r->max = x;
 }
 
-void sendResponse(SOCKET client, int status, const char* body) {
-    char response[BUFFER_SIZE];
-    const char* status_text = "OK";
-    if (status == 201) status_text = "Created";
-    else if (status == 400) status_text = "Bad Request";
-    else if (status == 401) status_text = "Unauthorized";
-    else if (status == 403) status_text = "Forbidden";
-    else if (status == 404) status_text = "Not Found";
+// Called with the store write-locked (or single-threaded at startup)
+SubjectAggregate* internSubjectAggregate(const char* subjectId, const char* name) {
+    SubjectAggregate* agg = (SubjectAggregate*)strIndexGet(&g_subjectAggregateIndex, subjectId);
+    if (agg) return agg;
+    agg = (SubjectAggregate*)calloc(1, sizeof(SubjectAggregate));
+    strncpy(agg->subjectId, subjectId, sizeof(agg->subjectId) - 1);
+    strncpy(agg->name, name, sizeof(agg->name) - 1);
+    if (g_subjectAggregates.count == g_subjectAggregates.capacity) {
+        g_subjectAggregates.capacity = g_subjectAggregates.capacity ? g_subjectAggregates.capacity * 2 : 16;
+        g_subjectAggregates.items = (SubjectAggregate**)realloc(g_subjectAggregates.items,
+            g_subjectAggregates.capacity * sizeof(SubjectAggregate*));
+    }
+    agg->id = g_subjectAggregates.count;
+    g_subjectAggregates.items[g_subjectAggregates.count++] = agg;
+    strIndexPut(&g_subjectAggregateIndex, agg->subjectId, agg);
+    return agg;
+}
 
-    sprintf(response,
-        "HTTP/1.1 %d %s\r\n"
-        "Content-Type: application/json\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "Access-Control-Allow-Methods: GET, POST, PUT, OPTIONS\r\n"
-        "Access-Control-Allow-Headers: Content-Type\r\n"
-        "Content-Length: %d\r\n"
-        "\r\n%s",
-        status, status_text, (int)strlen(body), body);
+// Recomputes stale min/max. Readers call this under the shared store lock
+// while holding g_aggregateRepairLock, which also covers reading the
+// aggregates out; writers hold the store exclusively and need neither.
+// Departments rescan their posting lists; stale subjects share one pass
+// over the subject columns.
+void aggregateRepair() {
+    for (int i = 0; i < g_departments.count; i++) {
+        Department* d = g_departments.items[i];
+        if (!d->cgpa.minMaxStale && !d->attendance.minMaxStale) continue;
+        for (int k = 0; k < d->students.count; k++) {
+            Student* st = (Student*)d->students.items[k].record;
+            runningRescan(&d->cgpa, st->cgpa, k == 0);
+            runningRescan(&d->attendance, st->attendance, k == 0);
+        }
+        d->cgpa.minMaxStale = 0;
+        d->attendance.minMaxStale = 0;
+    }
 
-    send(client, response, strlen(response), 0);
+    int count = g_subjectAggregates.count;
+    unsigned char* seen = NULL;  // per subject: 0 fresh, 1 stale, 2 stale and rescanned a row
+    for (int i = 0; i < count; i++) {
+        SubjectAggregate* agg = g_subjectAggregates.items[i];
+        if (!agg->total.minMaxStale && !agg->attendance.minMaxStale) continue;
+        if (!seen) seen = (unsigned char*)calloc(count, 1);
+        seen[i] = 1;
+    }
+    if (!seen) return;
+    for (int r = 0; r < g_subjectColumns.count; r++) {
+        int key = g_subjectColumns.subjectKey[r];
+        if (!seen[key]) continue;
+        SubjectAggregate* agg = g_subjectAggregates.items[key];
+        runningRescan(&agg->total, g_subjectColumns.total[r], seen[key] == 1);
+        runningRescan(&agg->attendance, g_subjectColumns.attendance[r], seen[key] == 1);
+        seen[key] = 2;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!seen[i]) continue;
+        g_subjectAggregates.items[i]->total.minMaxStale = 0;
+        g_subjectAggregates.items[i]->attendance.minMaxStale = 0;
+    }
+    free(seen);
 }
 
-void sendCORSHeaders(SOCKET client) {
-    char response[512];
-    sprintf(response,
-        "HTTP/1.1 200 OK\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "Access-Control-Allow-Methods: GET, POST, PUT, OPTIONS\r\n"
-        "Access-Control-Allow-Headers: Content-Type\r\n"
-        "\r\n");
-    send(client, response, strlen(response), 0);
+// ---------------------------------------------------------------------------
+// Rank indexes (/api/rankings)
+// ---------------------------------------------------------------------------
+
+static int rankLess(RankNode* n, double value, int id) {
+    return n->value < value || (n->value == value && n->id < id);
 }
 
-Student* findStudent(int id) {
-    Student* current = g_system.students;
-    while (current) {
-        if (current->studentId == id) return current;
-        current = current->next;
+// Each level holds a quarter of the one below it
+static int rankRandomLevel(RankIndex* index) {
+    int level = 1;
+    for (;;) {
+        index->seed ^= index->seed << 13;
+        index->seed ^= index->seed >> 17;
+        index->seed ^= index->seed << 5;
+        if ((index->seed & 3) != 0 || level == RANK_MAX_LEVEL) return level;
+        level++;
     }
-    return NULL;
 }
 
-Teacher* findTeacher(int id) {
-    Teacher* current = g_system.teachers;
-    while (current) {
-        if (current->teacherId == id) return current;
-        current = current->next;
+// Links a node whose level, value and id are already set
+static void rankLink(RankIndex* index, RankNode* node) {
+    RankNode* update[RANK_MAX_LEVEL];
+    int rank[RANK_MAX_LEVEL];
+    RankNode* x = index->head;
+    for (int i = index->level - 1; i >= 0; i--) {
+        rank[i] = i == index->level - 1 ? 0 : rank[i + 1];
+        while (x->links[i].next && rankLess(x->links[i].next, node->value, node->id)) {
+            rank[i] += x->links[i].span;
+            x = x->links[i].next;
+        }
+        update[i] = x;
     }
-    return NULL;
+    if (node->level > index->level) {
+        for (int i = index->level; i < node->level; i++) {
+            rank[i] = 0;
+            update[i] = index->head;
+            update[i]->links[i].span = index->count;
+        }
+        index->level = node->level;
+    }
+    for (int i = 0; i < node->level; i++) {
+        node->links[i].next = update[i]->links[i].next;
+        update[i]->links[i].next = node;
+        node->links[i].span = update[i]->links[i].span - (rank[0] - rank[i]);
+        update[i]->links[i].span = rank[0] - rank[i] + 1;
+    }
+    for (int i = node->level; i < index->level; i++) update[i]->links[i].span++;
+    node->prev = update[0] == index->head ? NULL : update[0];
+    if (node->links[0].next) node->links[0].next->prev = node;
+    else index->tail = node;
+    index->count++;
 }
 
-Teacher* findTeacherByEmail(char* email) {
-    Teacher* current = g_system.teachers;
-    while (current) {
-        if (strcmp(current->email, email) == 0) return current;
-        current = current->next;
+// Unlinks the node keyed (value, id) and returns it, or NULL if absent
+static RankNode* rankUnlink(RankIndex* index, double value, int id) {
+    if (!index->head) return NULL;
+    RankNode* update[RANK_MAX_LEVEL];
+    RankNode* x = index->head;
+    for (int i = index->level - 1; i >= 0; i--) {
+        while (x->links[i].next && rankLess(x->links[i].next, value, id)) x = x->links[i].next;
+        update[i] = x;
+    }
+    x = x->links[0].next;
+    if (!x || x->value != value || x->id != id) return NULL;
+    for (int i = 0; i < index->level; i++) {
+        if (update[i]->links[i].next == x) {
+            update[i]->links[i].span += x->links[i].span - 1;
+            update[i]->links[i].next = x->links[i].next;
+        } else {
+            update[i]->links[i].span--;
+        }
+    }
+    if (x->links[0].next) x->links[0].next->prev = x->prev;
+    else index->tail = x->prev;
+    while (index->level > 1 && index->head->links[index->level - 1].next == NULL) index->level--;
+    index->count--;
+    return x;
+}
+
+// Called with the store write-locked (or single-threaded at startup)
+void rankInsert(RankIndex* index, double value, int id, Student* record) {
+    if (!index->head) {
+        index->head = (RankNode*)calloc(1, sizeof(RankNode) + RANK_MAX_LEVEL * sizeof(index->head->links[0]));
+        index->level = 1;
+        if (index->seed == 0) index->seed = 2463534242u;
+    }
+    int level = rankRandomLevel(index);
+    RankNode* node = (RankNode*)malloc(sizeof(RankNode) + level * sizeof(node->links[0]));
+    node->value = value;
+    node->id = id;
+    node->level = level;
+    node->record = record;
+    rankLink(index, node);
+}
+
+// Moves an entry to its new value, reusing its node
+void rankUpdate(RankIndex* index, double oldValue, int id, double value) {
+    if (oldValue == value) return;
+    RankNode* node = rankUnlink(index, oldValue, id);
+    if (!node) return;
+    node->value = value;
+    rankLink(index, node);
+}
+
+// First node at or after (value, id) in ascending order, or NULL
+RankNode* rankSeek(RankIndex* index, double value, int id) {
+    if (!index->head) return NULL;
+    RankNode* x = index->head;
+    for (int i = index->level - 1; i >= 0; i--) {
+        while (x->links[i].next && rankLess(x->links[i].next, value, id)) x = x->links[i].next;
+    }
+    return x->links[0].next;
+}
+
+// Node at 1-based ascending rank, or NULL if out of range
+RankNode* rankSelect(RankIndex* index, int rank) {
+    if (!index->head || rank < 1 || rank > index->count) return NULL;
+    RankNode* x = index->head;
+    int traversed = 0;
+    for (int i = index->level - 1; i >= 0; i--) {
+        while (x->links[i].next && traversed + x->links[i].span <= rank) {
+            traversed += x->links[i].span;
+            x = x->links[i].next;
+        }
+        if (traversed == rank) return x;
     }
     return NULL;
 }
 
-Principal* findPrincipal(int id) {
-    Principal* current = g_system.principals;
-    while (current) {
-        if (current->principalId == id) return current;
-        current = current->next;
+// Number of entries ordered before (value, id)
+int rankCountBelow(RankIndex* index, double value, int id) {
+    if (!index->head) return 0;
+    RankNode* x = index->head;
+    int traversed = 0;
+    for (int i = index->level - 1; i >= 0; i--) {
+        while (x->links[i].next && rankLess(x->links[i].next, value, id)) {
+            traversed += x->links[i].span;
+            x = x->links[i].next;
+        }
+    }
+    return traversed;
+}
+
+void rankFree(RankIndex* index) {
+    RankNode* x = index->head;
+    while (x) {
+        RankNode* next = x->links[0].next;
+        free(x);
+        x = next;
+    }
+    memset(index, 0, sizeof(RankIndex));
+}
+
+static int compareRankAscending(const void* a, const void* b) {
+    const RankEntry* x = (const RankEntry*)a;
+    const RankEntry* y = (const RankEntry*)b;
+    if (x->value != y->value) return x->value < y->value ? -1 : 1;
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+// Rebuilds index from entries: sort once, then append each node after the
+// last one at every level it reaches, with no top-down searches
+static void rankBuild(RankIndex* index, RankEntry* entries, int count) {
+    rankFree(index);
+    index->head = (RankNode*)calloc(1, sizeof(RankNode) + RANK_MAX_LEVEL * sizeof(index->head->links[0]));
+    index->level = 1;
+    index->seed = 2463534242u;
+    qsort(entries, count, sizeof(RankEntry), compareRankAscending);
+
+    RankNode* last[RANK_MAX_LEVEL];
+    int lastRank[RANK_MAX_LEVEL];
+    for (int i = 0; i < RANK_MAX_LEVEL; i++) {
+        last[i] = index->head;
+        lastRank[i] = 0;
+    }
+    for (int r = 0; r < count; r++) {
+        int level = rankRandomLevel(index);
+        RankNode* node = (RankNode*)malloc(sizeof(RankNode) + level * sizeof(node->links[0]));
+        node->value = entries[r].value;
+        node->id = entries[r].id;
+        node->level = level;
+        node->record = entries[r].record;
+        node->prev = r > 0 ? last[0] : NULL;
+        for (int i = 0; i < level; i++) {
+            last[i]->links[i].next = node;
+            last[i]->links[i].span = r + 1 - lastRank[i];
+            last[i] = node;
+            lastRank[i] = r + 1;
+        }
+        if (level > index->level) index->level = level;
+    }
+    // Trailing links span to the end, as rankLink expects
+    for (int i = 0; i < index->level; i++) {
+        last[i]->links[i].next = NULL;
+        last[i]->links[i].span = count - lastRank[i];
+    }
+    index->tail = count > 0 ? last[0] : NULL;
+    index->count = count;
+}
+
+// After a bulk load, which skips the per-record inserts
+void buildRankIndexes() {
+    int rows = g_studentColumns.count;
+    int subjectRows = g_subjectColumns.count;
+    RankEntry* entries = (RankEntry*)malloc(((rows > subjectRows ? rows : subjectRows) + 1) * sizeof(RankEntry));
+    for (int r = 0; r < rows; r++) {
+        entries[r].value = g_studentColumns.cgpa[r];
+        entries[r].id = g_studentColumns.studentId[r];
+        entries[r].record = g_studentColumns.record[r];
+    }
+    rankBuild(&g_cgpaRank, entries, rows);
+    for (int r = 0; r < rows; r++) {
+        entries[r].value = g_studentColumns.attendance[r];
+        entries[r].id = g_studentColumns.studentId[r];
+        entries[r].record = g_studentColumns.record[r];
+    }
+    rankBuild(&g_attendanceRank, entries, rows);
+
+    // Group subject rows by subject with a counting sort, then build each
+    int subjects = g_subjectAggregates.count;
+    int* start = (int*)calloc(subjects + 1, sizeof(int));
+    for (int r = 0; r < subjectRows; r++) start[g_subjectColumns.subjectKey[r] + 1]++;
+    for (int k = 0; k < subjects; k++) start[k + 1] += start[k];
+    int* fill = (int*)malloc((subjects + 1) * sizeof(int));
+    memcpy(fill, start, (subjects + 1) * sizeof(int));
+    for (int r = 0; r < subjectRows; r++) {
+        Student* s = g_studentColumns.record[g_subjectColumns.studentRow[r]];
+        RankEntry* e = &entries[fill[g_subjectColumns.subjectKey[r]]++];
+        e->value = g_subjectColumns.total[r];
+        e->id = s->studentId;
+        e->record = s;
+    }
+    for (int k = 0; k < subjects; k++) {
+        rankBuild(&g_subjectAggregates.items[k]->ranking, entries + start[k], start[k + 1] - start[k]);
+    }
+    free(fill);
+    free(start);
+    free(entries);
+}
+
+// departmentId -1 and year 0 match everything
+int rankMatches(Student* s, int departmentId, int year) {
+    return (departmentId < 0 || s->departmentId == departmentId) && (year == 0 || s->year == year);
+}
+
+// Whether a ranks ahead of b; ties go by studentId in the same direction
+static int rankAhead(RankEntry* a, RankEntry* b, int descending) {
+    if (a->value != b->value) return descending ? a->value > b->value : a->value < b->value;
+    return descending ? a->id > b->id : a->id < b->id;
+}
+
+// Bounded heap with the weakest kept entry at the root
+static void rankHeapSift(RankEntry* heap, int count, int i, int descending) {
+    for (;;) {
+        int weakest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < count && rankAhead(&heap[weakest], &heap[left], descending)) weakest = left;
+        if (right < count && rankAhead(&heap[weakest], &heap[right], descending)) weakest = right;
+        if (weakest == i) return;
+        RankEntry tmp = heap[i];
+        heap[i] = heap[weakest];
+        heap[weakest] = tmp;
+        i = weakest;
+    }
+}
+
+// Fills out with up to k entries passing the filters, best first, and
+// returns how many. The index is walked from the wanted end, which for a
+// department of d students out of n touches about k*n/d nodes. If that
+// walk passes d nodes without finishing (small or sparse departments),
+// the department's posting list is scanned with a bounded heap instead.
+// Subject indexes are always walked.
+int rankTopK(RankIndex* index, int metric, Department* d, int year, int k, int descending, RankEntry* out) {
+    int found = 0;
+    int departmentId = d ? d->id : -1;
+    int budget = d && metric != RANK_SUBJECT ? d->students.count : INT_MAX;
+    RankNode* x = NULL;
+    if (index->head) x = descending ? index->tail : index->head->links[0].next;
+    for (; x && found < k && budget > 0; budget--) {
+        if (rankMatches(x->record, departmentId, year)) {
+            out[found].value = x->value;
+            out[found].id = x->id;
+            out[found].record = x->record;
+            found++;
+        }
+        x = descending ? x->prev : x->links[0].next;
+    }
+    if (budget > 0 || found == k || !x) return found;
+
+    found = 0;
+    for (int i = 0; i < d->students.count; i++) {
+        Student* s = (Student*)d->students.items[i].record;
+        if (year != 0 && s->year != year) continue;
+        RankEntry e = {metric == RANK_CGPA ? s->cgpa : s->attendance, s->studentId, s};
+        if (found < k) {
+            // Sift the new leaf up to keep the weakest at the root
+            int c = found++;
+            out[c] = e;
+            while (c > 0 && rankAhead(&out[(c - 1) / 2], &out[c], descending)) {
+                RankEntry tmp = out[c];
+                out[c] = out[(c - 1) / 2];
+                out[(c - 1) / 2] = tmp;
+                c = (c - 1) / 2;
+            }
+        } else if (rankAhead(&e, &out[0], descending)) {
+            out[0] = e;
+            rankHeapSift(out, found, 0, descending);
+        }
+    }
+    // Pop the weakest to the back until the array is sorted best first
+    for (int n = found - 1; n > 0; n--) {
+        RankEntry tmp = out[0];
+        out[0] = out[n];
+        out[n] = tmp;
+        rankHeapSift(out, n, 0, descending);
+    }
+    return found;
+}
+
+void rankEntryToJSON(OutBuffer* out, RankEntry* e, int rank) {
+    jsonOpen(out, NULL, '{');
+    jsonPutInt(out, "rank", rank);
+    jsonPutInt(out, "studentId", e->id);
+    jsonPutString(out, "name", e->record->name);
+    jsonPutString(out, "department", e->record->department);
+    jsonPutInt(out, "year", e->record->year);
+    jsonPutNumber(out, "value", e->value);
+    jsonClose(out, '}');
+}
+
+// ---------------------------------------------------------------------------
+// JSON tokenizer
+// ---------------------------------------------------------------------------
+
+const char* jsonSkipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// p is just past an opening quote; returns the closing quote or NULL
+static const char* jsonSkipString(const char* p, const char* end) {
+    for (;;) {
+        const char* quote = (const char*)memchr(p, '"', end - p);
+        if (!quote) return NULL;
+        // The quote is escaped only if an odd run of backslashes precedes it
+        const char* b = quote;
+        while (b > p && b[-1] == '\\') b--;
+        if (((quote - b) & 1) == 0) return quote;
+        p = quote + 1;
+    }
+}
+
+// Returns the position just past the value starting at p, or NULL if malformed
+static const char* jsonSkipValue(const char* p, const char* end) {
+    if (*p == '"') {
+        p = jsonSkipString(p + 1, end);
+        return p ? p + 1 : NULL;
+    }
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        for (; p < end; p++) {
+            if (*p == '"') {
+                p = jsonSkipString(p + 1, end);
+                if (!p) return NULL;
+            } else if (*p == '{' || *p == '[') {
+                depth++;
+            } else if (*p == '}' || *p == ']') {
+                if (--depth == 0) return p + 1;
+            }
+        }
+        return NULL;
+    }
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+    return p > start ? p : NULL;
+}
+
+// Records the member key: value (value points at its first byte) and
+// returns the position just past the value, or NULL if it is malformed
+const char* jsonAddField(JsonObject* obj, const char* key, int keyLen, const char* value, const char* end) {
+    const char* valueEnd = jsonSkipValue(value, end);
+    if (!valueEnd || obj->count >= JSON_MAX_FIELDS) return valueEnd;
+    JsonField* field = &obj->fields[obj->count++];
+    field->key = key;
+    field->keyLen = keyLen;
+    if (*value == '"') {
+        field->type = JSON_STRING;
+        field->value = value + 1;
+        field->valueLen = (int)(valueEnd - value - 2);
+        field->escaped = memchr(field->value, '\\', field->valueLen) != NULL;
+    } else {
+        field->type = *value == '{' ? JSON_OBJECT : *value == '[' ? JSON_ARRAY : JSON_LITERAL;
+        field->value = value;
+        field->valueLen = (int)(valueEnd - value);
+        field->escaped = 0;
+    }
+    return valueEnd;
+}
+
+// Tokenizes the members of one JSON object in a single pass. Nested objects
+// and arrays are kept as raw spans. Members past JSON_MAX_FIELDS are skipped;
+// on malformed input the members read so far are kept and NULL is returned.
+// p points at the '{'; returns the position just past the closing '}'.
+const char* jsonParseObject(JsonObject* obj, const char* p, const char* end) {
+    const char* key;
+    const char* value;
+    int keyLen;
+    obj->count = 0;
+    if (p >= end || *p != '{') return NULL;
+    p++;
+    while ((value = jsonMemberNext(p, end, &key, &keyLen)) != NULL) {
+        p = jsonAddField(obj, key, keyLen, value, end);
+        if (!p) return NULL;
+    }
+    p = jsonSkipSpace(p, end);
+    return p < end && *p == '}' ? p + 1 : NULL;
+}
+
+int jsonParse(JsonObject* obj, const char* text, int len) {
+    const char* end = text + len;
+    return jsonParseObject(obj, jsonSkipSpace(text, end), end) ? 0 : -1;
+}
+
+// First member with this key, or NULL
+JsonField* jsonFind(JsonObject* obj, const char* key) {
+    int keyLen = (int)strlen(key);
+    for (int i = 0; i < obj->count; i++) {
+        JsonField* f = &obj->fields[i];
+        if (f->keyLen == keyLen && f->key[0] == key[0] && memcmp(f->key, key, keyLen) == 0) return f;
     }
     return NULL;
 }
 
-void parseJSON(char* json, char* key, char* value) {
+static int jsonHexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static unsigned int jsonHex4(const char* p, const char* end) {
+    unsigned int code = 0;
+    if (end - p < 4) return 0xFFFD;
+    for (int i = 0; i < 4; i++) {
+        int d = jsonHexDigit(p[i]);
+        if (d < 0) return 0xFFFD;
+        code = code * 16 + d;
+    }
+    return code;
+}
+
+// Copies a member's value into value (size bytes, always NUL-terminated),
+// decoding string escapes. Literals are copied as written; a missing member,
+// null, or a nested value yields "". Returns the length copied.
+int jsonString(JsonObject* obj, const char* key, char* value, int size) {
+    JsonField* f = jsonFind(obj, key);
+    int n = 0;
     value[0] = '\0';
-    char search[110];
-    sprintf(search, "\"%s\"", key);
-    char* key_pos = strstr(json, search);
-    if (key_pos) {
-        char* colon = strchr(key_pos + strlen(search), ':');
-        if (colon) {
-            char* start = strchr(colon, '"');
-            if (start) {
-                start++; // Move past opening quote
-                char* end = strchr(start, '"');
-                if (end) {
-                    int len = end - start;
-                    if (len > 99) len = 99;
-                    strncpy(value, start, len);
-                    value[len] = '\0';
+    if (!f || f->type == JSON_OBJECT || f->type == JSON_ARRAY) return 0;
+    if (f->type == JSON_LITERAL && f->valueLen == 4 && memcmp(f->value, "null", 4) == 0) return 0;
+
+    if (!f->escaped) {
+        n = f->valueLen < size - 1 ? f->valueLen : size - 1;
+        memcpy(value, f->value, n);
+        value[n] = '\0';
+        return n;
+    }
+
+    const char* p = f->value;
+    const char* end = f->value + f->valueLen;
+    while (p < end) {
+        char utf8[4];
+        int len = 1;
+        if (*p != '\\' || p + 1 >= end) {
+            utf8[0] = *p++;
+        } else {
+            p++;
+            char c = *p++;
+            switch (c) {
+                case 'b': utf8[0] = '\b'; break;
+                case 'f': utf8[0] = '\f'; break;
+                case 'n': utf8[0] = '\n'; break;
+                case 'r': utf8[0] = '\r'; break;
+                case 't': utf8[0] = '\t'; break;
+                case 'u': {
+                    unsigned int code = jsonHex4(p, end);
+                    p += end - p < 4 ? end - p : 4;
+                    if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        unsigned int low = jsonHex4(p + 2, end);
+                        if (low >= 0xDC00 && low <= 0xDFFF) {
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                            p += 6;
+                        }
+                    }
+                    if (code < 0x80) {
+                        utf8[0] = (char)code;
+                    } else if (code < 0x800) {
+                        utf8[0] = (char)(0xC0 | (code >> 6));
+                        utf8[1] = (char)(0x80 | (code & 0x3F));
+                        len = 2;
+                    } else if (code < 0x10000) {
+                        utf8[0] = (char)(0xE0 | (code >> 12));
+                        utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+                        utf8[2] = (char)(0x80 | (code & 0x3F));
+                        len = 3;
+                    } else {
+                        utf8[0] = (char)(0xF0 | (code >> 18));
+                        utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+                        utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+                        utf8[3] = (char)(0x80 | (code & 0x3F));
+                        len = 4;
+                    }
+                    break;
                 }
+                default: utf8[0] = c; break;  // \" \\ \/
             }
         }
+        if (n + len > size - 1) break;
+        memcpy(value + n, utf8, len);
+        n += len;
     }
+    value[n] = '\0';
+    return n;
+}
+
+// Numeric value of a member (quoted numbers accepted); 0 when missing
+double jsonNumber(JsonObject* obj, const char* key) {
+    JsonField* f = jsonFind(obj, key);
+    if (!f || f->type == JSON_OBJECT || f->type == JSON_ARRAY) return 0.0;
+    return jsonSpanNumber(f->value, f->valueLen);
 }
 
-double parseJSONNumber(char* json, char* key) {
-    char search[110];
-    sprintf(search, "\"%s\"", key);
-    char* key_pos = strstr(json, search);
-    if (key_pos) {
-        char* colon = strchr(key_pos + strlen(search), ':');
-        if (colon) {
-            return atof(colon + 1);
+// Numeric value of a token span (not NUL-terminated)
+double jsonSpanNumber(const char* text, int len) {
+    char number[64];
+
+    // Fast path for plain decimals, which is what every client sends
+    const char* p = text;
+    const char* end = text + len;
+    int negative = p < end && *p == '-';
+    double value = 0.0, scale = 1.0;
+    if (negative) p++;
+    while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            scale /= 10;
+            value += (*p - '0') * scale;
         }
     }
-    return 0.0;
+    if (p == end) return negative ? -value : value;
+
+    if (len > (int)sizeof(number) - 1) len = (int)sizeof(number) - 1;
+    memcpy(number, text, len);
+    number[len] = '\0';
+    return atof(number);
+}
+
+int jsonInt(JsonObject* obj, const char* key) {
+    return (int)jsonNumber(obj, key);
+}
+
+// Steps through the members of an object without tokenizing their values.
+// Start with p just past the '{' and pass back the position after each value;
+// returns the start of the next value (its key in key/keyLen), or NULL at the
+// closing '}' or on malformed input.
+const char* jsonMemberNext(const char* p, const char* end, const char** key, int* keyLen) {
+    p = jsonSkipSpace(p, end);
+    if (p < end && *p == ',') p = jsonSkipSpace(p + 1, end);
+    if (p >= end || *p != '"') return NULL;
+    *key = p + 1;
+    p = jsonSkipString(p + 1, end);
+    if (!p) return NULL;
+    *keyLen = (int)(p - *key);
+    p = jsonSkipSpace(p + 1, end);
+    if (p >= end || *p != ':') return NULL;
+    p = jsonSkipSpace(p + 1, end);
+    return p < end ? p : NULL;
+}
+
+// Escape sequence for one byte that cannot appear raw in a JSON string
+static int jsonEscapeChar(unsigned char c, char* esc) {
+    esc[0] = '\\';
+    switch (c) {
+        case '"': esc[1] = '"'; return 2;
+        case '\\': esc[1] = '\\'; return 2;
+        case '\n': esc[1] = 'n'; return 2;
+        case '\r': esc[1] = 'r'; return 2;
+        case '\t': esc[1] = 't'; return 2;
+        default: return sprintf(esc, "\\u%04x", c);
+    }
+}
+
+// Writes text as the inside of a JSON string literal; truncates on a
+// character boundary when out is too small. Returns out.
+const char* jsonEscape(const char* text, char* out, int size) {
+    int n = 0;
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        char esc[8];
+        int len = 1;
+        if (*p < 0x20 || *p == '"' || *p == '\\') len = jsonEscapeChar(*p, esc);
+        else esc[0] = (char)*p;
+        if (n + len > size - 1) break;
+        memcpy(out + n, esc, len);
+        n += len;
+    }
+    out[n] = '\0';
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// JSON response writer (appends to a growable OutBuffer)
+// ---------------------------------------------------------------------------
+
+// Writes the comma before a member or element unless it is the first one,
+// then the "key": prefix when a key is given. Every writer starts with this.
+void jsonPutKey(OutBuffer* out, const char* key) {
+    if (out->len > 0) {
+        char last = out->data[out->len - 1];
+        if (last != '{' && last != '[' && last != ':') queueOutput(out, ",", 1);
+    }
+    if (key) {
+        queueOutput(out, "\"", 1);
+        queueOutput(out, key, (int)strlen(key));
+        queueOutput(out, "\":", 2);
+    }
 }
 
-int parseJSONInt(char* json, char* key) {
-    return (int)parseJSONNumber(json, key);
+void jsonOpen(OutBuffer* out, const char* key, char bracket) {
+    jsonPutKey(out, key);
+    queueOutput(out, &bracket, 1);
+}
+
+void jsonClose(OutBuffer* out, char bracket) {
+    queueOutput(out, &bracket, 1);
+}
+
+// Quoted and escaped; runs of plain characters are copied in one go
+void jsonPutString(OutBuffer* out, const char* key, const char* value) {
+    jsonPutKey(out, key);
+    queueOutput(out, "\"", 1);
+    const char* run = value;
+    for (const char* p = value; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        char esc[8];
+        queueOutput(out, run, (int)(p - run));
+        queueOutput(out, esc, jsonEscapeChar(c, esc));
+        run = p + 1;
+    }
+    queueOutput(out, run, (int)strlen(run));
+    queueOutput(out, "\"", 1);
+}
+
+void jsonPutInt(OutBuffer* out, const char* key, long long value) {
+    char digits[24];
+    int n = sizeof(digits);
+    unsigned long long v = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[--n] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0) digits[--n] = '-';
+    jsonPutKey(out, key);
+    queueOutput(out, digits + n, (int)sizeof(digits) - n);
+}
+
+// Two decimals, as every score and percentage in the API is reported
+void jsonPutNumber(OutBuffer* out, const char* key, double value) {
+    char number[64];
+    jsonPutKey(out, key);
+    queueOutput(out, number, snprintf(number, sizeof(number), "%.2f", value));
+}
+
+// Literal JSON such as true or false
+void jsonPutRaw(OutBuffer* out, const char* key, const char* raw) {
+    jsonPutKey(out, key);
+    queueOutput(out, raw, (int)strlen(raw));
 }
 
 void getCurrentTimestamp(char* buffer) {
@@ -1036,276 +6453,446 @@ void getCurrentTimestamp(char* buffer) {
     strftime(buffer, 50, "%Y-%m-%d %H:%M:%S", t);
 }
 
-// Convert subject array to JSON array string
-void subjectsToJSON(Subject* subjects, int count, char* output) {
-    strcpy(output, "[");
+// Appends the subjects as a JSON array value
+void subjectsToJSON(Subject* subjects, int count, OutBuffer* out) {
+    jsonOpen(out, NULL, '[');
     for (int i = 0; i < count; i++) {
-        if (i > 0) strcat(output, ",");
-        char subjStr[512];
-        int total = subjects[i].mid1 + subjects[i].mid2 + subjects[i].final;
-        sprintf(subjStr, "{\"subjectId\":\"%s\",\"name\":\"%s\",\"mid1\":%d,\"mid2\":%d,\"final\":%d,\"total\":%d,\"attendance_percent\":%.2f,\"remarks\":\"%s\"}",
-            subjects[i].subjectId, subjects[i].name, subjects[i].mid1, subjects[i].mid2, subjects[i].final, total, subjects[i].attendance_percent, subjects[i].remarks);
-        strcat(output, subjStr);
+        jsonOpen(out, NULL, '{');
+        jsonPutString(out, "subjectId", subjects[i].subjectId);
+        jsonPutString(out, "name", subjects[i].name);
+        jsonPutInt(out, "mid1", subjects[i].mid1);
+        jsonPutInt(out, "mid2", subjects[i].mid2);
+        jsonPutInt(out, "final", subjects[i].final);
+        jsonPutInt(out, "total", subjects[i].mid1 + subjects[i].mid2 + subjects[i].final);
+        jsonPutNumber(out, "attendance_percent", subjects[i].attendance_percent);
+        jsonPutString(out, "remarks", subjects[i].remarks);
+        jsonClose(out, '}');
     }
-    strcat(output, "]");
+    jsonClose(out, ']');
 }
 
-// Find subject in student's subject array by subjectId
-Subject* findStudentSubject(Student* s, char* subjectId) {
-    for (int i = 0; i < s->subjectCount; i++) {
-        if (strcmp(s->subjects[i].subjectId, subjectId) == 0) {
-            return &s->subjects[i];
+// One teacher list entry
+void teacherToJSON(OutBuffer* out, Teacher* t) {
+    jsonOpen(out, NULL, '{');
+    jsonPutInt(out, "teacherId", t->teacherId);
+    jsonPutString(out, "name", t->name);
+    jsonPutString(out, "email", t->email);
+    jsonPutString(out, "department", t->department);
+    jsonClose(out, '}');
+}
+
+// One student list entry, restricted to the projected fields
+void studentToJSON(OutBuffer* out, Student* s, int fields) {
+    jsonOpen(out, NULL, '{');
+    jsonPutInt(out, "studentId", s->studentId);
+    if (fields & FIELD_NAME) jsonPutString(out, "name", s->name);
+    if (fields & FIELD_EMAIL) jsonPutString(out, "email", s->email);
+    if (fields & FIELD_DEPARTMENT) jsonPutString(out, "department", s->department);
+    if (fields & FIELD_YEAR) jsonPutInt(out, "year", s->year);
+    if (fields & FIELD_CGPA) jsonPutNumber(out, "cgpa", s->cgpa);
+    if (fields & FIELD_ATTENDANCE) jsonPutNumber(out, "attendance", s->attendance);
+    jsonClose(out, '}');
+}
+
+// Comma-separated field names to a FIELD_* mask; -1 on an unknown name
+int parseStudentFields(const char* list) {
+    static const struct { const char* name; int flag; } names[] = {
+        {"studentId", 0}, {"name", FIELD_NAME}, {"email", FIELD_EMAIL},
+        {"department", FIELD_DEPARTMENT}, {"year", FIELD_YEAR},
+        {"cgpa", FIELD_CGPA}, {"attendance", FIELD_ATTENDANCE}
+    };
+    int mask = 0;
+    const char* p = list;
+    while (*p) {
+        const char* comma = strchr(p, ',');
+        int len = comma ? (int)(comma - p) : (int)strlen(p);
+        int known = (len == 0);
+        for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])) && !known; i++) {
+            if ((int)strlen(names[i].name) == len && strncmp(p, names[i].name, len) == 0) {
+                mask |= names[i].flag;
+                known = 1;
+            }
+        }
+        if (!known) return -1;
+        p += len + (comma ? 1 : 0);
+    }
+    return mask;
+}
+
+// Decodes %XX escapes and '+' in a query-string value, in place
+void urlDecode(char* text) {
+    char* out = text;
+    for (char* p = text; *p; p++) {
+        if (*p == '%' && jsonHexDigit(p[1]) >= 0 && jsonHexDigit(p[2]) >= 0) {
+            *out++ = (char)(jsonHexDigit(p[1]) * 16 + jsonHexDigit(p[2]));
+            p += 2;
+        } else {
+            *out++ = (*p == '+') ? ' ' : *p;
         }
     }
+    *out = '\0';
+}
+
+// Find subject by subjectId: binary search on the hashed keys, then
+// compare names only for equal hashes
+Subject* findStudentSubject(Student* s, const char* subjectId) {
+    unsigned int h = hashString(subjectId);
+    int lo = subjectKeySeek(s, h);
+    for (int i = lo; i < s->subjectCount && s->subjectKeys[i].hash == h; i++) {
+        Subject* subj = &s->subjects[s->subjectKeys[i].index];
+        if (strcmp(subj->subjectId, subjectId) == 0) return subj;
+    }
     return NULL;
 }
 
 
-void saveToFile() {
-    FILE* f = fopen("database.json", "w");
+static void snapshotStudent(OutBuffer* out, Student* s, int first) {
+    char esc[1200];
+    if (!first) bufPrintf(out, ",\n");
+    bufPrintf(out, "    {\n");
+    bufPrintf(out, "      \"studentId\": %d,\n", s->studentId);
+    bufPrintf(out, "      \"name\": \"%s\",\n", jsonEscape(s->name, esc, sizeof(esc)));
+    bufPrintf(out, "      \"password\": \"%s\",\n", jsonEscape(s->password, esc, sizeof(esc)));
+    bufPrintf(out, "      \"email\": \"%s\",\n", jsonEscape(s->email, esc, sizeof(esc)));
+    bufPrintf(out, "      \"department\": \"%s\",\n", jsonEscape(s->department, esc, sizeof(esc)));
+    bufPrintf(out, "      \"year\": %d,\n", s->year);
+    bufPrintf(out, "      \"semester\": %d,\n", s->semester);
+    bufPrintf(out, "      \"cgpa\": %.2f,\n", s->cgpa);
+    bufPrintf(out, "      \"attendance\": %.2f,\n", s->attendance);
+    bufPrintf(out, "      \"subjects\": [\n");
+    for (int i = 0; i < s->subjectCount; i++) {
+        if (i > 0) bufPrintf(out, ",\n");
+        bufPrintf(out, "        {\n");
+        bufPrintf(out, "          \"subjectId\": \"%s\",\n", jsonEscape(s->subjects[i].subjectId, esc, sizeof(esc)));
+        bufPrintf(out, "          \"name\": \"%s\",\n", jsonEscape(s->subjects[i].name, esc, sizeof(esc)));
+        bufPrintf(out, "          \"mid1\": %d,\n", s->subjects[i].mid1);
+        bufPrintf(out, "          \"mid2\": %d,\n", s->subjects[i].mid2);
+        bufPrintf(out, "          \"final\": %d,\n", s->subjects[i].final);
+        bufPrintf(out, "          \"attendance_percent\": %.2f,\n", s->subjects[i].attendance_percent);
+        bufPrintf(out, "          \"remarks\": \"%s\"\n", jsonEscape(s->subjects[i].remarks, esc, sizeof(esc)));
+        bufPrintf(out, "        }");
+    }
+    bufPrintf(out, "\n      ]\n");
+    bufPrintf(out, "    }");
+}
+
+static void snapshotTeacher(OutBuffer* out, Teacher* t, int first) {
+    char esc[720];
+    if (!first) bufPrintf(out, ",\n");
+    bufPrintf(out, "    {\n");
+    bufPrintf(out, "      \"teacherId\": %d,\n", t->teacherId);
+    bufPrintf(out, "      \"name\": \"%s\",\n", jsonEscape(t->name, esc, sizeof(esc)));
+    bufPrintf(out, "      \"password\": \"%s\",\n", jsonEscape(t->password, esc, sizeof(esc)));
+    bufPrintf(out, "      \"email\": \"%s\",\n", jsonEscape(t->email, esc, sizeof(esc)));
+    bufPrintf(out, "      \"department\": \"%s\",\n", jsonEscape(t->department, esc, sizeof(esc)));
+    bufPrintf(out, "      \"approved\": %d,\n", t->approved);
+    bufPrintf(out, "      \"approvalDate\": \"%s\"\n", jsonEscape(t->approvalDate, esc, sizeof(esc)));
+    bufPrintf(out, "    }");
+}
+
+// Moves a serialized chunk to the file; returns -1 on a short write
+static int snapshotWrite(FILE* f, OutBuffer* chunk, long long* bytes) {
+    int ok = chunk->len == 0 || fwrite(chunk->data, 1, chunk->len, f) == (size_t)chunk->len;
+    *bytes += chunk->len;
+    chunk->len = 0;
+    return ok ? 0 : -1;
+}
+
+// Writes g_system to database.json crash-safely: the snapshot goes to a temp
+// file that is fsynced and then renamed over the old one, so a crash leaves
+// either the old or the new file intact. Records are copied out in short
+// g_systemLock read holds and written to disk with no lock held. Writers may
+// change records between chunks; such changes carry LSNs above walLsn and
+// replay idempotently on top of the snapshot. Returns 0 on success.
+int saveToFile(unsigned long long walLsn) {
+    long long started = nowMillis();
+    long long bytes = 0;
+    int failed = 0;
+    OutBuffer chunk = {0};
+
+    FILE* f = fopen(DATABASE_TMP_FILE, "wb");
     if (!f) {
-        printf("Error: Cannot create database.json\n");
-        return;
+        logError("snapshot_failed", "file=%s step=create", DATABASE_TMP_FILE);
+        g_snapshotStats.failures++;
+        return -1;
     }
 
-    fprintf(f, "{\n");
-    fprintf(f, "  \"nextStudentId\": %d,\n", g_system.nextStudentId);
-    fprintf(f, "  \"nextTeacherId\": %d,\n", g_system.nextTeacherId);
-    fprintf(f, "  \"nextPrincipalId\": %d,\n", g_system.nextPrincipalId);
-    
-    // Save students with subjects
-    fprintf(f, "  \"students\": [\n");
+    rwlockReadLock(&g_systemLock);
     Student* s = g_system.students;
-    int firstStudent = 1;
-    while (s) {
-        if (!firstStudent) fprintf(f, ",\n");
-        firstStudent = 0;
-        
-        fprintf(f, "    {\n");
-        fprintf(f, "      \"studentId\": %d,\n", s->studentId);
-        fprintf(f, "      \"name\": \"%s\",\n", s->name);
-        fprintf(f, "      \"password\": \"%s\",\n", s->password);
-        fprintf(f, "      \"email\": \"%s\",\n", s->email);
-        fprintf(f, "      \"department\": \"%s\",\n", s->department);
-        fprintf(f, "      \"year\": %d,\n", s->year);
-        fprintf(f, "      \"semester\": %d,\n", s->semester);
-        fprintf(f, "      \"cgpa\": %.2f,\n", s->cgpa);
-        fprintf(f, "      \"attendance\": %.2f,\n", s->attendance);
-        fprintf(f, "      \"subjects\": [\n");
-        
-        for (int i = 0; i < s->subjectCount; i++) {
-            if (i > 0) fprintf(f, ",\n");
-            fprintf(f, "        {\n");
-            fprintf(f, "          \"subjectId\": \"%s\",\n", s->subjects[i].subjectId);
-            fprintf(f, "          \"name\": \"%s\",\n", s->subjects[i].name);
-            fprintf(f, "          \"mid1\": %d,\n", s->subjects[i].mid1);
-            fprintf(f, "          \"mid2\": %d,\n", s->subjects[i].mid2);
-            fprintf(f, "          \"final\": %d,\n", s->subjects[i].final);
-            fprintf(f, "          \"attendance_percent\": %.2f,\n", s->subjects[i].attendance_percent);
-            fprintf(f, "          \"remarks\": \"%s\"\n", s->subjects[i].remarks);
-            fprintf(f, "        }");
-        }
-        
-        fprintf(f, "\n      ]\n");
-        fprintf(f, "    }");
-        s = s->next;
-    }
-    fprintf(f, "\n  ],\n");
-    
-    // Save teachers
-    fprintf(f, "  \"teachers\": [\n");
     Teacher* t = g_system.teachers;
-    int firstTeacher = 1;
-    while (t) {
-        if (!firstTeacher) fprintf(f, ",\n");
-        firstTeacher = 0;
-        
-        fprintf(f, "    {\n");
-        fprintf(f, "      \"teacherId\": %d,\n", t->teacherId);
-        fprintf(f, "      \"name\": \"%s\",\n", t->name);
-        fprintf(f, "      \"password\": \"%s\",\n", t->password);
-        fprintf(f, "      \"email\": \"%s\",\n", t->email);
-        fprintf(f, "      \"department\": \"%s\",\n", t->department);
-        fprintf(f, "      \"approved\": %d,\n", t->approved);
-        fprintf(f, "      \"approvalDate\": \"%s\"\n", t->approvalDate);
-        fprintf(f, "    }");
-        t = t->next;
-    }
-    fprintf(f, "\n  ]\n");
-    
-    fprintf(f, "}\n");
-    fclose(f);
+    bufPrintf(&chunk, "{\n");
+    bufPrintf(&chunk, "  \"nextStudentId\": %d,\n", g_system.nextStudentId);
+    bufPrintf(&chunk, "  \"nextTeacherId\": %d,\n", g_system.nextTeacherId);
+    bufPrintf(&chunk, "  \"nextPrincipalId\": %d,\n", g_system.nextPrincipalId);
+    bufPrintf(&chunk, "  \"walLsn\": %llu,\n", walLsn);
+    rwlockReadUnlock(&g_systemLock);
+
+    // Save students with subjects
+    bufPrintf(&chunk, "  \"students\": [\n");
+    int first = 1;
+    while (s && !failed) {
+        rwlockReadLock(&g_systemLock);
+        for (int n = 0; s && n < SNAPSHOT_CHUNK; n++, s = s->next) {
+            snapshotStudent(&chunk, s, first);
+            first = 0;
+        }
+        rwlockReadUnlock(&g_systemLock);
+        failed = snapshotWrite(f, &chunk, &bytes) != 0;
+    }
+    bufPrintf(&chunk, "\n  ],\n");
+
+    // Save teachers
+    bufPrintf(&chunk, "  \"teachers\": [\n");
+    first = 1;
+    while (t && !failed) {
+        rwlockReadLock(&g_systemLock);
+        for (int n = 0; t && n < SNAPSHOT_CHUNK; n++, t = t->next) {
+            snapshotTeacher(&chunk, t, first);
+            first = 0;
+        }
+        rwlockReadUnlock(&g_systemLock);
+        failed = snapshotWrite(f, &chunk, &bytes) != 0;
+    }
+    bufPrintf(&chunk, "\n  ]\n");
+    bufPrintf(&chunk, "}\n");
+    if (!failed) failed = snapshotWrite(f, &chunk, &bytes) != 0;
+    free(chunk.data);
+
+    if (fflush(f) != 0 || fileSyncFd(fileno(f)) != 0) failed = 1;
+    if (fclose(f) != 0) failed = 1;
+    if (failed || fileReplace(DATABASE_TMP_FILE, DATABASE_FILE) != 0) {
+        logError("snapshot_failed", "file=%s step=write", DATABASE_FILE);
+        remove(DATABASE_TMP_FILE);
+        g_snapshotStats.failures++;
+        return -1;
+    }
+
+    g_snapshotStats.count++;
+    g_snapshotStats.lastBytes = bytes;
+    g_snapshotStats.lastDurationMs = nowMillis() - started;
+    g_snapshotStats.totalDurationMs += g_snapshotStats.lastDurationMs;
+    return 0;
 }
 
-void loadFromFile() {
-    FILE* f = fopen("database.json", "r");
-    if (!f) {
-        printf("No existing database found. Creating new system...\n");
-        // Create default student
-        Student* stu = (Student*)malloc(sizeof(Student));
-        stu->studentId = g_system.nextStudentId++;
-        strcpy(stu->name, "Default Student");
-        strcpy(stu->password, DEFAULT_STUDENT_PASSWORD);
-        strcpy(stu->email, "student@example.edu");
-        strcpy(stu->department, "CSE");
-        stu->year = 1;
-        stu->semester = 1;
-        stu->cgpa = 0.0;
-        stu->attendance = 0.0;
-        stu->subjectCount = 0;
-        stu->next = NULL;
-        g_system.students = stu;
-        saveToFile();
-        printf("Default student created: ID=%d, Password=%s\n", stu->studentId, DEFAULT_STUDENT_PASSWORD);
-        return;
+// Returns zeroed, 16-byte aligned memory that lives for the whole run
+void* arenaAlloc(Arena* arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    ArenaBlock* block = arena->head;
+    if (!block || block->used + size > block->cap) {
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock));
+        block->cap = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+#if defined(_WIN32)
+        block->data = (char*)VirtualAlloc(NULL, block->cap, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#elif defined(MAP_POPULATE)
+        // Blocks fill up completely, so fault all their pages in with one call
+        block->data = (char*)mmap(NULL, block->cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (block->data == MAP_FAILED) block->data = (char*)calloc(1, block->cap);
+#else
+        block->data = (char*)calloc(1, block->cap);
+#endif
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
     }
+    void* p = block->data + block->used;
+    block->used += size;
+    arena->bytes += size;
+    return p;
+}
 
-    // Read entire file
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    
-    char* content = (char*)malloc(fsize + 1);
-    fread(content, 1, fsize, f);
-    content[fsize] = '\0';
-    fclose(f);
+int mapFile(MappedFile* m, const char* path) {
+    memset(m, 0, sizeof(MappedFile));
+#ifdef _WIN32
+    m->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) return -1;
+    LARGE_INTEGER size;
+    GetFileSizeEx(m->file, &size);
+    m->size = (size_t)size.QuadPart;
+    if (m->size == 0) return 0;
+    m->mapping = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m->mapping) m->data = (const char*)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m->data) {
+        unmapFile(m);
+        return -1;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    m->size = (size_t)st.st_size;
+    if (m->size > 0) {
+        void* data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        madvise(data, m->size, MADV_SEQUENTIAL);
+        m->data = (const char*)data;
+    }
+    close(fd);  // the mapping keeps the file referenced
+#endif
+    return 0;
+}
 
-    // Parse JSON metadata
-    g_system.nextStudentId = parseJSONInt(content, "nextStudentId");
-    g_system.nextTeacherId = parseJSONInt(content, "nextTeacherId");
-    g_system.nextPrincipalId = parseJSONInt(content, "nextPrincipalId");
-
-    // Parse students array
-    char* studentsArray = strstr(content, "\"students\":");
-    if (studentsArray) {
-        char* studentStart = strchr(studentsArray, '[');
-        if (studentStart) {
-            char* current = studentStart + 1;
-            while (*current && *current != ']') {
-                // Find next student object
-                char* objStart = strchr(current, '{');
-                if (!objStart || objStart > strchr(current, ']')) break;
-                
-                char* objEnd = objStart;
-                int braceCount = 1;
-                objEnd++;
-                while (*objEnd && braceCount > 0) {
-                    if (*objEnd == '{') braceCount++;
-                    else if (*objEnd == '}') braceCount--;
-                    objEnd++;
-                }
-                
-                // Extract student JSON
-                int len = objEnd - objStart;
-                char* studentJSON = (char*)malloc(len + 1);
-                strncpy(studentJSON, objStart, len);
-                studentJSON[len] = '\0';
-                
-                // Parse student
-                Student* s = (Student*)malloc(sizeof(Student));
-                memset(s, 0, sizeof(Student));
-                s->studentId = parseJSONInt(studentJSON, "studentId");
-                parseJSON(studentJSON, "name", s->name);
-                parseJSON(studentJSON, "password", s->password);
-                parseJSON(studentJSON, "email", s->email);
-                parseJSON(studentJSON, "department", s->department);
-                s->year = parseJSONInt(studentJSON, "year");
-                s->semester = parseJSONInt(studentJSON, "semester");
-                s->cgpa = parseJSONNumber(studentJSON, "cgpa");
-                s->attendance = parseJSONNumber(studentJSON, "attendance");
-                s->subjectCount = 0;
-                
-                // Parse subjects for this student
-                char* subjArray = strstr(studentJSON, "\"subjects\":");
-                if (subjArray) {
-                    char* subjStart = strchr(subjArray, '[');
-                    if (subjStart) {
-                        char* subjCurrent = subjStart + 1;
-                        while (*subjCurrent && *subjCurrent != ']' && s->subjectCount < 10) {
-                            char* subjObjStart = strchr(subjCurrent, '{');
-                            if (!subjObjStart || subjObjStart > strchr(subjCurrent, ']')) break;
-                            
-                            char* subjObjEnd = subjObjStart;
-                            int subjBraces = 1;
-                            subjObjEnd++;
-                            while (*subjObjEnd && subjBraces > 0) {
-                                if (*subjObjEnd == '{') subjBraces++;
-                                else if (*subjObjEnd == '}') subjBraces--;
-                                subjObjEnd++;
-                            }
-                            
-                            int subjLen = subjObjEnd - subjObjStart;
-                            char* subjJSON = (char*)malloc(subjLen + 1);
-                            strncpy(subjJSON, subjObjStart, subjLen);
-                            subjJSON[subjLen] = '\0';
-                            
-                            Subject* subj = &s->subjects[s->subjectCount];
-                            memset(subj, 0, sizeof(Subject));
-                            parseJSON(subjJSON, "subjectId", subj->subjectId);
-                            parseJSON(subjJSON, "name", subj->name);
-                            subj->mid1 = parseJSONInt(subjJSON, "mid1");
-                            subj->mid2 = parseJSONInt(subjJSON, "mid2");
-                            subj->final = parseJSONInt(subjJSON, "final");
-                            subj->attendance_percent = parseJSONNumber(subjJSON, "attendance_percent");
-                            parseJSON(subjJSON, "remarks", subj->remarks);
-                            
-                            s->subjectCount++;
-                            free(subjJSON);
-                            subjCurrent = subjObjEnd;
-                        }
-                    }
-                }
-                
-                s->next = g_system.students;
-                g_system.students = s;
-                free(studentJSON);
-                current = objEnd;
+void unmapFile(MappedFile* m) {
+#ifdef _WIN32
+    if (m->data) UnmapViewOfFile(m->data);
+    if (m->mapping) CloseHandle(m->mapping);
+    if (m->file && m->file != INVALID_HANDLE_VALUE) CloseHandle(m->file);
+#else
+    if (m->data) munmap((void*)m->data, m->size);
+#endif
+    memset(m, 0, sizeof(MappedFile));
+}
+
+static const char* loadSubjects(Student* s, const char* p, const char* end) {
+    JsonObject rec;
+    p = jsonSkipSpace(p + 1, end);
+    while (p < end && *p == '{') {
+        p = jsonParseObject(&rec, p, end);
+        if (!p) return NULL;
+        char subjectId[20];
+        jsonString(&rec, "subjectId", subjectId, sizeof(subjectId));
+        Subject* subj = addStudentSubject(s, subjectId);
+        jsonString(&rec, "name", subj->name, sizeof(subj->name));
+        subj->mid1 = jsonInt(&rec, "mid1");
+        subj->mid2 = jsonInt(&rec, "mid2");
+        subj->final = jsonInt(&rec, "final");
+        subj->attendance_percent = jsonNumber(&rec, "attendance_percent");
+        jsonString(&rec, "remarks", subj->remarks, sizeof(subj->remarks));
+        p = jsonSkipSpace(p, end);
+        if (p < end && *p == ',') p = jsonSkipSpace(p + 1, end);
+    }
+    return p < end && *p == ']' ? p + 1 : NULL;
+}
+
+static const char* loadStudents(const char* p, const char* end) {
+    JsonObject rec;
+    const char* key;
+    const char* value;
+    int keyLen;
+    Student* tail = NULL;
+    for (Student* s = g_system.students; s; s = s->next) tail = s;
+
+    p = jsonSkipSpace(p + 1, end);
+    while (p < end && *p == '{') {
+        Student* s = (Student*)arenaAlloc(&g_recordArena, sizeof(Student));
+
+        // Scalar members are tokenized; the subjects array is loaded in place
+        rec.count = 0;
+        p++;
+        while ((value = jsonMemberNext(p, end, &key, &keyLen)) != NULL) {
+            if (keyLen == 8 && memcmp(key, "subjects", 8) == 0 && *value == '[') {
+                p = loadSubjects(s, value, end);
+            } else {
+                p = jsonAddField(&rec, key, keyLen, value, end);
             }
+            if (!p) return NULL;
         }
+        p = jsonSkipSpace(p, end);
+        if (p >= end || *p != '}') return NULL;
+        p++;
+
+        s->studentId = jsonInt(&rec, "studentId");
+        jsonString(&rec, "name", s->name, sizeof(s->name));
+        jsonString(&rec, "password", s->password, sizeof(s->password));
+        jsonString(&rec, "email", s->email, sizeof(s->email));
+        jsonString(&rec, "department", s->department, sizeof(s->department));
+        s->year = jsonInt(&rec, "year");
+        s->semester = jsonInt(&rec, "semester");
+        s->cgpa = jsonNumber(&rec, "cgpa");
+        s->attendance = jsonNumber(&rec, "attendance");
+        appendStudent(s, &tail);
+
+        p = jsonSkipSpace(p, end);
+        if (p < end && *p == ',') p = jsonSkipSpace(p + 1, end);
     }
+    return p < end && *p == ']' ? p + 1 : NULL;
+}
 
-    // Parse teachers array
-    char* teachersArray = strstr(content, "\"teachers\":");
-    if (teachersArray) {
-        char* teacherStart = strchr(teachersArray, '[');
-        if (teacherStart) {
-            char* current = teacherStart + 1;
-            while (*current && *current != ']') {
-                char* objStart = strchr(current, '{');
-                if (!objStart || objStart > strchr(current, ']')) break;
-                
-                char* objEnd = objStart;
-                int braceCount = 1;
-                objEnd++;
-                while (*objEnd && braceCount > 0) {
-                    if (*objEnd == '{') braceCount++;
-                    else if (*objEnd == '}') braceCount--;
-                    objEnd++;
-                }
-                
-                int len = objEnd - objStart;
-                char* teacherJSON = (char*)malloc(len + 1);
-                strncpy(teacherJSON, objStart, len);
-                teacherJSON[len] = '\0';
-                
-                Teacher* t = (Teacher*)malloc(sizeof(Teacher));
-                memset(t, 0, sizeof(Teacher));
-                t->teacherId = parseJSONInt(teacherJSON, "teacherId");
-                parseJSON(teacherJSON, "name", t->name);
-                parseJSON(teacherJSON, "password", t->password);
-                parseJSON(teacherJSON, "email", t->email);
-                parseJSON(teacherJSON, "department", t->department);
-                t->approved = parseJSONInt(teacherJSON, "approved");
-                parseJSON(teacherJSON, "approvalDate", t->approvalDate);
-                
-                t->next = g_system.teachers;
-                g_system.teachers = t;
-                free(teacherJSON);
-                current = objEnd;
+static const char* loadTeachers(const char* p, const char* end) {
+    JsonObject rec;
+    Teacher* tail = NULL;
+    for (Teacher* t = g_system.teachers; t; t = t->next) tail = t;
+
+    p = jsonSkipSpace(p + 1, end);
+    while (p < end && *p == '{') {
+        p = jsonParseObject(&rec, p, end);
+        if (!p) return NULL;
+
+        Teacher* t = (Teacher*)arenaAlloc(&g_recordArena, sizeof(Teacher));
+        t->teacherId = jsonInt(&rec, "teacherId");
+        jsonString(&rec, "name", t->name, sizeof(t->name));
+        jsonString(&rec, "password", t->password, sizeof(t->password));
+        jsonString(&rec, "email", t->email, sizeof(t->email));
+        jsonString(&rec, "department", t->department, sizeof(t->department));
+        t->approved = jsonInt(&rec, "approved");
+        jsonString(&rec, "approvalDate", t->approvalDate, sizeof(t->approvalDate));
+        appendTeacher(t, &tail);
+
+        p = jsonSkipSpace(p, end);
+        if (p < end && *p == ',') p = jsonSkipSpace(p + 1, end);
+    }
+    return p < end && *p == ']' ? p + 1 : NULL;
+}
+
+// Loads a snapshot in one forward pass over a memory-mapped copy of the file.
+// Records are carved from g_recordArena and keep their file order. Returns 0
+// on success, -1 if the file cannot be opened, -2 if it is malformed (the
+// records before the damage stay loaded).
+int loadDatabase(const char* path) {
+    MappedFile db;
+    if (mapFile(&db, path) != 0) return -1;
+
+    const char* end = db.data + db.size;
+    const char* p = db.data ? jsonSkipSpace(db.data, end) : end;
+    int complete = p < end && *p == '{';
+    if (complete) p++;
+
+    const char* key;
+    int keyLen;
+    const char* value;
+    while (complete && (value = jsonMemberNext(p, end, &key, &keyLen)) != NULL) {
+        if (keyLen == 8 && memcmp(key, "students", 8) == 0 && *value == '[') {
+            p = loadStudents(value, end);
+        } else if (keyLen == 8 && memcmp(key, "teachers", 8) == 0 && *value == '[') {
+            p = loadTeachers(value, end);
+        } else {
+            // Scalar metadata
+            p = jsonSkipValue(value, end);
+            if (p) {
+                double number = jsonSpanNumber(value, (int)(p - value));
+                if (keyLen == 13 && memcmp(key, "nextStudentId", 13) == 0) g_system.nextStudentId = (int)number;
+                else if (keyLen == 13 && memcmp(key, "nextTeacherId", 13) == 0) g_system.nextTeacherId = (int)number;
+                else if (keyLen == 15 && memcmp(key, "nextPrincipalId", 15) == 0) g_system.nextPrincipalId = (int)number;
+                else if (keyLen == 6 && memcmp(key, "walLsn", 6) == 0) g_wal.checkpointLsn = (unsigned long long)number;
             }
         }
+        if (!p) complete = 0;
     }
 
-    free(content);
-    printf("System data loaded successfully from database.json\n");
+    unmapFile(&db);
+    sortDepartmentLists();
+    buildRankIndexes();
+    return complete ? 0 : -2;
+}
+
+int loadFromFile() {
+    int result = loadDatabase(DATABASE_FILE);
+    if (result == -2) return -1;
+    if (result != 0) {
+        logInfo("database_created", "file=%s", DATABASE_FILE);
+        // Create default student
+        Student* stu = createStudent(g_system.nextStudentId, "Default Student", DEFAULT_STUDENT_PASSWORD,
+                                     "student@example.edu", "CSE", 1);
+        saveToFile(0);
+        logInfo("default_student_created", "studentId=%d", stu->studentId);
+        return 0;
+    }
+    logInfo("database_loaded", "file=%s students=%d teachers=%d", DATABASE_FILE, g_studentIndex.count, g_teacherIndex.count);
+    return 0;
 }
@@ -34,6 +34,12 @@ const StudentManagementSystem = () => {
   };
 
   const handleLogout = () => {
+    if (userData?.token) {
+      fetch('http://localhost:8080/api/logout', {
+        method: 'POST',
+        headers: { Authorization: `Bearer ${userData.token}` }
+      }).catch(() => {});
+    }
     setCurrentView('landing');
     setUserRole(null);
     setUserData(null);
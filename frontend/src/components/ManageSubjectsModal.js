@@ -19,6 +19,11 @@ const ManageSubjectsModal = ({ isOpen, student, teacher, onClose, onSave }) => {
   const [successMsg, setSuccessMsg] = useState('');
   const [studentData, setStudentData] = useState(student);
 
+  // Teachers authenticate with the session token from their login
+  const authHeaders = () => (teacher?.token
+    ? { 'Content-Type': 'application/json', Authorization: `Bearer ${teacher.token}` }
+    : { 'Content-Type': 'application/json' });
+
   // Update CGPA and attendance when student data changes
   useEffect(() => {
     if (student) {
@@ -164,12 +169,11 @@ const ManageSubjectsModal = ({ isOpen, student, teacher, onClose, onSave }) => {
       } else {
         payload.role = 'teacher';
         payload.email = teacher?.email;
-        payload.password = teacher?.password;
       }
 
       const response = await fetch(`http://localhost:8080/api/students/${studentData.studentId}/subjects`, {
         method: 'POST',
-        headers: { 'Content-Type': 'application/json' },
+        headers: authHeaders(),
         body: JSON.stringify(payload)
       });
 
@@ -230,12 +234,11 @@ const ManageSubjectsModal = ({ isOpen, student, teacher, onClose, onSave }) => {
       } else {
         payload.role = 'teacher';
         payload.email = teacher?.email;
-        payload.password = teacher?.password;
       }
 
       const response = await fetch(`http://localhost:8080/api/students/${studentData.studentId}/subjects/${editingSubjectId}`, {
         method: 'PUT',
-        headers: { 'Content-Type': 'application/json' },
+        headers: authHeaders(),
         body: JSON.stringify(payload)
       });
 
@@ -291,12 +294,11 @@ const ManageSubjectsModal = ({ isOpen, student, teacher, onClose, onSave }) => {
       } else {
         payload.role = 'teacher';
         payload.email = teacher?.email;
-        payload.password = teacher?.password;
       }
 
       const response = await fetch(`http://localhost:8080/api/students/${studentData.studentId}/academics`, {
         method: 'PUT',
-        headers: { 'Content-Type': 'application/json' },
+        headers: authHeaders(),
         body: JSON.stringify(payload)
       });
 
@@ -6,6 +6,7 @@ const PrincipalDashboard = ({ onLogout, showMessage }) => {
   const [pendingTeachers, setPendingTeachers] = useState([]);
   const [teachers, setTeachers] = useState([]);
   const [students, setStudents] = useState([]);
+  const [stats, setStats] = useState(null);
   const [loading, setLoading] = useState(true);
   const [activeTab, setActiveTab] = useState('pending');
   const [departmentFilter, setDepartmentFilter] = useState('');
@@ -39,6 +40,15 @@ const PrincipalDashboard = ({ onLogout, showMessage }) => {
         setStudents(await studentRes.json());
       }
 
+      // Fetch institution-wide summary (computed server-side)
+      const statsRes = await fetch('http://localhost:8080/api/stats', {
+        method: 'GET',
+        headers: { 'Content-Type': 'application/json' }
+      });
+      if (statsRes.ok) {
+        setStats(await statsRes.json());
+      }
+
       // Fetch all teachers
       const allTeachersRes = await fetch('http://localhost:8080/api/teachers', {
         method: 'GET',
@@ -229,11 +239,11 @@ const PrincipalDashboard = ({ onLogout, showMessage }) => {
           <div style={statLabelStyle}>Pending Teachers</div>
         </div>
         <div style={statCardStyle('linear-gradient(135deg, #f093fb 0%, #f5576c 100%)')}>
-          <div style={statNumberStyle}>{students.length}</div>
+          <div style={statNumberStyle}>{stats ? stats.students : students.length}</div>
           <div style={statLabelStyle}>Total Students</div>
         </div>
         <div style={statCardStyle('linear-gradient(135deg, #4facfe 0%, #00f2fe 100%)')}>
-          <div style={statNumberStyle}>{Math.round(students.reduce((sum, s) => sum + s.cgpa, 0) / (students.length || 1) * 10) / 10}</div>
+          <div style={statNumberStyle}>{stats ? Math.round((stats.cgpa.mean || 0) * 10) / 10 : Math.round(students.reduce((sum, s) => sum + s.cgpa, 0) / (students.length || 1) * 10) / 10}</div>
           <div style={statLabelStyle}>Avg CGPA</div>
         </div>
       </div>
@@ -4,7 +4,7 @@ import ManageSubjectsModal from './ManageSubjectsModal';
 
 const TeacherDashboard = ({ teacherData, onLogout, showMessage }) => {
   const [teacher, setTeacher] = useState(teacherData || {});
-  const [teacherPassword, setTeacherPassword] = useState(teacherData?.password || '');
+  const [sessionToken, setSessionToken] = useState(teacherData?.token || '');
   const [students, setStudents] = useState([]);
   const [loading, setLoading] = useState(true);
   const [activeTab, setActiveTab] = useState('profile');
@@ -13,8 +13,8 @@ const TeacherDashboard = ({ teacherData, onLogout, showMessage }) => {
   const [selectedStudent, setSelectedStudent] = useState(null);
 
   useEffect(() => {
-    if (teacherData?.password) {
-      setTeacherPassword(teacherData.password);
+    if (teacherData?.token) {
+      setSessionToken(teacherData.token);
     }
     refreshTeacher();
     fetchStudents();
@@ -365,7 +365,7 @@ const TeacherDashboard = ({ teacherData, onLogout, showMessage }) => {
       <ManageSubjectsModal
         isOpen={showModal}
         student={selectedStudent}
-        teacher={{ ...teacher, password: teacherPassword }}
+        teacher={{ ...teacher, token: sessionToken }}
         onClose={() => {
           setShowModal(false);
           setSelectedStudent(null);